@@ -6,20 +6,229 @@
 //  Copyright © 2020 Antony Searle. All rights reserved.
 //
 
+#include <chrono>
+#include <iterator>
+#include <map>
+#include <thread>
+#include <vector>
+
 #include "awrc.hpp"
 
 #include <catch2/catch.hpp>
 
 namespace manic {
 
+// force distinct keys into a few buckets to exercise lnodes
+struct _colliding_key {
+    u64 x;
+    bool operator==(_colliding_key const& other) const { return x == other.x; }
+};
+
+inline u64 hash(_colliding_key const& k) {
+    return k.x & 3;
+}
+
 TEST_CASE("ctrie") {
-    
-    ctrie<int, int> a;
-    
-    REQUIRE(a.lookup(7) == nullptr);
-    
-    
-    
+
+    SECTION("basic") {
+
+        ctrie<int, int> a;
+
+        REQUIRE_FALSE(a.lookup(7));
+        REQUIRE_FALSE(a.insert(7, 1));
+        REQUIRE(a.lookup(7) == 1);
+        REQUIRE(a.insert(7, 2) == 1);
+        REQUIRE(a.lookup(7) == 2);
+        REQUIRE(a.try_emplace(7, 3) == 2);
+        REQUIRE(a.try_emplace(8, 3) == 3);
+        REQUIRE(a.size() == 2);
+        REQUIRE(a.remove(7) == 2);
+        REQUIRE_FALSE(a.remove(7));
+        REQUIRE_FALSE(a.lookup(7));
+        REQUIRE(a.size() == 1);
+
+    }
+
+    SECTION("sequential") {
+
+        const int N = 100'000;
+        ctrie<int, int> a;
+        for (int i = 0; i != N; ++i)
+            REQUIRE_FALSE(a.insert(i, -i));
+        for (int i = 0; i != N; ++i)
+            REQUIRE(a.lookup(i) == -i);
+        REQUIRE(a.size() == N);
+        for (int i = 0; i != N; i += 2)
+            REQUIRE(a.remove(i) == -i);
+        for (int i = 0; i != N; ++i)
+            REQUIRE(a.contains(i) == (i & 1));
+
+    }
+
+    SECTION("collisions") {
+
+        const u64 N = 1'000;
+        ctrie<_colliding_key, u64> a;
+        for (u64 i = 0; i != N; ++i)
+            a.insert(_colliding_key{i}, i);
+        for (u64 i = 0; i != N; ++i)
+            REQUIRE(a.lookup(_colliding_key{i}) == i);
+        for (u64 i = 0; i != N; ++i)
+            REQUIRE(a.remove(_colliding_key{i}) == i);
+        REQUIRE(a.size() == 0);
+
+    }
+
+    SECTION("snapshot") {
+
+        const int N = 10'000;
+        ctrie<int, int> a;
+        for (int i = 0; i != N; ++i)
+            a.insert(i, i);
+
+        auto b = a.snapshot();
+        auto c = a.read_only_snapshot();
+
+        for (int i = 0; i != N; i += 2)
+            a.remove(i);
+        for (int i = 1; i < N; i += 2)
+            b.insert(i, -i);
+
+        REQUIRE(a.size() == N / 2);
+        REQUIRE(b.size() == N);
+        REQUIRE(c.size() == N);
+        for (int i = 0; i != N; ++i) {
+            REQUIRE(a.lookup(i) == ((i & 1) ? std::optional<int>(i) : std::nullopt));
+            REQUIRE(b.lookup(i) == ((i & 1) ? -i : i));
+            REQUIRE(c.lookup(i) == i);
+        }
+
+    }
+
+    SECTION("stress") {
+
+        // threads race to insert, replace and remove overlapping keys while
+        // snapshots are taken; each thread finally owns a disjoint range
+
+        const int N = 10'000;
+        const int M = std::max(4u, std::thread::hardware_concurrency());
+
+        ctrie<int, int> a;
+        std::vector<std::thread> t;
+        std::atomic<int> snapshots{0};
+        std::atomic<bool> consistent{true};
+        for (int i = 0; i != M; ++i) {
+            t.emplace_back([&, i] {
+                for (int j = 0; j != N; ++j) {
+                    int k = (j * M + i) % (N * 2);
+                    a.insert(k, i);
+                    a.try_emplace(k ^ 1, i);
+                    a.remove(k ^ 2);
+                    if (!(j % 1'000)) {
+                        // (Catch is not thread-safe)
+                        auto b = a.read_only_snapshot();
+                        b.for_each([&](int k, int v) {
+                            if (k < 0 || k >= N * (2 + M) || v < 0 || v >= M)
+                                consistent = false;
+                        });
+                        ++snapshots;
+                    }
+                }
+                for (int j = 0; j != N; ++j)
+                    a.insert(N * 2 + i * N + j, i);
+            });
+        }
+        for (auto& s : t)
+            s.join();
+        REQUIRE(snapshots == M * N / 1'000);
+        REQUIRE(consistent);
+        for (int i = 0; i != M; ++i)
+            for (int j = 0; j != N; ++j)
+                REQUIRE(a.lookup(N * 2 + i * N + j) == i);
+
+    }
+
+    SECTION("snapshot consistency") {
+
+        // each thread inserts its own keys in order and publishes how many
+        // it has inserted; a snapshot must then hold, for each thread, the
+        // prefix of its keys that was published before the snapshot was
+        // taken, and at most one more key than was published after
+
+        const int N = 20'000;
+        const int M = 4;
+
+        ctrie<int, int> a;
+        std::vector<std::atomic<int>> published(M);
+        for (auto& p : published)
+            p.store(0);
+        std::vector<std::thread> t;
+        for (int i = 0; i != M; ++i) {
+            t.emplace_back([&, i] {
+                for (int j = 0; j != N; ++j) {
+                    a.insert(i * N + j, i);
+                    published[i].store(j + 1, std::memory_order_release);
+                }
+            });
+        }
+        for (bool done = false; !done;) {
+            std::vector<int> before(M), after(M);
+            for (int i = 0; i != M; ++i)
+                before[i] = published[i].load(std::memory_order_acquire);
+            auto b = a.read_only_snapshot();
+            done = true;
+            for (int i = 0; i != M; ++i) {
+                after[i] = published[i].load(std::memory_order_acquire);
+                done = done && (after[i] == N);
+            }
+            std::map<int, int> model;
+            b.for_each([&](int k, int v) { model.emplace(k, v); });
+            for (int i = 0; i != M; ++i) {
+                // this thread's keys are [i * N, i * N + n)
+                auto first = model.lower_bound(i * N);
+                auto last = model.lower_bound((i + 1) * N);
+                int n = (int) std::distance(first, last);
+                REQUIRE(before[i] <= n);
+                REQUIRE(n <= after[i] + 1);
+                if (n) {
+                    REQUIRE(first->first == i * N);
+                    REQUIRE(std::prev(last)->first == i * N + n - 1);
+                }
+                for (auto p = first; p != last; ++p)
+                    REQUIRE(p->second == i);
+            }
+            REQUIRE((isize) model.size() == b.size());
+        }
+        for (auto& s : t)
+            s.join();
+
+    }
+
+}
+
+TEST_CASE("ctrie scaling", "[.benchmark]") {
+
+    const int N = 1'000'000;
+
+    for (int M = 1; M <= (int) std::thread::hardware_concurrency(); M *= 2) {
+        ctrie<int, int> a;
+        auto t0 = std::chrono::steady_clock::now();
+        std::vector<std::thread> t;
+        for (int i = 0; i != M; ++i) {
+            t.emplace_back([&, i] {
+                for (int j = i; j < N; j += M)
+                    a.try_emplace(j, j);
+                for (int j = i; j < N; j += M)
+                    a.lookup(j);
+            });
+        }
+        for (auto& s : t)
+            s.join();
+        auto t1 = std::chrono::steady_clock::now();
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        printf("ctrie: %d threads, %g ns/op\n", M, (double) ns / (2 * N));
+    }
+
 }
 
 }
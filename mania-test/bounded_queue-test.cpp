@@ -0,0 +1,206 @@
+//
+//  bounded_queue-test.cpp
+//  mania-test
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "bounded_queue.hpp"
+
+namespace manic {
+
+TEST_CASE("bounded_queue") {
+
+    SECTION("fifo") {
+
+        bounded_queue<int> const a(5);
+        REQUIRE(a.capacity() == 8);
+        int x = -1;
+        REQUIRE(!a.try_pop(x));
+        for (int i = 0; i != 8; ++i)
+            REQUIRE(a.try_push(i));
+        REQUIRE(!a.try_push(8));
+        REQUIRE(a.size() == 8);
+        for (int i = 0; i != 8; ++i) {
+            REQUIRE(a.try_pop(x));
+            REQUIRE(x == i);
+        }
+        REQUIRE(!a.try_pop(x));
+        // wrap around many times
+        for (int i = 0; i != 100; ++i) {
+            a.push(i);
+            REQUIRE(a.pop() == i);
+        }
+
+    }
+
+    SECTION("failed push leaves the value") {
+
+        bounded_queue<std::unique_ptr<int>> const a(2);
+        REQUIRE(a.try_push(std::make_unique<int>(0)));
+        REQUIRE(a.try_push(std::make_unique<int>(1)));
+        auto p = std::make_unique<int>(2);
+        REQUIRE(!a.try_push(std::move(p)));
+        REQUIRE(p);
+        REQUIRE(*a.pop() == 0);
+        REQUIRE(a.try_push(std::move(p)));
+        REQUIRE(!p);
+
+    }
+
+    SECTION("batches") {
+
+        bounded_queue<int> const a(8);
+        int b[12];
+        for (int i = 0; i != 12; ++i)
+            b[i] = i;
+        REQUIRE(a.try_push_n(b, 0) == 0);
+        REQUIRE(a.try_push_n(b, 5) == 5);
+        REQUIRE(a.try_push_n(b + 5, 7) == 3); // <-- partial
+        REQUIRE(a.try_push_n(b + 8, 4) == 0);
+        int c[12] = {};
+        REQUIRE(a.try_pop_n(c, 3) == 3);
+        REQUIRE(a.try_pop_n(c + 3, 12) == 5);
+        REQUIRE(a.try_pop_n(c + 8, 4) == 0);
+        for (int i = 0; i != 8; ++i)
+            REQUIRE(c[i] == i);
+
+    }
+
+    SECTION("destruction") {
+
+        auto p = std::make_shared<int>(0);
+        {
+            bounded_queue<std::shared_ptr<int>> const a(4);
+            a.push(p);
+            a.push(p);
+            a.push(p);
+            a.pop();
+            REQUIRE(p.use_count() == 3);
+        }
+        REQUIRE(p.use_count() == 1);
+
+    }
+
+    SECTION("threads") {
+
+        // producers mix single and batch pushes; consumers mix single and
+        // batch pops; the queue is small so both ends block often
+        const int P = 3;
+        const int C = 3;
+        const i64 N = 20000;
+        bounded_queue<i64> const a(16);
+        std::vector<std::thread> t;
+        for (int p = 0; p != P; ++p)
+            t.emplace_back([&, p] {
+                i64 b[7];
+                for (i64 i = 0; i != N;) {
+                    if (i % 3) {
+                        a.push(p * N + i++);
+                    } else {
+                        isize n = std::min<i64>(7, N - i);
+                        for (isize k = 0; k != n; ++k)
+                            b[k] = p * N + i++;
+                        a.push_n(b, n);
+                    }
+                }
+            });
+        std::vector<std::vector<i64>> r(C);
+        for (int c = 0; c != C; ++c)
+            t.emplace_back([&, c] {
+                i64 b[5];
+                // stop on the sentinels pushed after the producers join
+                for (;;) {
+                    if (c & 1) {
+                        i64 x = a.pop();
+                        if (x < 0)
+                            return;
+                        r[c].push_back(x);
+                    } else {
+                        isize n = a.pop_n(b, 5);
+                        for (isize k = 0; k != n; ++k) {
+                            if (b[k] < 0) {
+                                // put back sentinels that belong to others
+                                for (isize j = k + 1; j != n; ++j)
+                                    if (b[j] < 0)
+                                        a.push(b[j]);
+                                    else
+                                        r[c].push_back(b[j]);
+                                return;
+                            }
+                            r[c].push_back(b[k]);
+                        }
+                    }
+                }
+            });
+        for (int p = 0; p != P; ++p)
+            t[p].join();
+        for (int c = 0; c != C; ++c)
+            a.push(-1);
+        for (int c = 0; c != C; ++c)
+            t[P + c].join();
+
+        std::vector<i64> all;
+        for (auto& v : r) {
+            // each consumer sees each producer's values in order
+            std::vector<i64> last(P, -1);
+            for (i64 x : v) {
+                REQUIRE(x > last[x / N]);
+                last[x / N] = x;
+            }
+            all.insert(all.end(), v.begin(), v.end());
+        }
+        std::sort(all.begin(), all.end());
+        REQUIRE(all.size() == P * N);
+        for (i64 i = 0; i != P * N; ++i)
+            REQUIRE(all[i] == i);
+
+    }
+
+}
+
+TEST_CASE("bounded_queue benchmark", "[.benchmark]") {
+
+    using ns = std::chrono::duration<double, std::nano>;
+    const i64 N = 1 << 22;
+    bounded_queue<i64> const a(1024);
+
+    for (isize batch : {1, 4, 16, 64}) {
+        auto t0 = std::chrono::steady_clock::now();
+        std::thread producer([&] {
+            std::vector<i64> b(batch);
+            for (i64 i = 0; i != N; i += batch) {
+                for (isize k = 0; k != batch; ++k)
+                    b[k] = i + k;
+                if (batch == 1)
+                    a.push(b[0]);
+                else
+                    a.push_n(b.data(), batch);
+            }
+        });
+        std::vector<i64> b(batch);
+        i64 sum = 0;
+        for (i64 i = 0; i != N;) {
+            isize n = batch == 1 ? (b[0] = a.pop(), 1) : a.pop_n(b.data(), batch);
+            for (isize k = 0; k != n; ++k)
+                sum += b[k];
+            i += n;
+        }
+        producer.join();
+        auto t1 = std::chrono::steady_clock::now();
+        printf("bounded_queue: batch %td, %g ns per element (%lld)\n",
+               batch, ns(t1 - t0).count() / N, (long long) sum);
+    }
+
+}
+
+} // namespace manic
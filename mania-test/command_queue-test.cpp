@@ -0,0 +1,108 @@
+//
+//  command_queue-test.cpp
+//  mania-test
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#include <thread>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "command_queue.hpp"
+
+namespace manic {
+
+TEST_CASE("command_queue", "[command_queue]") {
+
+    command_queue q;
+
+    SECTION("empty") {
+
+        REQUIRE(q.drain().empty());
+
+    }
+
+    SECTION("order") {
+
+        // two senders, interleaved; the batch is ordered by source and then
+        // by sequence, whatever the order of the pushes
+        auto a = q.sender(1);
+        auto b = q.sender(0);
+        for (u64 i = 0; i != 10; ++i) {
+            a.write({(i64) i, 0}, i);
+            b.add({(i64) i, 1}, i);
+        }
+        matrix<u64> m(2, 3, 7);
+        b.paste({4, 4}, m);
+        auto v = q.drain();
+        REQUIRE(v.size() == 21);
+        for (u64 i = 0; i != 10; ++i) {
+            REQUIRE(v[i]._source == 0);
+            REQUIRE(v[i]._sequence == i);
+            REQUIRE(v[i]._kind == command::ADD);
+            REQUIRE(v[i]._xy == vec<i64, 2>{(i64) i, 1});
+        }
+        REQUIRE(v[10]._kind == command::PASTE);
+        REQUIRE(v[10]._region.rows() == 2);
+        REQUIRE(v[10]._region.columns() == 3);
+        for (u64 i = 0; i != 10; ++i) {
+            REQUIRE(v[11 + i]._source == 1);
+            REQUIRE(v[11 + i]._sequence == i);
+            REQUIRE(v[11 + i]._value == i);
+        }
+        REQUIRE(q.drain().empty());
+
+    }
+
+    SECTION("undrained") {
+
+        // a queue destroyed before it is drained deletes the entities of
+        // its spawns (the leak checker sees any it misses)
+        command_queue r;
+        auto s = r.sender(0);
+        s.spawn(new entity2);
+        s.write({0, 0}, 1);
+        s.spawn(new entity2);
+
+    }
+
+    SECTION("concurrent") {
+
+        // senders on other threads while the consumer drains each "tick"
+        const u64 T = 4;
+        const u64 N = 10000;
+        std::vector<std::thread> t;
+        for (u64 k = 0; k != T; ++k)
+            t.emplace_back([&q, k] {
+                auto s = q.sender(k);
+                for (u64 i = 0; i != N; ++i)
+                    s.write({0, 0}, i);
+            });
+        std::vector<u64> next(T, 0);
+        u64 n = 0;
+        auto drain = [&] {
+            for (command const& c : q.drain()) {
+                // each source's commands arrive once, in order
+                REQUIRE(c._sequence == next[c._source]);
+                REQUIRE(c._value == next[c._source]);
+                ++next[c._source];
+                ++n;
+            }
+        };
+        while (n != T * N) {
+            drain();
+            std::this_thread::yield();
+        }
+        for (auto& u : t)
+            u.join();
+        drain();
+        REQUIRE(n == T * N);
+
+    }
+
+}
+
+} // namespace manic
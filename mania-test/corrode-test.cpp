@@ -6,10 +6,12 @@
 //  Copyright © 2020 Antony Searle. All rights reserved.
 //
 
-#include <experimental/coroutine>
+#include <cstdlib>
+#include <coroutine>
 #include <future>
 #include <map>
 #include <list>
+#include <string>
 #include <thread>
 #include <utility>
 #include <vector>
@@ -78,7 +80,7 @@ TEST_CASE("await-future", "[await]") {
     printf("0\n");
     []() -> void {
         printf("a\n");
-        int i = co_await []() -> future<int> {
+        int i = co_await []() -> manic::task<int> {
             printf("b\n");
             co_await transfer;
             printf("c\n");
@@ -123,3 +125,132 @@ TEST_CASE("stress", "[await]") {
     
 }
 
+
+TEST_CASE("await-file", "[await]") {
+    
+    char name[] = "/tmp/corrode-XXXXXX";
+    int fd = mkstemp(name);
+    REQUIRE(fd >= 0);
+    unlink(name);
+    
+    std::promise<std::string> p;
+    auto f = [&]() -> void {
+        std::string a = "hello, world";
+        ssize_t r = co_await write_at(fd, 4, a);
+        assert(r == (ssize_t) a.size());
+        std::string b(a.size(), '\0');
+        r = co_await read_at(fd, 4, b);
+        assert(r == (ssize_t) b.size());
+        p.set_value(b);
+    };
+    f();
+    REQUIRE(p.get_future().get() == "hello, world");
+    
+    close(fd);
+    
+}
+
+namespace manic {
+
+namespace {
+
+task<i64> fib(i64 n) {
+    if (n < 2)
+        co_return n;
+    auto [a, b] = co_await when_all(fib(n - 1), fib(n - 2));
+    co_return a + b;
+}
+
+task<i64> square(i64 n) {
+    co_await transfer;
+    co_return n * n;
+}
+
+// Polls until cancelled, or gives up
+task<bool> poll() {
+    for (int i = 0; i != 10'000; ++i) {
+        if (co_await cancelled)
+            co_return true;
+        co_await std::chrono::milliseconds(1);
+    }
+    co_return false;
+}
+
+generator<i64> iota(i64 n) {
+    for (i64 i = 0; i != n; ++i)
+        co_yield i;
+}
+
+} // namespace
+
+TEST_CASE("task", "[task]") {
+    
+    SECTION("chains") {
+        
+        auto f = []() -> task<i64> {
+            i64 x = co_await square(3);
+            i64 y = co_await square(4);
+            co_return x + y;
+        };
+        REQUIRE(sync_wait(f()) == 25);
+        
+        // (resumed by symmetric transfer, so in optimized builds the depth is
+        // not limited by the stack)
+        auto g = [](auto& self, i64 n) -> task<i64> {
+            if (!n)
+                co_return 0;
+            i64 m = co_await self(self, n - 1);
+            co_return m + 1;
+        };
+        REQUIRE(sync_wait(g(g, 1'000)) == 1'000);
+        
+    }
+    
+    SECTION("when_all") {
+        
+        REQUIRE(sync_wait(fib(20)) == 6765);
+        
+        std::vector<task<i64>> v;
+        for (i64 i = 0; i != 100; ++i)
+            v.push_back(square(i));
+        auto w = sync_wait(when_all(std::move(v)));
+        REQUIRE(w.size() == 100);
+        for (i64 i = 0; i != 100; ++i)
+            REQUIRE(w[i] == i * i);
+        
+        auto [a, b] = sync_wait(when_all([]() -> task<> { co_return; }(), square(5)));
+        REQUIRE(b == 25);
+        
+    }
+    
+    SECTION("when_any and cancellation") {
+        
+        std::vector<task<bool>> v;
+        v.push_back(poll());
+        v.push_back(poll());
+        v.push_back([]() -> task<bool> { co_return false; }());
+        v.push_back(poll());
+        auto [i, x] = sync_wait(when_any(std::move(v)));
+        REQUIRE(i == 2);
+        REQUIRE(!x);
+        
+        // cancellation from outside reaches nested tasks
+        auto c = cancellation::make();
+        c.cancel();
+        auto f = []() -> task<bool> { co_return co_await poll(); };
+        REQUIRE(sync_wait(with_cancellation(f(), c)));
+        
+    }
+    
+    SECTION("generator") {
+        
+        i64 n = 0;
+        for (auto& x : iota(10))
+            n += x;
+        REQUIRE(n == 45);
+        
+    }
+    
+}
+
+} // namespace manic
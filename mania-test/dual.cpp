@@ -483,7 +483,9 @@ struct dual {
 
 
 TEST_CASE("dual", "[dual]") {
+#ifdef __FN_EXTANT
     printf("extant: %llu\n", detail::node<void()>::_extant.load(std::memory_order_relaxed));
+#endif
 
     {
     int z = 0;
@@ -502,13 +504,17 @@ TEST_CASE("dual", "[dual]") {
     a.pop_and_call();
     REQUIRE(z == 3);
     }
+#ifdef __FN_EXTANT
     printf("extant: %llu\n", detail::node<void()>::_extant.load(std::memory_order_relaxed));
+#endif
 
 }
 
 TEST_CASE("dual-multi", "[dual]") {
     
+#ifdef __FN_EXTANT
     printf("extant: %llu\n", detail::node<void()>::_extant.load(std::memory_order_relaxed));
+#endif
     {
     dual d;
     auto n = std::thread::hardware_concurrency();
@@ -551,13 +557,17 @@ TEST_CASE("dual-multi", "[dual]") {
         t.pop_back();
     }
     }
+#ifdef __FN_EXTANT
     printf("extant: %llu\n", detail::node<void()>::_extant.load(std::memory_order_relaxed));
+#endif
     
 }
 
 TEST_CASE("dual-exhaust", "[dual]") {
     {
+#ifdef __FN_EXTANT
         printf("extant: %llu\n", detail::node<void()>::_extant.load(std::memory_order_relaxed));
+#endif
         
         dual d;
         auto n = std::thread::hardware_concurrency();
@@ -612,7 +622,9 @@ TEST_CASE("dual-exhaust", "[dual]") {
         printf("submitted %llu jobs\n", y.load(std::memory_order_relaxed));
         printf("executed  %llu jobs\n", z.load(std::memory_order_relaxed));
     }
+#ifdef __FN_EXTANT
     printf("extant: %llu\n", detail::node<void()>::_extant.load(std::memory_order_relaxed));
+#endif
     
 }
 
@@ -658,16 +670,4 @@ struct pool_dual : dual {
     
 };
 
-void pool_submit_one(fn<void()> f) {
-    pool_dual::_get().push(std::move(f));
-}
-
-void pool_submit_many(stack<fn<void()>> s) {
-    pool_dual const& r = pool_dual::_get();
-    s.reverse();
-    while (!s.empty()) {
-        r.push(s.pop());
-    }
-}
-
 }
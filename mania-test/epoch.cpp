@@ -1,259 +1,238 @@
-// epoch-based garbage collection
 //
-// in imitation of Crossbeam https://github.com/crossbeam-rs/crossbeam in an
-// attempt to grok it
+//  epoch.cpp
+//  mania-test
+//
+//  Created by Antony Searle on 17/8/20.
+//  Copyright © 2020 Antony Searle. All rights reserved.
+//
 
-#include <array>
-#include <functional>
-#include <map>
-#include <optional>
+#include <chrono>
+#include <cstdio>
 #include <thread>
 #include <vector>
 
 #include "atomic.hpp"
-#include "corrode.hpp"
 #include "epoch.hpp"
-#include "tagged.hpp"
+#include "queue.hpp"
 
 #include <catch2/catch.hpp>
 
 namespace manic {
 
-template<typename F>
-void defer(F&& f);
-
+namespace {
 
+// Michael-Scott queue reclaimed by epochs, to compare with the split
+// reference counts of Atomic<queue<T>>
 template<typename T>
-struct Queue {
-    
-    struct Node {
-        Atomic<Node const*> next;
-        union { T payload; };
+struct _epoch_queue {
+
+    struct node {
+        std::atomic<node*> _next;
+        T _payload;
     };
-    
-    // false sharing
-    Atomic<Node const*> head;
-    Atomic<Node const*> tail;
-    
-    Queue()
-    : Queue(new Node { nullptr }) {
-    }
-    
-    explicit Queue(Node const* ptr)
-    : head(ptr)
-    , tail(ptr) {
+
+    alignas(64) std::atomic<node*> _head;
+    alignas(64) std::atomic<node*> _tail;
+
+    _epoch_queue() : _head(new node{nullptr, T()}), _tail(_head.load()) {}
+
+    ~_epoch_queue() {
+        for (node* p = _head.load(); p;)
+            delete std::exchange(p, p->_next.load());
     }
-    
+
     void push(T x) {
-        Node const* desired = new Node { nullptr, std::move(x) };
-        Node const* tail = this->tail.load(std::memory_order_acquire);
+        node* n = new node{nullptr, std::move(x)};
+        epoch::guard g;
         for (;;) {
-            assert(tail);
-            Node const* next = tail->next.load(std::memory_order_acquire);
-            if (!next && tail->next.compare_exchange_strong(next,
-                                                            desired,
-                                                            std::memory_order_release,
-                                                            std::memory_order_acquire)) {
+            node* t = _tail.load(std::memory_order_acquire);
+            node* next = t->_next.load(std::memory_order_acquire);
+            if (next) {
+                // help a lagging push
+                _tail.compare_exchange_weak(t, next, std::memory_order_release, std::memory_order_relaxed);
+            } else if (t->_next.compare_exchange_weak(next, n, std::memory_order_release, std::memory_order_relaxed)) {
+                _tail.compare_exchange_strong(t, n, std::memory_order_release, std::memory_order_relaxed);
                 return;
             }
-            assert(next);
-            if (this->tail.compare_exchange_strong(tail,
-                                                   next,
-                                                   std::memory_order_release,
-                                                   std::memory_order_acquire)) {
-                tail = next;
-            }
         }
     }
-    
-    std::optional<T> try_pop() {
-        Node const* head = this->head.load(std::memory_order_acquire);
+
+    bool try_pop(T& x) {
+        epoch::guard g;
         for (;;) {
-            assert(head);
-            if (Node const* next = head->next.load(std::memory_order_acquire)) {
-                if (this->head.compare_exchange_strong(head,
-                                                       next,
-                                                       std::memory_order_release,
-                                                       std::memory_order_acquire)) {
-                    defer([=] { delete head; });
-                    T tmp{std::move(next->payload)};
-                    next->payload.~T();
-                    return tmp;
-                }
-            } else {
-                return std::optional<T>{};
+            node* h = _head.load(std::memory_order_acquire);
+            node* t = _tail.load(std::memory_order_acquire);
+            node* next = h->_next.load(std::memory_order_acquire);
+            if (!next)
+                return false;
+            if (h == t) {
+                // the tail must not be left pointing at a retired node
+                _tail.compare_exchange_weak(t, next, std::memory_order_release, std::memory_order_relaxed);
+            } else if (_head.compare_exchange_weak(h, next, std::memory_order_acquire, std::memory_order_relaxed)) {
+                // next is now the sentinel, and its payload is ours
+                x = std::move(next->_payload);
+                epoch::defer_delete(h);
+                return true;
             }
         }
     }
-    
-}; // struct Queue
 
+}; // struct _epoch_queue
 
-struct Deferred {
-    std::function<void()> _array[32];
-    usize _filled;
-    u64 _epoch;
+struct tracked {
+    static inline std::atomic<i64> _live{0};
+    tracked() { ++_live; }
+    ~tracked() { --_live; }
 };
 
-struct Local;
-
-struct Global {
-    
-    Atomic<u64> epoch;
-    Atomic<TaggedPtr<Local>> head;
-    
-    static Global const& get() {
-        // global is deliberately leaked at shutdown
-        static Global* global = new Global {
-            0,
-            TaggedPtr<Local> { nullptr }
-        };
-        return *global;
+// Collects until the garbage of this thread is gone, or gives up
+bool drain(i64 live) {
+    for (int i = 0; i != 100; ++i) {
+        if (tracked::_live.load() == live)
+            return true;
+        epoch::flush();
     }
-    
-};
+    return tracked::_live.load() == live;
+}
+
+} // namespace
+
+TEST_CASE("epoch", "[epoch]") {
+
+    i64 live = tracked::_live.load();
+
+    SECTION("guards nest") {
+
+        REQUIRE(!epoch::is_pinned());
+        {
+            epoch::guard a;
+            REQUIRE(epoch::is_pinned());
+            {
+                epoch::guard b;
+                REQUIRE(epoch::is_pinned());
+            }
+            REQUIRE(epoch::is_pinned());
+        }
+        REQUIRE(!epoch::is_pinned());
 
-struct Local {
-    
-public:
-    
-    Atomic<u64> epoch; // <-- written frequently
-    Atomic<TaggedPtr<Local>> next; // <-- written only when a thread ends
-    
-private:
-    
-    mutable u64 _local_epoch;
-    mutable Deferred _deferred;
-    
-    explicit Local(TaggedPtr<Local> ptr)
-    : _deferred()
-    , epoch(0)
-    , _local_epoch(0)
-    , next(ptr) {
     }
-    
-    static Local* make() {
-        // insert node at head of list
-        Atomic<TaggedPtr<Local>> const& head = Global::get().head;
-        Local* desired = new Local(head.load(std::memory_order_relaxed));
-        while (!head.compare_exchange_weak(desired->next,
-                                           TaggedPtr<Local> { desired },
-                                           std::memory_order_release,
-                                           std::memory_order_relaxed)) {}
-        return desired;
+
+    SECTION("deferred destruction") {
+
+        {
+            epoch::guard g;
+            epoch::defer_delete(new tracked);
+            // not before we unpin
+            epoch::collect();
+            epoch::collect();
+            epoch::collect();
+            REQUIRE(tracked::_live.load() == live + 1);
+        }
+        REQUIRE(drain(live));
+
     }
-    
-    void mark() const {
-        // mark node for deletion
-        this->next.fetch_or(1, std::memory_order_release);
+
+    SECTION("batches") {
+
+        // fills and seals several bags on the way
+        for (int i = 0; i != 1000; ++i) {
+            epoch::guard g;
+            epoch::defer_delete(new tracked);
+        }
+        REQUIRE(drain(live));
+
     }
-        
-public:
-        
-    static Local const& get() {
-        thread_local struct Guard {
-            Local const* local;
-            Guard() : local(make()) {}
-            ~Guard() { local->mark(); }
-        } guard;
-        return *guard.local;
+
+    SECTION("pinned threads hold back reclamation") {
+
+        std::atomic<int> stage{0};
+        std::thread t([&] {
+            epoch::guard g;
+            stage = 1;
+            while (stage.load() != 2)
+                std::this_thread::yield();
+        });
+        while (stage.load() != 1)
+            std::this_thread::yield();
+        {
+            epoch::guard g;
+            epoch::defer_delete(new tracked);
+        }
+        for (int i = 0; i != 100; ++i)
+            epoch::flush();
+        REQUIRE(tracked::_live.load() == live + 1);
+        stage = 2;
+        t.join();
+        REQUIRE(drain(live));
+
     }
-    
-    void defer(std::function<void()> f) const {
-        _deferred.emplace_back(_local_epoch, std::move(f));
+
+    SECTION("exiting threads leave their garbage behind") {
+
+        std::thread([] {
+            epoch::guard g;
+            epoch::defer_delete(new tracked);
+        }).join();
+        REQUIRE(drain(live));
+
     }
-    
-    // be careful of coroutine heap allocation overhead; but this should be
-    // infrequently called
-    Generator<u64> epochs() const {
-        Atomic<TaggedPtr<Local>> const* pred = &Global::get().head;
-        TaggedPtr<Local> curr = pred->load(std::memory_order_acquire);
-        while (curr.ptr) {
-            TaggedPtr<Local> next = curr->next.load(std::memory_order_relaxed);
-            if (!next.tag) {
-                // read the epoch
-                co_yield curr->epoch.load(std::memory_order_relaxed);
-            } else if (!curr.tag) {
-                // node is marked for deletion and predecessor is not, so we can
-                // attempt to delete it
-                if (pred->compare_exchange_strong(curr,
-                                                  next & 0,
-                                                  std::memory_order_relaxed,
-                                                  std::memory_order_relaxed)) {
-                    // we won the race to delete the node, now we defer its actual
-                    // reclamation
-                    this->defer([ptr = curr.ptr] {
-                        delete ptr;
-                    });
+
+    SECTION("queue") {
+
+        const int N = 10000;
+        const int M = 4;
+        _epoch_queue<i64> q;
+        std::atomic<i64> sum{0};
+        std::vector<std::thread> t;
+        for (int i = 0; i != M; ++i)
+            t.emplace_back([&] {
+                for (int j = 0; j != N; ++j) {
+                    q.push(j);
+                    i64 x;
+                    while (!q.try_pop(x))
+                        ;
+                    sum += x;
                 }
-                continue;
-            }
-            // advance
-            pred = &curr->next;
-            curr = next;
-        }
+            });
+        for (auto& s : t)
+            s.join();
+        REQUIRE(sum.load() == i64(M) * N * (N - 1) / 2);
+
     }
-    
-}; // struct Local
 
-TEST_CASE("epoch", "[epoch]") {
-    
-    return;
-    
-    std::size_t n = 8;
-    
-    std::vector<std::thread> t;
-    for (int i = 0; i != n; ++i) {
-        t.emplace_back([=] {
-            
-            Global const& global = Global::get();
-            Local const& local = Local::get();
-            
-            for (;;) {
-
-                // see crossbeam repin
-                u64 local_epoch = local.epoch.load(std::memory_order_relaxed);
-                u64 global_epoch = global.epoch.load(std::memory_order_relaxed);
-                if (local_epoch != global_epoch) {
-                    // unsafe for old memory accesses to leak into new epoch
-                    local.epoch.store(global_epoch, std::memory_order_release);
-                    // safe for new memory accesses to leak into old epoch
-                }
-                
-                
-                // we should advance "infrequently"
-                // one defintion could be 1/nth of the time when n is number of
-                // threads, since only one thread every epoch actually advances
-                // it, and the others just overwrite the advance
-                // see crossbeam try_advance
-                bool flag = true;
-                for (auto e : local.epochs()) {
-                    if (e != local_epoch) {
-                        flag = false;
-                        break;
-                    }
-                }
-                
-                if (flag) {
-                    // synchronize with other threads only when advancing
-                    std::atomic_thread_fence(std::memory_order_acquire);
-                    global.epoch.store(local_epoch + 1, std::memory_order_release);
-                    printf("%d %llu\n", i, local_epoch);
+}
+
+TEST_CASE("epoch benchmark", "[.benchmark]") {
+
+    using ns = std::chrono::duration<double, std::nano>;
+    const int N = 1 << 18;
+
+    auto run = [&](int threads, auto& q) {
+        std::vector<std::thread> t;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i != threads; ++i)
+            t.emplace_back([&] {
+                for (int j = 0; j != N; ++j) {
+                    q.push(j);
+                    int x;
+                    while (!q.try_pop(x))
+                        ;
                 }
-                
-                // to sleep and wake we will need to implement crossbeam pin and unpin
-                
-            }
-            
-        });
-    }
-    
-    
-    while (!t.empty()) {
-        t.back().join();
-        t.pop_back();
+            });
+        for (auto& s : t)
+            s.join();
+        auto t1 = std::chrono::steady_clock::now();
+        return ns(t1 - t0).count() / (i64(N) * threads);
+    };
+
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        Atomic<queue<int>> const a;
+        _epoch_queue<int> b;
+        double u = run(threads, a);
+        double v = run(threads, b);
+        printf("queue push+pop, %d threads: counted %g ns, epoch %g ns\n", threads, u, v);
     }
-    
-}
 
 }
+
+} // namespace manic
@@ -0,0 +1,97 @@
+//
+//  file_io-test.cpp
+//  mania-test
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "atomic.hpp"
+#include "file_io.hpp"
+
+namespace manic {
+
+TEST_CASE("file_io") {
+
+    char name[] = "/tmp/file_io-XXXXXX";
+    int fd = mkstemp(name);
+    REQUIRE(fd >= 0);
+    unlink(name);
+
+    const Atomic<i64> done(0);
+    auto wait = [&](i64 n) {
+        for (i64 m; (m = done.load(std::memory_order_acquire)) != n;)
+            done.wait(m, std::memory_order_acquire);
+    };
+    auto signal = [&] {
+        done.fetch_add(1, std::memory_order_release);
+        done.notify_all();
+    };
+
+    // many blocks in flight at once, more than fit in the ring
+    const i64 N = 1000;
+    const i64 M = 64;
+    std::vector<std::vector<unsigned char>> a(N);
+    std::vector<file_io> b(N);
+    for (i64 i = 0; i != N; ++i) {
+        a[i].assign(M, (unsigned char) i);
+        b[i] = file_io{file_io::WRITE, fd, (u64) (i * M), a[i].data(), M, -1, signal};
+        file_io_submit(&b[i]);
+    }
+    wait(N);
+    for (auto& x : b)
+        REQUIRE(x._result == M);
+
+    std::vector<unsigned char> c(N * M);
+    for (i64 i = 0; i != N; ++i) {
+        b[i] = file_io{file_io::READ, fd, (u64) ((N - 1 - i) * M), c.data() + (N - 1 - i) * M, M, -1, signal};
+        file_io_submit(&b[i]);
+    }
+    wait(2 * N);
+    for (auto& x : b)
+        REQUIRE(x._result == M);
+    for (i64 i = 0; i != N * M; ++i)
+        REQUIRE(c[i] == (unsigned char) (i / M));
+
+    SECTION("short and failed transfers") {
+
+        // past the end of the file
+        b[0] = file_io{file_io::READ, fd, (u64) (N * M - 10), c.data(), M, -1, signal};
+        file_io_submit(&b[0]);
+        wait(2 * N + 1);
+        REQUIRE(b[0]._result == 10);
+
+        b[0] = file_io{file_io::READ, -1, 0, c.data(), M, -1, signal};
+        file_io_submit(&b[0]);
+        wait(2 * N + 2);
+        REQUIRE(b[0]._result == -EBADF);
+
+    }
+
+    SECTION("busy kernel") {
+
+        // submissions the kernel refuses for a while still complete, though
+        // nothing else is in flight to prompt another enter
+        _file_io_fail_submissions(3);
+        b[0] = file_io{file_io::READ, fd, (u64) M, c.data(), M, -1, signal};
+        file_io_submit(&b[0]);
+        wait(2 * N + 1);
+        REQUIRE(b[0]._result == M);
+        REQUIRE(c[0] == 1);
+        _file_io_fail_submissions(0);
+
+    }
+
+    close(fd);
+
+}
+
+} // namespace manic
@@ -0,0 +1,173 @@
+//
+//  hamt-test.cpp
+//  mania-test
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#include <catch2/catch.hpp>
+
+#include "hamt.hpp"
+#include "space2.hpp"
+#include "tattler.hpp"
+#include "vec.hpp"
+
+namespace manic {
+
+// force every key into the same few buckets to exercise collision nodes
+struct _bad_key {
+    u64 x;
+    bool operator==(_bad_key const& other) const { return x == other.x; }
+};
+
+inline u64 hash(_bad_key const& k) {
+    return k.x & 3;
+}
+
+TEST_CASE("hamt") {
+
+    SECTION("default") {
+
+        hamt<u64, u64> t;
+        REQUIRE(t.size() == 0);
+        REQUIRE_FALSE(t.contains(0));
+        REQUIRE_FALSE(t.erase(0));
+        REQUIRE(std::as_const(t).try_get(0) == nullptr);
+
+        t.insert(1, 2);
+        REQUIRE(t.size() == 1);
+        REQUIRE(t.contains(1));
+        REQUIRE(t.get(1) == 2);
+        t.insert(1, 3);
+        REQUIRE(t.size() == 1);
+        REQUIRE(t.get(1) == 3);
+        REQUIRE(t.erase(1));
+        REQUIRE(t.size() == 0);
+        REQUIRE_FALSE(t.contains(1));
+
+    }
+
+    SECTION("stress") {
+
+        const u64 N = 100'000;
+
+        hamt<u64, u64> t;
+        for (u64 i = 0; i != N; ++i) {
+            t.insert(i, hash(i));
+            REQUIRE(t.size() == i + 1);
+        }
+        for (u64 i = 0; i != N; ++i) {
+            REQUIRE(t.contains(i));
+            REQUIRE_FALSE(t.contains(i + N));
+            REQUIRE(t.get(i) == hash(i));
+        }
+        u64 s = 0;
+        t.for_each([&](u64 k, u64) { s += k; });
+        REQUIRE(s == N * (N - 1) / 2);
+        for (u64 i = 0; i != N; ++i) {
+            REQUIRE(t.erase(i));
+            REQUIRE(t.size() == N - 1 - i);
+        }
+        REQUIRE(t._root == nullptr);
+
+    }
+
+    SECTION("snapshot") {
+
+        const u64 N = 10'000;
+
+        hamt<vec<i64, 2>, u64> t;
+        for (u64 i = 0; i != N; ++i)
+            t.entry(vec<i64, 2>{(i64) i, -(i64) i}).or_insert(i);
+
+        auto a = t.snapshot();
+        REQUIRE(a._root == t._root);
+
+        for (u64 i = 0; i != N; i += 2)
+            t[vec<i64, 2>{(i64) i, -(i64) i}] = 0;
+        for (u64 i = 1; i < N; i += 4)
+            t.erase(vec<i64, 2>{(i64) i, -(i64) i});
+
+        // the snapshot is unchanged
+        REQUIRE(a.size() == N);
+        for (u64 i = 0; i != N; ++i)
+            REQUIRE(a.get(vec<i64, 2>{(i64) i, -(i64) i}) == i);
+
+        // the original reflects the mutations
+        REQUIRE(t.size() == N - N / 4);
+        for (u64 i = 0; i != N; ++i) {
+            auto p = std::as_const(t).try_get(vec<i64, 2>{(i64) i, -(i64) i});
+            if (!(i & 1)) {
+                REQUIRE(p);
+                REQUIRE(*p == 0);
+            } else if ((i & 3) == 1) {
+                REQUIRE_FALSE(p);
+            } else {
+                REQUIRE(p);
+                REQUIRE(*p == i);
+            }
+        }
+
+    }
+
+    SECTION("collisions") {
+
+        const u64 N = 1'000;
+
+        hamt<_bad_key, u64> t;
+        for (u64 i = 0; i != N; ++i)
+            t.insert(_bad_key{i}, i);
+        auto a = t;
+        for (u64 i = 0; i != N; ++i)
+            REQUIRE(t.get(_bad_key{i}) == i);
+        for (u64 i = 0; i != N; i += 2)
+            REQUIRE(t.erase(_bad_key{i}));
+        REQUIRE(t.size() == N / 2);
+        for (u64 i = 0; i != N; ++i) {
+            REQUIRE(t.contains(_bad_key{i}) == (i & 1));
+            REQUIRE(a.get(_bad_key{i}) == i);
+        }
+
+    }
+
+    SECTION("space2 reads") {
+
+        // const reads neither generate nor path-copy chunks
+        space2<_space2_inline<u64>, hamt> s;
+        s({1, 2}) = 7;
+        auto a = s.snapshot();
+        REQUIRE(*std::as_const(s).try_get({1, 2}) == 7);
+        REQUIRE_FALSE(std::as_const(s).try_get({100, 100}));
+        REQUIRE_FALSE(s.contains({100, 100}));
+        REQUIRE(a._root == s._table._root);
+
+    }
+
+    SECTION("lifetimes") {
+
+        const int N = 10'000;
+
+        {
+            hamt<int, tattler> t;
+            for (int i = 0; i != N; ++i)
+                t.insert(i, tattler());
+            REQUIRE(tattler::_live == N);
+            {
+                auto a = t;
+                // path copying only copies the touched leaf
+                t.get(0);
+                REQUIRE(tattler::_live == N + 1);
+                for (int i = 0; i != N; ++i)
+                    t.erase(i);
+                REQUIRE(tattler::_live == N);
+            }
+            REQUIRE(tattler::_live == 0);
+        }
+        REQUIRE(tattler::_live == 0);
+
+    }
+
+}
+
+}
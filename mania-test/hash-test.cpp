@@ -0,0 +1,127 @@
+//
+//  hash-test.cpp
+//  mania-test
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "hash.hpp"
+
+namespace manic {
+
+TEST_CASE("hash") {
+
+    SECTION("injective") {
+
+        // spot check: distinct inputs, distinct outputs
+        std::vector<u64> a;
+        for (u64 i = 0; i != 1000; ++i)
+            a.push_back(hash(i));
+        std::sort(a.begin(), a.end());
+        REQUIRE(std::adjacent_find(a.begin(), a.end()) == a.end());
+
+    }
+
+    SECTION("hash_n") {
+
+        for (isize n = 0; n != 19; ++n) {
+            std::vector<u64> a(n), b(n);
+            for (isize k = 0; k != n; ++k)
+                a[k] = k * 0x9E3779B97F4A7C15ull;
+            hash_n(a.data(), b.data(), n);
+            for (isize k = 0; k != n; ++k)
+                REQUIRE(b[k] == hash(a[k]));
+            // in place
+            hash_n(a.data(), a.data(), n);
+            REQUIRE(a == b);
+        }
+
+    }
+
+    SECTION("hash32_n") {
+
+        for (isize n = 0; n != 35; ++n) {
+            std::vector<u32> a(n), b(n);
+            for (isize k = 0; k != n; ++k)
+                a[k] = (u32) (k * 0x9E3779B9u);
+            hash32_n(a.data(), b.data(), n);
+            for (isize k = 0; k != n; ++k)
+                REQUIRE(b[k] == hash32(a[k]));
+        }
+
+    }
+
+    SECTION("hash_row") {
+
+        for (isize n = 0; n != 19; ++n) {
+            std::vector<u64> a(n);
+            hash_row(77, -3, -9, a.data(), n);
+            for (isize k = 0; k != n; ++k)
+                REQUIRE(a[k] == hash(hash(77 ^ (u64) -3) ^ (u64) (-9 + k)));
+        }
+
+    }
+
+}
+
+TEST_CASE("hash benchmark", "[.benchmark]") {
+
+    const isize N = 1 << 12;
+    const isize M = 1 << 12;
+    std::vector<u64> a(N);
+    std::vector<u32> b(N);
+    for (isize k = 0; k != N; ++k) {
+        a[k] = k;
+        b[k] = (u32) k;
+    }
+    using ns = std::chrono::duration<double, std::nano>;
+    u64 sink = 0;
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (isize m = 0; m != M; ++m)
+        for (isize k = 0; k != N; ++k)
+            a[k] = hash(a[k]);
+    auto t1 = std::chrono::steady_clock::now();
+    for (isize m = 0; m != M; ++m)
+        hash_n(a.data(), a.data(), N);
+    auto t2 = std::chrono::steady_clock::now();
+    sink += a[N - 1];
+    printf("hash: scalar %g ns, hash_n %g ns\n",
+           ns(t1 - t0).count() / (N * M), ns(t2 - t1).count() / (N * M));
+
+    t0 = std::chrono::steady_clock::now();
+    for (isize m = 0; m != M; ++m)
+        for (isize k = 0; k != N; ++k)
+            b[k] = hash32(b[k]);
+    t1 = std::chrono::steady_clock::now();
+    for (isize m = 0; m != M; ++m)
+        hash32_n(b.data(), b.data(), N);
+    t2 = std::chrono::steady_clock::now();
+    sink += b[N - 1];
+    printf("hash32: scalar %g ns, hash32_n %g ns\n",
+           ns(t1 - t0).count() / (N * M), ns(t2 - t1).count() / (N * M));
+
+    t0 = std::chrono::steady_clock::now();
+    for (isize m = 0; m != M; ++m)
+        for (isize k = 0; k != N; ++k)
+            a[k] = hash(hash(m ^ 7) ^ k);
+    sink += a[N - 1];
+    t1 = std::chrono::steady_clock::now();
+    for (isize m = 0; m != M; ++m)
+        hash_row(7, m, 0, a.data(), N);
+    t2 = std::chrono::steady_clock::now();
+    sink += a[N - 1];
+    printf("noise: scalar %g ns, hash_row %g ns (%llx)\n",
+           ns(t1 - t0).count() / (N * M), ns(t2 - t1).count() / (N * M), (unsigned long long) sink);
+
+}
+
+} // namespace manic
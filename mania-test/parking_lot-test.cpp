@@ -0,0 +1,174 @@
+//
+//  parking_lot-test.cpp
+//  mania-test
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "atomic.hpp"
+#include "parking_lot.hpp"
+
+namespace manic {
+
+TEST_CASE("parking_lot", "[parking_lot]") {
+
+    SECTION("elision") {
+
+        // notifying an address nobody waits on makes no wake
+        const Atomic<i64> x(0);
+        auto s0 = parking_lot_statistics::get();
+        for (int i = 0; i != 1000; ++i) {
+            x.store(i, std::memory_order_release);
+            x.notify_all();
+        }
+        auto s1 = parking_lot_statistics::get();
+        // (other tests' threads may still be using the parking lot)
+        REQUIRE(s1.wakes - s0.wakes < 1000);
+
+    }
+
+    SECTION("long waits park") {
+
+        const Atomic<i64> x(0);
+        auto s0 = parking_lot_statistics::get();
+        std::thread t([&] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            x.store(1, std::memory_order_release);
+            x.notify_one();
+        });
+        x.wait(0, std::memory_order_acquire);
+        REQUIRE(x.load(std::memory_order_acquire) == 1);
+        t.join();
+        auto s1 = parking_lot_statistics::get();
+        REQUIRE(s1.parks > s0.parks);
+        REQUIRE(s1.wakes > s0.wakes);
+
+    }
+
+    SECTION("ping-pong") {
+
+        const Atomic<i64> x(0);
+        const i64 N = 10000;
+        std::thread t([&] {
+            for (i64 i = 1; i < N; i += 2) {
+                for (i64 m; (m = x.load(std::memory_order_acquire)) != i;)
+                    x.wait(m, std::memory_order_acquire);
+                x.store(i + 1, std::memory_order_release);
+                x.notify_one();
+            }
+        });
+        for (i64 i = 0; i < N; i += 2) {
+            for (i64 m; (m = x.load(std::memory_order_acquire)) != i;)
+                x.wait(m, std::memory_order_acquire);
+            x.store(i + 1, std::memory_order_release);
+            x.notify_one();
+        }
+        t.join();
+        REQUIRE(x.load(std::memory_order_acquire) == N);
+
+    }
+
+    SECTION("notify_one wakes one") {
+
+        // of several waiters on one address, notify_one wakes only the one
+        // that has waited longest, even when the value has changed for all
+        // of them, and notify_all the rest
+        const isize T = 4;
+        const Atomic<i64> x(0);
+        const Atomic<i64> ready(0);
+        const Atomic<i64> woken(0);
+        std::vector<std::thread> t;
+        for (isize k = 0; k != T; ++k)
+            t.emplace_back([&] {
+                ready.fetch_add(1, std::memory_order_relaxed);
+                x.wait(0, std::memory_order_acquire);
+                woken.fetch_add(1, std::memory_order_relaxed);
+            });
+        while (ready.load(std::memory_order_relaxed) != T)
+            std::this_thread::yield();
+        // (long enough for every waiter to stop spinning and park)
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        x.store(1, std::memory_order_release);
+        x.notify_one();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        REQUIRE(woken.load(std::memory_order_relaxed) == 1);
+        x.notify_all();
+        for (auto& u : t)
+            u.join();
+        REQUIRE(woken.load(std::memory_order_relaxed) == T);
+
+    }
+
+    SECTION("shared buckets") {
+
+        // more addresses than buckets, each with a waiter, woken one at a
+        // time with notify_one, which must not strand a waiter on another
+        // address of the same bucket
+        const isize N = 1024;
+        std::vector<Atomic<i64>> x(N);
+        const Atomic<i64> woken(0);
+        const isize T = 8;
+        std::vector<std::thread> t;
+        for (isize k = 0; k != T; ++k)
+            t.emplace_back([&, k] {
+                for (isize i = k; i < N; i += T) {
+                    std::as_const(x[i]).wait(0, std::memory_order_acquire);
+                    woken.fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+        for (isize i = 0; i != N; ++i) {
+            std::as_const(x[i]).store(1, std::memory_order_release);
+            std::as_const(x[i]).notify_one();
+        }
+        for (auto& u : t)
+            u.join();
+        REQUIRE(woken.load(std::memory_order_relaxed) == N);
+
+    }
+
+}
+
+TEST_CASE("parking_lot benchmark", "[.benchmark]") {
+
+    using ns = std::chrono::duration<double, std::nano>;
+
+    // round trips between two threads, for short waits
+    const Atomic<i64> x(0);
+    const i64 N = 1000000;
+    auto s0 = parking_lot_statistics::get();
+    auto t0 = std::chrono::steady_clock::now();
+    std::thread t([&] {
+        for (i64 i = 1; i < N; i += 2) {
+            for (i64 m; (m = x.load(std::memory_order_acquire)) != i;)
+                x.wait(m, std::memory_order_acquire);
+            x.store(i + 1, std::memory_order_release);
+            x.notify_one();
+        }
+    });
+    for (i64 i = 0; i < N; i += 2) {
+        for (i64 m; (m = x.load(std::memory_order_acquire)) != i;)
+            x.wait(m, std::memory_order_acquire);
+        x.store(i + 1, std::memory_order_release);
+        x.notify_one();
+    }
+    t.join();
+    auto t1 = std::chrono::steady_clock::now();
+    auto s1 = parking_lot_statistics::get();
+    printf("parking_lot: %g ns/round trip, %llu spins, %llu parks, %llu wakes\n",
+           ns(t1 - t0).count() * 2 / N,
+           (unsigned long long) (s1.spins - s0.spins),
+           (unsigned long long) (s1.parks - s0.parks),
+           (unsigned long long) (s1.wakes - s0.wakes));
+
+}
+
+} // namespace manic
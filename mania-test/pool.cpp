@@ -6,14 +6,214 @@
 //  Copyright © 2020 Antony Searle. All rights reserved.
 //
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "atomic.hpp"
 #include "pool.hpp"
 
 #include <catch2/catch.hpp>
 
+namespace manic {
+
+namespace {
+
+// Blocks until n jobs have finished
+struct latch {
+    
+    Atomic<i64> _count;
+    
+    explicit latch(i64 n) : _count(n) {}
+    
+    void count_down() const {
+        if (_count.fetch_sub(1, std::memory_order_release) == 1)
+            _count.notify_all();
+    }
+    
+    void wait() const {
+        for (i64 n; (n = _count.load(std::memory_order_acquire));)
+            _count.wait(n, std::memory_order_acquire);
+    }
+    
+};
+
+// Fork-join tree of 2^depth leaves, spawned from inside the workers
+void fork(latch const* done, Atomic<i64> const* sum, int depth) {
+    if (depth) {
+        pool_submit_one([=] { fork(done, sum, depth - 1); });
+        pool_submit_one([=] { fork(done, sum, depth - 1); });
+    } else {
+        sum->fetch_add(1, std::memory_order_relaxed);
+        done->count_down();
+    }
+}
+
+} // namespace
+
 TEST_CASE("pool", "[pool]") {
     
+    SECTION("external submissions") {
+        
+        const i64 N = 10000;
+        const latch done(N);
+        const Atomic<i64> sum(0);
+        for (i64 i = 0; i != N; ++i)
+            pool_submit_one([&, i] {
+                sum.fetch_add(i, std::memory_order_relaxed);
+                done.count_down();
+            });
+        done.wait();
+        REQUIRE(sum.load(std::memory_order_relaxed) == N * (N - 1) / 2);
+        
+    }
+    
+    SECTION("batches") {
+        
+        const i64 N = 1000;
+        const latch done(N * 2);
+        const Atomic<i64> sum(0);
+        stack<fn<void()>> s;
+        for (i64 i = 0; i != N; ++i)
+            s.push([&] {
+                // nested batch, submitted from a worker
+                stack<fn<void()>> t;
+                t.push([&] { sum.fetch_add(1, std::memory_order_relaxed); done.count_down(); });
+                pool_submit_many(std::move(t));
+                sum.fetch_add(1, std::memory_order_relaxed);
+                done.count_down();
+            });
+        pool_submit_many(std::move(s));
+        pool_submit_many(stack<fn<void()>>()); // <-- empty is harmless
+        done.wait();
+        REQUIRE(sum.load(std::memory_order_relaxed) == N * 2);
+        
+    }
+    
+    SECTION("fork-join") {
+        
+        // exercises local pushes, deque growth and stealing
+        const int D = 14;
+        const latch done(i64(1) << D);
+        const Atomic<i64> sum(0);
+        pool_submit_one([&] { fork(&done, &sum, D); });
+        done.wait();
+        REQUIRE(sum.load(std::memory_order_relaxed) == i64(1) << D);
+        
+    }
+    
+    SECTION("parking") {
+        
+        // workers park between bursts and must all be woken again
+        for (int k = 0; k != 100; ++k) {
+            const latch done(4);
+            for (int i = 0; i != 4; ++i)
+                pool_submit_one([&] { done.count_down(); });
+            done.wait();
+        }
+        
+    }
+    
+    SECTION("qos") {
+        
+        // a backlog of slow background jobs neither delays critical and
+        // normal jobs until it drains, nor occupies more than its share of
+        // the workers
+        const i64 B = 200;
+        const i64 limit = std::max<i64>(1, std::thread::hardware_concurrency() / 4);
+        const latch background(B);
+        const Atomic<i64> running(0);
+        const Atomic<i64> peak(0);
+        const Atomic<i64> finished(0);
+        for (i64 i = 0; i != B; ++i)
+            pool_submit_one([&] {
+                i64 n = running.fetch_add(1, std::memory_order_relaxed) + 1;
+                for (i64 m = peak.load(std::memory_order_relaxed); m < n;)
+                    if (peak.compare_exchange_weak(m, n, std::memory_order_relaxed, std::memory_order_relaxed))
+                        break;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                running.fetch_sub(1, std::memory_order_relaxed);
+                finished.fetch_add(1, std::memory_order_relaxed);
+                background.count_down();
+            }, qos::background);
+        
+        const i64 N = 20;
+        const latch critical(N);
+        const latch normal(N);
+        const Atomic<i64> lag(0); // <-- background jobs finished before the last critical job
+        for (i64 i = 0; i != N; ++i) {
+            pool_submit_one([&] {
+                lag.store(finished.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                critical.count_down();
+            }, qos::critical);
+            pool_submit_one([&] { normal.count_down(); });
+        }
+        critical.wait();
+        normal.wait();
+        REQUIRE(lag.load(std::memory_order_relaxed) < B / 2);
+        background.wait();
+        REQUIRE(peak.load(std::memory_order_relaxed) <= limit);
+        REQUIRE(!pool_should_yield());
+        
+    }
+    
+    SECTION("lane order") {
+        
+        // lanes start jobs in submission order, whether submitted one at a
+        // time or in a batch; with one background job running at a time,
+        // that is also the order in which they run
+        const i64 B = 100;
+        const i64 limit = std::max<i64>(1, std::thread::hardware_concurrency() / 4);
+        const latch done(2 * B);
+        std::vector<i64> order(2 * B, -1);
+        const Atomic<i64> next(0);
+        auto job = [&](i64 i) {
+            return [&, i] {
+                order[next.fetch_add(1, std::memory_order_relaxed)] = i;
+                done.count_down();
+            };
+        };
+        for (i64 i = 0; i != B; ++i)
+            pool_submit_one(job(i), qos::background);
+        stack<fn<void()>> s;
+        for (i64 i = B; i != 2 * B; ++i)
+            s.push(job(i));
+        pool_submit_many(std::move(s), qos::background);
+        done.wait();
+        std::vector<i64> sorted(order);
+        std::sort(sorted.begin(), sorted.end());
+        for (i64 i = 0; i != 2 * B; ++i)
+            REQUIRE(sorted[i] == i);
+        if (limit == 1)
+            for (i64 i = 0; i != 2 * B; ++i)
+                REQUIRE(order[i] == i);
+        
+    }
+    
 }
 
+TEST_CASE("pool benchmark", "[.benchmark]") {
+    
+    using ns = std::chrono::duration<double, std::nano>;
+    const int D = 20;
+    for (int k = 0; k != 3; ++k) {
+        const latch done(i64(1) << D);
+        const Atomic<i64> sum(0);
+        auto t0 = std::chrono::steady_clock::now();
+        pool_submit_one([&] { fork(&done, &sum, D); });
+        done.wait();
+        auto t1 = std::chrono::steady_clock::now();
+        printf("pool: fork-join %g ns per job (%u threads)\n",
+               ns(t1 - t0).count() / ((i64(2) << D) - 1),
+               std::thread::hardware_concurrency());
+    }
+    
+}
+
+} // namespace manic
+
 
 
 
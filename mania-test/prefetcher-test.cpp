@@ -0,0 +1,137 @@
+//
+//  prefetcher-test.cpp
+//  mania-test
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <catch2/catch.hpp>
+
+#include "prefetcher.hpp"
+#include "space2.hpp"
+
+namespace manic {
+
+// chunk contents identify the chunk, and generation is counted
+struct _prefetcher_test_generator {
+    std::shared_ptr<std::atomic<int>> _calls = std::make_shared<std::atomic<int>>(0);
+    auto operator()(vec<i64, 2> uv) const {
+        return [uv, calls = _calls]() {
+            ++*calls;
+            matrix<i64> m(16, 16);
+            m(uv.x & 15, uv.y & 15) = uv.x * 1000 + uv.y;
+            return m;
+        };
+    }
+};
+
+TEST_CASE("prefetcher") {
+
+    using S = space2<_prefetcher_test_generator>;
+
+    // install until nothing is in flight
+    auto drain = [](prefetcher<S>& p, S& s) {
+        while (p.pending()) {
+            p.install(s);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    };
+
+    SECTION("request") {
+
+        S s;
+        prefetcher<S> p;
+        REQUIRE(p.request(s, vec<i64, 2>{5, -3}));
+        REQUIRE(p.pending() == 1);
+        // duplicate requests are ignored
+        REQUIRE(p.request(s, vec<i64, 2>{0, -16}));
+        REQUIRE(p.pending() == 1);
+        drain(p, s);
+        REQUIRE(s._table.size() == 1);
+        REQUIRE(s.contains({0, -16}));
+        REQUIRE(s.get({0, -16}) == -16);
+        REQUIRE(*s._generator._calls == 1);
+        // present chunks are not requested again
+        REQUIRE(p.request(s, vec<i64, 2>{1, -1}));
+        REQUIRE(p.pending() == 0);
+
+    }
+
+    SECTION("region") {
+
+        S s;
+        prefetcher<S> p;
+        REQUIRE(p.request(s, vec<i64, 2>{-1, 0}, vec<i64, 2>{17, 16}));
+        drain(p, s);
+        // chunks at x = -16, 0, 16 and y = 0
+        REQUIRE(s._table.size() == 3);
+        REQUIRE(s.contains({-16, 0}));
+        REQUIRE(s.contains({16, 15}));
+        REQUIRE_FALSE(s.contains({0, 16}));
+
+    }
+
+    SECTION("velocity") {
+
+        S s;
+        prefetcher<S> p;
+        // a one-chunk view moving right at half a cell per frame
+        REQUIRE(p.request(s, vec<i64, 2>{0, 0}, vec<i64, 2>{16, 16}, vec<double, 2>{0.5, 0.0}));
+        drain(p, s);
+        // the margin around the view
+        for (i64 u = -16; u != 32; u += 16)
+            for (i64 v = -16; v != 32; v += 16)
+                REQUIRE(s.contains({u, v}));
+        // 30 cells ahead
+        REQUIRE(s.contains({30, 0}));
+        REQUIRE(s.contains({45, 15}));
+        REQUIRE_FALSE(s.contains({-32, 0}));
+
+    }
+
+    SECTION("saturation") {
+
+        S s;
+        prefetcher<S> p;
+        REQUIRE_FALSE(p.request(s, vec<i64, 2>{0, 0}, vec<i64, 2>{16 * 16, 16 * 16}));
+        REQUIRE(p.pending() == prefetcher<S>::MAX_PENDING);
+        drain(p, s);
+        REQUIRE(s._table.size() == prefetcher<S>::MAX_PENDING);
+
+    }
+
+    SECTION("fallback") {
+
+        // the synchronous path wins the race; the late chunk is discarded
+        S s;
+        prefetcher<S> p;
+        REQUIRE(p.request(s, vec<i64, 2>{0, 0}));
+        s.get({0, 0}) = 7;
+        drain(p, s);
+        REQUIRE(s.get({0, 0}) == 7);
+        REQUIRE(*s._generator._calls == 2);
+
+    }
+
+    SECTION("lifetime") {
+
+        // jobs may complete after the prefetcher is gone
+        S s;
+        {
+            prefetcher<S> p;
+            p.request(s, vec<i64, 2>{0, 0}, vec<i64, 2>{64, 64});
+        }
+        while (*s._generator._calls != 16)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        REQUIRE(s._table.size() == 0);
+
+    }
+
+}
+
+} // namespace manic
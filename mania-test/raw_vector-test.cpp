@@ -0,0 +1,114 @@
+//
+//  raw_vector-test.cpp
+//  mania-test
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#include <chrono>
+#include <cstdio>
+
+#include <catch2/catch.hpp>
+
+#include "matrix.hpp"
+#include "raw_vector.hpp"
+#include "vector.hpp"
+
+namespace manic {
+
+TEST_CASE("raw_vector") {
+
+    SECTION("zeroed") {
+
+        for (isize n : { 0, 1, 1'000, 1'000'000 }) {
+            raw_vector<u64> v(n);
+            REQUIRE(v.capacity() >= n);
+            for (isize i = 0; i != n; ++i)
+                REQUIRE(v[i] == 0);
+        }
+
+    }
+
+    SECTION("uninitialized") {
+
+        for (isize n : { 0, 1, 1'000, 1'000'000 }) {
+            raw_vector<u64> v(n, uninitialized);
+            REQUIRE(v.capacity() >= n);
+            for (isize i = 0; i != n; ++i)
+                v[i] = i;
+            for (isize i = 0; i != n; ++i)
+                REQUIRE(v[i] == i);
+        }
+
+    }
+
+    SECTION("huge") {
+
+        // large allocations are whole, aligned huge pages
+        isize n = _RAW_VECTOR_HUGE / sizeof(u32) + 1;
+        raw_vector<u32> v(n);
+        REQUIRE(v.capacity() >= n);
+#ifdef __linux__
+        REQUIRE(!((usize) v.begin() & (_RAW_VECTOR_HUGE - 1)));
+        REQUIRE(v.capacity() * sizeof(u32) == 2 * _RAW_VECTOR_HUGE);
+#endif
+        for (isize i = 0; i != v.capacity(); ++i)
+            REQUIRE(v[i] == 0);
+        raw_vector<u32> w(std::move(v));
+        REQUIRE(v.begin() == nullptr);
+        w[w.capacity() - 1] = 1;
+
+    }
+
+    SECTION("containers") {
+
+        vector<int> v;
+        for (int i = 0; i != 1'000'000; ++i)
+            v.push_back(i);
+        for (int i = 0; i != 1'000'000; ++i)
+            REQUIRE(v[i] == i);
+        v.shrink_to_fit();
+        REQUIRE(v.size() == 1'000'000);
+        REQUIRE(v.back() == 999'999);
+
+        matrix<float> a(1'000, 1'000);
+        REQUIRE(a(999, 999) == 0.0f);
+        a.discard_and_resize(2'000, 2'000);
+        a = 1.0f;
+        matrix<float> b(a);
+        REQUIRE(b(1'999, 1'999) == 1.0f);
+
+    }
+
+}
+
+TEST_CASE("raw_vector allocation", "[.benchmark]") {
+
+    // allocate, overwrite and release, as when growing a matrix or vector
+
+    for (isize bytes = 1 << 12; bytes <= (1 << 28); bytes <<= 4) {
+        isize n = bytes / sizeof(u64);
+        isize m = std::max<isize>(1, (1 << 28) / bytes);
+        auto t0 = std::chrono::steady_clock::now();
+        for (isize j = 0; j != m; ++j) {
+            raw_vector<u64> v(n);
+            std::fill(v.begin(), v.begin() + n, j);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        for (isize j = 0; j != m; ++j) {
+            raw_vector<u64> v(n, uninitialized);
+            std::fill(v.begin(), v.begin() + n, j);
+        }
+        auto t2 = std::chrono::steady_clock::now();
+        auto a = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        auto b = std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count();
+        printf("raw_vector: %10td bytes, zeroed %8.3f ns/KB, uninitialized %8.3f ns/KB\n",
+               bytes,
+               (double) a * 1024 / (m * bytes),
+               (double) b * 1024 / (m * bytes));
+    }
+
+}
+
+}
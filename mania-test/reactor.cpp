@@ -19,29 +19,192 @@ reactor::reactor()
         perror(strerror(errno));
         abort();
     }
+#if defined(__linux__)
+    _epoll = epoll_create1(EPOLL_CLOEXEC);
+    _timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (_epoll == -1 || _timer == -1)
+        (void) perror(strerror(errno)), abort();
+    // the notification pipe is level-triggered, as we may deliberately
+    // leave bytes in it (see _run)
+    epoll_event e{};
+    e.events = EPOLLIN;
+    e.data.fd = _pipe[0];
+    if (epoll_ctl(_epoll, EPOLL_CTL_ADD, _pipe[0], &e) != 0)
+        (void) perror(strerror(errno)), abort();
+    e.events = EPOLLIN | EPOLLET;
+    e.data.fd = _timer;
+    if (epoll_ctl(_epoll, EPOLL_CTL_ADD, _timer, &e) != 0)
+        (void) perror(strerror(errno)), abort();
+#endif
     _thread = std::thread(&reactor::_run, this);
 }
 
 reactor::~reactor() {
     _cancel();
     _thread.join();
+#if defined(__linux__)
+    close(_timer);
+    close(_epoll);
+#endif
     close(_pipe[1]);
     close(_pipe[0]);
 }
 
+#if defined(__linux__)
+
 void reactor::_run() const {
     
-    struct cmp_t {
-        bool operator()(const fn<void()>& a,
-                        const fn<void()>& b) {
-            return a->_t > b->_t; // <-- reverse order puts earliest at top of priority queue
-        }
+    // waiters on each fd, indexed by fd
+    struct interest_t {
+        stack<fn<void()>> readers;
+        stack<fn<void()>> writers;
+        stack<fn<void()>> excepters;
+        bool touched = false;
     };
     
+    std::vector<interest_t> interests;
+    std::vector<int> touched; // <-- fds that gained waiters this wake
+    _timer_heap timers;
+    
+    stack<fn<void()>> pending;
+    std::vector<char> buf;
+    std::vector<epoll_event> events(64);
+    
+    int count = 0; // <-- the number of events observed by epoll_wait
+    
+    auto armed = std::chrono::steady_clock::time_point::max();
+    
+    std::uint64_t outstanding = 0; // <-- single-byte write notifications we have synchronized with but not yet cleared
+    
+    for (;;) {
+        
+        {
+            // establish an ordering between this read and the writes that preceeded notifications
+            auto old = _cancelled_and_notifications.fetch_and(CANCELLED_BIT,
+                                                              std::memory_order_acquire);
+            if (old & CANCELLED_BIT)
+                break;
+            outstanding += old;
+            assert(outstanding >= old);
+        }
+        
+        // serve the events of the last wait before taking new waiters, which
+        // must not be served by readiness they did not see
+        for (int k = 0; k != count; ++k) {
+            int fd = events[k].data.fd;
+            auto e = events[k].events;
+            if (fd == _pipe[0]) {
+                // we risk clearing notifications before we have observed their
+                // effects, so only read as many notifications (bytes) as we
+                // know have been sent
+                assert(outstanding > 0); // <-- else why is pipe readable?
+                buf.resize(std::max<std::size_t>(outstanding, buf.size()));
+                ssize_t r = read(_pipe[0], buf.data(), outstanding);
+                if (r < 0)
+                    (void) perror(strerror(errno)), abort();
+                assert(r <= outstanding);
+                outstanding -= r;
+            } else if (fd == _timer) {
+                std::uint64_t expirations;
+                if (read(_timer, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+                    (void) perror(strerror(errno)), abort();
+                armed = std::chrono::steady_clock::time_point::max();
+            } else {
+                // as for select, hangup and error count as readable and
+                // writeable
+                interest_t& i = interests[fd];
+                if (e & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                    pending.splice(std::move(i.readers));
+                if (e & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+                    pending.splice(std::move(i.writers));
+                if (e & EPOLLPRI)
+                    pending.splice(std::move(i.excepters));
+            }
+        }
+        
+        auto process = [&](stack<fn<void()>> list, stack<fn<void()>> interest_t::* member) {
+            while (!list.empty()) {
+                fn<void()> f = list.pop();
+                int fd = f->_fd;
+                assert(fd >= 0);
+                if (fd >= (int) interests.size())
+                    interests.resize(std::max<std::size_t>(fd + 1, interests.size() * 2));
+                interest_t& i = interests[fd];
+                (i.*member).push(std::move(f));
+                if (!std::exchange(i.touched, true))
+                    touched.push_back(fd);
+            }
+        };
+        
+        process(_readers_buf.take(), &interest_t::readers);
+        process(_writers_buf.take(), &interest_t::writers);
+        process(_excepters_buf.take(), &interest_t::excepters);
+        
+        for (int fd : touched) {
+            interest_t& i = interests[fd];
+            i.touched = false;
+            epoll_event e{};
+            e.events = EPOLLIN | EPOLLOUT | EPOLLPRI | EPOLLRDHUP | EPOLLET;
+            e.data.fd = fd;
+            // registration persists until the fd is closed; if it already
+            // exists, modifying it re-evaluates readiness
+            if (epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &e) != 0) {
+                if (errno == EEXIST) {
+                    if (epoll_ctl(_epoll, EPOLL_CTL_MOD, fd, &e) != 0)
+                        (void) perror(strerror(errno)), abort();
+                } else if (errno == EPERM) {
+                    // regular files and the like are always ready, as for
+                    // select
+                    pending.splice(std::move(i.readers));
+                    pending.splice(std::move(i.writers));
+                    pending.splice(std::move(i.excepters));
+                } else {
+                    (void) perror(strerror(errno)), abort();
+                }
+            }
+        }
+        touched.clear();
+        
+        timers.splice(_timers_buf.take());
+        timers.expire(std::chrono::steady_clock::now(), pending);
+        if (!timers.empty() && timers.earliest() != armed) {
+            // (steady_clock is CLOCK_MONOTONIC)
+            armed = timers.earliest();
+            auto nsecs = std::chrono::duration_cast<std::chrono::
+                nanoseconds>(armed.time_since_epoch()).count();
+            itimerspec t{};
+            t.it_value.tv_sec = nsecs / 1'000'000'000;
+            t.it_value.tv_nsec = nsecs % 1'000'000'000;
+            if (timerfd_settime(_timer, TFD_TIMER_ABSTIME, &t, nullptr) != 0)
+                (void) perror(strerror(errno)), abort();
+        }
+        
+        if (!pending.empty())
+            pool_submit_many(std::move(pending));
+        
+        count = epoll_wait(_epoll, events.data(), (int) events.size(), -1);
+        
+        if (count == -1) {
+            if (errno != EINTR)
+                (void) perror(strerror(errno)), abort();
+            count = 0;
+        } else if (count == (int) events.size()) {
+            // (the events after these wait for the next call)
+            events.resize(events.size() * 2);
+        }
+        
+    }
+    
+}
+
+#else
+
+void reactor::_run() const {
+    
     stack<fn<void()>> readers;
     stack<fn<void()>> writers;
     stack<fn<void()>> excepters;
-    std::priority_queue<fn<void()>, std::vector<fn<void()>>, cmp_t> timers;
+    _timer_heap timers;
     
     stack<fn<void()>> pending;
     std::vector<char> buf;
@@ -80,11 +243,7 @@ void reactor::_run() const {
         writers.splice(_writers_buf.take());
         excepters.splice(_excepters_buf.take());
         
-        {
-            auto stale = _timers_buf.take();
-            while (!stale.empty())
-                timers.push(stale.pop());
-        }
+        timers.splice(_timers_buf.take());
         
         if (count && FD_ISSET(_pipe[0], &readset)) {
             // we risk clearing notifications before we have observed their
@@ -129,13 +288,10 @@ void reactor::_run() const {
         
         auto now = std::chrono::steady_clock::now();
         
-        while ((!timers.empty()) && (timers.top()->_t <= now)) {
-            pending.push(std::move(const_cast<fn<void()>&>(timers.top())));
-            timers.pop();
-        }
+        timers.expire(now, pending);
         if (!timers.empty()) {
             auto usecs = std::chrono::duration_cast<std::chrono::
-                microseconds>(timers.top()->_t - now).count();
+                microseconds>(timers.earliest() - now).count();
             timeout.tv_usec = (int) (usecs % 1'000'000);
             timeout.tv_sec = usecs / 1'000'000;
             ptimeout = &timeout;
@@ -155,4 +311,76 @@ void reactor::_run() const {
     
 }
 
+#endif
+
+TEST_CASE("reactor", "[reactor]") {
+    
+    auto const& r = reactor::get();
+    
+    SECTION("timers") {
+        
+        // submitted as one batch, out of order, so the heap is rebuilt
+        const i64 N = 100;
+        const Atomic<i64> done(0);
+        const Atomic<i64> late(0);
+        auto t0 = std::chrono::steady_clock::now();
+        for (i64 i = 0; i != N; ++i) {
+            auto t = t0 + std::chrono::milliseconds((i * 37) % N);
+            r.when(t, [&, t] {
+                if (std::chrono::steady_clock::now() < t)
+                    late.fetch_add(1, std::memory_order_relaxed);
+                if (done.fetch_add(1, std::memory_order_release) + 1 == N)
+                    done.notify_all();
+            });
+        }
+        for (i64 n; (n = done.load(std::memory_order_acquire)) != N;)
+            done.wait(n, std::memory_order_acquire);
+        REQUIRE(late.load(std::memory_order_relaxed) == 0);
+        
+    }
+    
+    SECTION("readable") {
+        
+        int p[2];
+        REQUIRE(pipe(p) == 0);
+        const Atomic<i64> done(0);
+        auto wait = [&](i64 n) {
+            for (i64 m; (m = done.load(std::memory_order_acquire)) != n;)
+                done.wait(m, std::memory_order_acquire);
+        };
+        auto signal = [&] {
+            done.fetch_add(1, std::memory_order_release);
+            done.notify_all();
+        };
+        char c = 'x';
+        
+        // not ready until written
+        r.when_readable(p[0], [&] { signal(); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        REQUIRE(done.load(std::memory_order_acquire) == 0);
+        REQUIRE(write(p[1], &c, 1) == 1);
+        wait(1);
+        
+        // still readable, as nothing has been read, so a new waiter is
+        // served at once
+        r.when_readable(p[0], [&] { signal(); });
+        wait(2);
+        
+        REQUIRE(read(p[0], &c, 1) == 1);
+        r.when_readable(p[0], [&] { signal(); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        REQUIRE(done.load(std::memory_order_acquire) == 2);
+        REQUIRE(write(p[1], &c, 1) == 1);
+        wait(3);
+        
+        r.when_writeable(p[1], [&] { signal(); });
+        wait(4);
+        
+        close(p[1]);
+        close(p[0]);
+        
+    }
+    
+}
+
 }
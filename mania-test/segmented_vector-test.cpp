@@ -0,0 +1,138 @@
+//
+//  segmented_vector-test.cpp
+//  mania-test
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#include <algorithm>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "segmented_vector.hpp"
+#include "tattler.hpp"
+
+namespace manic {
+
+TEST_CASE("segmented_vector") {
+
+    SECTION("default") {
+
+        segmented_vector<int> v;
+        REQUIRE(v.size() == 0);
+        REQUIRE(v.empty());
+        REQUIRE(v.capacity() == 0);
+        REQUIRE(v.begin() == v.end());
+
+    }
+
+    SECTION("stable") {
+
+        const isize N = 100'000;
+
+        segmented_vector<isize> v;
+        std::vector<isize*> p;
+        for (isize i = 0; i != N; ++i) {
+            v.push_back(i);
+            p.push_back(&v.back());
+        }
+        REQUIRE(v.size() == N);
+        REQUIRE(v.capacity() >= N);
+        // growth never moved an element
+        for (isize i = 0; i != N; ++i) {
+            REQUIRE(&v[i] == p[i]);
+            REQUIRE(v[i] == i);
+        }
+        isize s = 0;
+        for (isize x : v)
+            s += x;
+        REQUIRE(s == N * (N - 1) / 2);
+        REQUIRE(v.end() - v.begin() == N);
+
+    }
+
+    SECTION("swap_remove") {
+
+        segmented_vector<int> v;
+        for (int i = 0; i != 100; ++i)
+            v.push_back(i);
+        REQUIRE(v.swap_remove(10) == 10);
+        REQUIRE(v.size() == 99);
+        REQUIRE(v[10] == 99);
+        REQUIRE(v.swap_remove(98) == 98);
+        REQUIRE(v.back() == 97);
+        while (!v.empty())
+            v.swap_remove(0);
+        REQUIRE(v.capacity() > 0);
+        v.shrink_to_fit();
+        REQUIRE(v.capacity() == 0);
+
+    }
+
+    SECTION("swap") {
+
+        segmented_vector<int> a, b;
+        for (int i = 0; i != 1'000; ++i)
+            a.push_back(i);
+        b.push_back(-1);
+        isize m = a.capacity(), n = b.capacity();
+        swap(a, b);
+        REQUIRE(a.size() == 1);
+        REQUIRE(a.capacity() == n);
+        REQUIRE(a[0] == -1);
+        REQUIRE(b.size() == 1'000);
+        REQUIRE(b.capacity() == m);
+        for (int i = 0; i != 1'000; ++i)
+            REQUIRE(b[i] == i);
+        swap(a, b);
+        REQUIRE(a.size() == 1'000);
+        REQUIRE(a.back() == 999);
+        REQUIRE(b[0] == -1);
+
+    }
+
+    SECTION("iterators") {
+
+        segmented_vector<int> v;
+        for (int i = 0; i != 1'000; ++i)
+            v.push_back(999 - i);
+        auto a = v.begin();
+        auto b = 3 + a;
+        REQUIRE(b - a == 3);
+        REQUIRE(a < b);
+        REQUIRE(b > a);
+        REQUIRE(a <= a);
+        REQUIRE(b >= a);
+        REQUIRE(!(a >= b));
+        std::sort(v.begin(), v.end());
+        REQUIRE(std::is_sorted(v.begin(), v.end()));
+        REQUIRE(*std::lower_bound(v.begin(), v.end(), 500) == 500);
+
+    }
+
+    SECTION("lifetimes") {
+
+        {
+            segmented_vector<tattler> v;
+            for (int i = 0; i != 1'000; ++i)
+                v.emplace_back();
+            REQUIRE(tattler::_live == 1'000);
+            auto w = v;
+            REQUIRE(tattler::_live == 2'000);
+            v.swap_remove(7);
+            auto u = std::move(w);
+            REQUIRE(w.size() == 0);
+            REQUIRE(tattler::_live == 1'999);
+            w = u;
+            v.clear();
+            REQUIRE(tattler::_live == 2'000);
+        }
+        REQUIRE(tattler::_live == 0);
+
+    }
+
+}
+
+}
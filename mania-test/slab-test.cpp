@@ -0,0 +1,154 @@
+//
+//  slab-test.cpp
+//  mania-test
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "bounded_queue.hpp"
+#include "fn.hpp"
+#include "slab.hpp"
+
+namespace manic {
+
+TEST_CASE("slab") {
+
+    SECTION("blocks") {
+
+        // distinct, aligned and writable, in every class and beyond
+        std::vector<std::pair<void*, usize>> a;
+        for (usize n = 1; n <= slab::MAX_SIZE + 64; n += 7)
+            for (int k = 0; k != 3; ++k) {
+                void* p = slab::allocate(n);
+                REQUIRE(!((uintptr_t) p & (slab::GRANULE - 1)));
+                std::memset(p, (int) n, n);
+                a.emplace_back(p, n);
+            }
+        for (auto [p, n] : a)
+            for (usize i = 0; i != n; ++i)
+                REQUIRE(((unsigned char*) p)[i] == (unsigned char) n);
+        std::vector<void*> b;
+        for (auto [p, n] : a)
+            b.push_back(p);
+        std::sort(b.begin(), b.end());
+        REQUIRE(std::adjacent_find(b.begin(), b.end()) == b.end());
+        for (auto [p, n] : a)
+            slab::deallocate(p, n);
+
+    }
+
+    SECTION("reuse") {
+
+        void* p = slab::allocate(40);
+        slab::deallocate(p, 40);
+        // the same class comes back from the thread's list
+        REQUIRE(slab::allocate(33) == p);
+        slab::deallocate(p, 33);
+
+    }
+
+    SECTION("cross-thread") {
+
+        // blocks allocated here and freed there migrate back in batches
+        const int N = 10000;
+        std::vector<void*> a(N);
+        for (auto& p : a)
+            p = slab::allocate(48);
+        std::thread([&] {
+            for (auto p : a)
+                slab::deallocate(p, 48);
+        }).join();
+        std::vector<void*> b(N);
+        for (auto& p : b)
+            p = slab::allocate(48);
+        std::sort(a.begin(), a.end());
+        std::sort(b.begin(), b.end());
+        std::vector<void*> c;
+        std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(c));
+        // (all but what was already on this thread's list, which may hold
+        // up to a freshly carved slab)
+        REQUIRE(c.size() >= N - slab::SLAB_SIZE / 48);
+        for (auto p : b)
+            slab::deallocate(p, 48);
+
+    }
+
+    SECTION("fn") {
+
+        int x = 0;
+        std::vector<fn<void()>> a;
+        for (int i = 0; i != 1000; ++i)
+            a.emplace_back([&x, i] { x += i; });
+        char big[slab::MAX_SIZE] = {};
+        a.emplace_back([&x, big] { x += big[0] - 1; });
+        // over-aligned callables bypass the slabs, keeping their alignment
+        struct alignas(64) wide { int y; };
+        bool aligned = false;
+        a.emplace_back([&x, &aligned, w = wide{1}] {
+            aligned = !(reinterpret_cast<uintptr_t>(&w) % alignof(wide));
+            x += w.y;
+        });
+        for (auto& f : a)
+            f();
+        REQUIRE(x == 1000 * 999 / 2);
+        REQUIRE(aligned);
+
+    }
+
+}
+
+TEST_CASE("slab benchmark", "[.benchmark]") {
+
+    using ns = std::chrono::duration<double, std::nano>;
+    const isize N = 1 << 22;
+    const isize M = 64;
+    std::vector<void*> a(M);
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (isize i = 0; i != N; i += M) {
+        for (auto& p : a)
+            p = ::operator new(48);
+        for (auto p : a)
+            ::operator delete(p);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    for (isize i = 0; i != N; i += M) {
+        for (auto& p : a)
+            p = slab::allocate(48);
+        for (auto p : a)
+            slab::deallocate(p, 48);
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    printf("slab: same thread, malloc %g ns, slab %g ns\n",
+           ns(t1 - t0).count() / N, ns(t2 - t1).count() / N);
+
+    // allocated on one thread, freed on another, as for pool jobs
+    for (bool use_slab : {false, true}) {
+        bounded_queue<void*> const q(1024);
+        auto t0 = std::chrono::steady_clock::now();
+        std::thread consumer([&] {
+            for (isize i = 0; i != N; ++i) {
+                void* p = q.pop();
+                use_slab ? slab::deallocate(p, 48) : ::operator delete(p);
+            }
+        });
+        for (isize i = 0; i != N; ++i)
+            q.push(use_slab ? slab::allocate(48) : ::operator new(48));
+        consumer.join();
+        auto t1 = std::chrono::steady_clock::now();
+        printf("slab: cross-thread, %s %g ns\n", use_slab ? "slab" : "malloc", ns(t1 - t0).count() / N);
+    }
+
+}
+
+} // namespace manic
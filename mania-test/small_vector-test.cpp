@@ -0,0 +1,115 @@
+//
+//  small_vector-test.cpp
+//  mania-test
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#include <catch2/catch.hpp>
+
+#include "small_vector.hpp"
+#include "table3.hpp"
+#include "tattler.hpp"
+
+namespace manic {
+
+TEST_CASE("small_vector") {
+
+    SECTION("default") {
+
+        small_vector<int, 4> v;
+        REQUIRE(v.size() == 0);
+        REQUIRE(v.empty());
+        REQUIRE(v.capacity() == 4);
+        REQUIRE(v.begin() == v.end());
+
+    }
+
+    SECTION("spill") {
+
+        small_vector<int, 4> v;
+        for (int i = 0; i != 4; ++i)
+            v.push_back(i);
+        REQUIRE(v._is_inline());
+        v.push_back(4);
+        REQUIRE_FALSE(v._is_inline());
+        REQUIRE(v.size() == 5);
+        for (int i = 0; i != 5; ++i)
+            REQUIRE(v[i] == i);
+        REQUIRE(v.pop_front() == 0);
+        REQUIRE(v.front() == 1);
+        REQUIRE(v.swap_remove(0) == 1);
+        REQUIRE(v.front() == 4);
+        v.erase(0);
+        REQUIRE(v.size() == 2);
+        REQUIRE(v[0] == 2);
+        REQUIRE(v[1] == 3);
+
+    }
+
+    SECTION("swap") {
+
+        small_vector<int, 2> a, b;
+        a.push_back(1);
+        for (int i = 0; i != 10; ++i)
+            b.push_back(i);
+        swap(a, b);
+        REQUIRE(a.size() == 10);
+        REQUIRE(b.size() == 1);
+        REQUIRE(b[0] == 1);
+        REQUIRE(a[9] == 9);
+        auto c = std::move(a);
+        REQUIRE(a.empty());
+        REQUIRE(a._is_inline());
+        REQUIRE(c.size() == 10);
+
+    }
+
+    SECTION("relocatable") {
+
+        // table3 moves its values with memcpy as it grows
+
+        const int N = 10'000;
+
+        table3<int, small_vector<int, 4>> t;
+        for (int i = 0; i != N; ++i) {
+            auto& v = t.entry(i).or_insert_with([] { return small_vector<int, 4>{}; });
+            for (int j = 0; j != (i & 7); ++j)
+                v.push_back(i + j);
+        }
+        for (int i = 0; i != N; ++i) {
+            auto& v = t[i];
+            REQUIRE(v.size() == (i & 7));
+            for (int j = 0; j != (i & 7); ++j)
+                REQUIRE(v[j] == i + j);
+        }
+
+    }
+
+    SECTION("lifetimes") {
+
+        {
+            small_vector<tattler, 4> a;
+            for (int i = 0; i != 3; ++i)
+                a.emplace_back();
+            auto b = a;
+            for (int i = 0; i != 10; ++i)
+                b.emplace_back();
+            REQUIRE(tattler::_live == 16);
+            a = b;
+            REQUIRE(tattler::_live == 26);
+            b.pop_front();
+            b.swap_remove(3);
+            b.erase(0);
+            REQUIRE(tattler::_live == 23);
+            a = std::move(b);
+            REQUIRE(tattler::_live == 10);
+        }
+        REQUIRE(tattler::_live == 0);
+
+    }
+
+}
+
+}
@@ -0,0 +1,151 @@
+//
+//  task_graph-test.cpp
+//  mania-test
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "atomic.hpp"
+#include "task_graph.hpp"
+
+namespace manic {
+
+TEST_CASE("task_graph", "[task_graph]") {
+
+    SECTION("empty") {
+
+        task_graph g;
+        g.run();
+
+    }
+
+    SECTION("cycles") {
+
+        task_graph g;
+        isize a = g.add("a", [] {});
+        isize b = g.add("b", [] {});
+        isize c = g.add("c", [] {});
+        g.precede(a, b);
+        g.precede(b, c);
+        REQUIRE(g.is_acyclic());
+        g.precede(c, a);
+        REQUIRE(!g.is_acyclic());
+
+    }
+
+    SECTION("order") {
+
+        // tick -> publish -> (vertices of each chunk) -> commit, with a
+        // clock stamping the order in which jobs run
+        const isize N = 16;
+        const Atomic<i64> clock(0);
+        std::vector<i64> t(N + 3, -1);
+        auto stamp = [&](isize i) {
+            return [&, i] { t[i] = clock.fetch_add(1, std::memory_order_relaxed); };
+        };
+        task_graph g;
+        isize tick = g.add("tick", stamp(0));
+        isize publish = g.add("publish", stamp(1));
+        isize commit = g.add("commit", stamp(2));
+        g.precede(tick, publish);
+        for (isize i = 0; i != N; ++i) {
+            isize v = g.add("vertices", stamp(3 + i));
+            g.precede(publish, v);
+            g.precede(v, commit);
+        }
+        for (int k = 0; k != 10; ++k) {
+            std::fill(t.begin(), t.end(), -1);
+            g.run();
+            REQUIRE(t[0] < t[1]);
+            for (isize i = 0; i != N; ++i) {
+                REQUIRE(t[1] < t[3 + i]);
+                REQUIRE(t[3 + i] < t[2]);
+            }
+            REQUIRE(t[2] == clock.load(std::memory_order_relaxed) - 1);
+        }
+
+    }
+
+    SECTION("pipelines") {
+
+        // per-chunk chains with no barrier between stages: the last stage of
+        // a chunk may finish before the first stage of another starts
+        const isize N = 64;
+        const isize S = 3;
+        std::vector<i64> done(N * S, 0);
+        const Atomic<i64> errors(0);
+        task_graph g;
+        for (isize i = 0; i != N; ++i) {
+            isize previous = -1;
+            for (isize s = 0; s != S; ++s) {
+                isize j = g.add("stage", [&, i, s] {
+                    // (Catch is not thread-safe)
+                    if (s && done[i * S + s - 1] != 1)
+                        errors.fetch_add(1, std::memory_order_relaxed);
+                    ++done[i * S + s];
+                });
+                if (previous >= 0)
+                    g.precede(previous, j);
+                previous = j;
+            }
+        }
+        g.run();
+        REQUIRE(errors.load(std::memory_order_relaxed) == 0);
+        for (auto x : done)
+            REQUIRE(x == 1);
+
+    }
+
+    SECTION("timing") {
+
+        task_graph g;
+        isize a = g.add("sleep", [] { std::this_thread::sleep_for(std::chrono::milliseconds(2)); });
+        g.run();
+        REQUIRE(g.elapsed(a) >= std::chrono::milliseconds(2));
+        REQUIRE(g.name(a) == std::string_view("sleep"));
+
+    }
+
+}
+
+TEST_CASE("task_graph benchmark", "[.benchmark]") {
+
+    using ns = std::chrono::duration<double, std::nano>;
+
+    // a wide graph of short chains, as for per-chunk frame work
+    for (isize width : { 1, 16, 256 }) {
+        const isize depth = 4;
+        const Atomic<i64> sum(0);
+        task_graph g;
+        for (isize i = 0; i != width; ++i) {
+            isize previous = -1;
+            for (isize s = 0; s != depth; ++s) {
+                isize j = g.add("stage", [&] { sum.fetch_add(1, std::memory_order_relaxed); });
+                if (previous >= 0)
+                    g.precede(previous, j);
+                previous = j;
+            }
+        }
+        const int M = 1000;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int k = 0; k != M; ++k)
+            g.run();
+        auto t1 = std::chrono::steady_clock::now();
+        REQUIRE(sum.load(std::memory_order_relaxed) == M * width * depth);
+        printf("task_graph %td x %td: %g ns/run, %g ns/node\n", width, depth,
+               ns(t1 - t0).count() / M, ns(t1 - t0).count() / (M * width * depth));
+    }
+
+}
+
+} // namespace manic
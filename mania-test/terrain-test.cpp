@@ -0,0 +1,245 @@
+//
+//  terrain-test.cpp
+//  mania-test
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#include <chrono>
+#include <cstdio>
+
+#include <catch2/catch.hpp>
+
+#include "hash.hpp"
+#include "terrain.hpp"
+
+namespace manic {
+
+TEST_CASE("explode_filter_transpose") {
+
+    // matches explode, crop, filter_rows, filter_columns exactly
+
+    vector<double> f(16);
+    for (isize k = 0; k != 16; ++k)
+        f[k] = std::exp(-sqr(k - 7.5) / 8.0);
+
+    for (isize offset = 0; offset != 4; ++offset) {
+        isize ro = offset & 1;
+        isize co = offset >> 1;
+        matrix<double> a(13, 11);
+        for (isize i = 0; i != a.rows(); ++i)
+            for (isize j = 0; j != a.columns(); ++j)
+                a(i, j) = std::sin(i * 3.0 + j * 7.0);
+        isize rows = 2 * a.rows() - 1;
+        isize columns = 2 * a.columns() - 1;
+
+        matrix<double> b(a.rows() * 2, a.columns() * 2);
+        explode(b, a);
+        b.crop(ro, co, rows, columns);
+        matrix<double> c(rows, columns - 16);
+        filter_rows(c, b, f);
+        matrix<double> d(rows - 16, columns - 16);
+        filter_columns(d, c, f);
+
+        matrix<double> t(columns - 16, a.rows());
+        explode_filter_transpose(t, a, co, f);
+        matrix<double> e(rows - 16, columns - 16);
+        explode_filter_transpose(e, t, ro, f);
+
+        for (isize i = 0; i != d.rows(); ++i)
+            for (isize j = 0; j != d.columns(); ++j)
+                REQUIRE(d(i, j) == e(i, j));
+    }
+
+}
+
+TEST_CASE("terrain_cache") {
+
+    SECTION("consistent") {
+
+        // the cache reproduces the uncached fixed-point generator exactly,
+        // for any alignment of the request to the tiles
+
+        for (isize depth = 1; depth != 5; ++depth) {
+            terrain_cache c(7, depth);
+            for (auto [i, j, rows, columns] : {
+                std::tuple<i64, i64, i64, i64>{0, 0, 16, 16},
+                {16, -32, 16, 16},
+                {-37, 5, 23, 41},
+                {100, 100, 1, 1},
+            }) {
+                matrix<i32> a = terrain_fixed(i, j, rows, columns, 7, depth);
+                matrix<i32> b = c(i, j, rows, columns);
+                REQUIRE(a.rows() == b.rows());
+                REQUIRE(a.columns() == b.columns());
+                for (i64 s = 0; s != rows; ++s)
+                    for (i64 t = 0; t != columns; ++t)
+                        REQUIRE(a(s, t) == b(s, t));
+            }
+        }
+
+    }
+
+    SECTION("seamless") {
+
+        // neighbouring chunks agree with a single larger request
+
+        terrain_cache c(3, 4);
+        matrix<i32> a = c(-16, -16, 32, 32);
+        for (i64 u = -1; u != 1; ++u)
+            for (i64 v = -1; v != 1; ++v) {
+                matrix<i32> b = c(u * 16, v * 16, 16, 16);
+                for (i64 s = 0; s != 16; ++s)
+                    for (i64 t = 0; t != 16; ++t)
+                        REQUIRE(b(s, t) == a(s + (u + 1) * 16, t + (v + 1) * 16));
+            }
+
+    }
+
+    SECTION("reuse") {
+
+        // at depths that use tiles, a stream of neighbouring chunks finds
+        // most of the coarse tiles it needs already cached
+
+        terrain_cache c(5, 4);
+        for (i64 u = 0; u != 16; ++u)
+            for (i64 v = 0; v != 16; ++v)
+                c(u * 16, v * 16, 16, 16);
+        auto s = c.get_statistics();
+        REQUIRE(s.tiles == (isize) s.misses);
+        REQUIRE(s.hits > 4 * s.misses);
+
+    }
+
+    SECTION("eviction") {
+
+        // a sweep touching more tiles than the cache holds stays within
+        // capacity, and evicted tiles are recomputed identically
+
+        terrain_cache c(5, 3);
+        matrix<i32> a = c(0, 0, 16, 16);
+        for (i64 u = 0; u != 200; ++u)
+            for (i64 v = 0; v != 200; ++v)
+                c(u * 16, v * 16, 16, 16);
+        auto s = c.get_statistics();
+        REQUIRE(s.misses > terrain_cache::CAPACITY);
+        REQUIRE(s.tiles == terrain_cache::CAPACITY);
+        matrix<i32> b = c(0, 0, 16, 16);
+        matrix<i32> d = terrain_fixed(0, 0, 16, 16, 5, 3);
+        for (i64 i = 0; i != 16; ++i)
+            for (i64 j = 0; j != 16; ++j) {
+                REQUIRE(a(i, j) == b(i, j));
+                REQUIRE(b(i, j) == d(i, j));
+            }
+
+    }
+
+}
+
+TEST_CASE("terrain_cache lod") {
+
+    // block means of the full-resolution terrain
+    auto means = [](u64 seed, isize depth, isize level, vec<i64, 2> xy) {
+        i64 m = i64(1) << level;
+        matrix<i32> a = terrain_fixed(xy.x * 16 * m, xy.y * 16 * m, 16 * m, 16 * m, seed, depth);
+        matrix<double> b(16, 16);
+        for (i64 s = 0; s != 16 * m; ++s)
+            for (i64 t = 0; t != 16 * m; ++t)
+                b(s / m, t / m) += a(s, t) / (double) (m * m);
+        return b;
+    };
+
+    SECTION("exact") {
+
+        // levels whose octaves are all included are exact up to rounding
+        for (isize depth : {isize(1), isize(4)}) {
+            terrain_cache c(7, depth);
+            for (isize level = 0; level <= terrain_cache::LOD_EXACT + 1; ++level) {
+                matrix<i32> a = c.lod(level, {1, -2});
+                matrix<double> b = means(7, depth, level, {1, -2});
+                for (i64 s = 0; s != 16; ++s)
+                    for (i64 t = 0; t != 16; ++t)
+                        REQUIRE(std::abs(a(s, t) - b(s, t)) < 2.0);
+            }
+        }
+
+    }
+
+    SECTION("approximate") {
+
+        // beyond, the neglected fine octaves are small compared to the
+        // coarse ones
+        terrain_cache c(7, 6);
+        for (isize level = terrain_cache::LOD_EXACT + 2; level != 7; ++level) {
+            matrix<i32> a = c.lod(level, {-1, 0});
+            matrix<double> b = means(7, 6, level, {-1, 0});
+            double e = 0.0;
+            double f = 0.0;
+            for (i64 s = 0; s != 16; ++s)
+                for (i64 t = 0; t != 16; ++t) {
+                    e += sqr(a(s, t) - b(s, t));
+                    f += sqr(b(s, t));
+                }
+            REQUIRE(e < 0.01 * f);
+        }
+
+    }
+
+}
+
+TEST_CASE("terrain_fixed") {
+
+    SECTION("approximates terrain") {
+
+        for (isize depth = 1; depth != 4; ++depth) {
+            matrix<double> a = terrain(-20, 30, 24, 24, 5, depth);
+            matrix<i32> b = terrain_fixed(-20, 30, 24, 24, 5, depth);
+            for (i64 s = 0; s != 24; ++s)
+                for (i64 t = 0; t != 24; ++t)
+                    REQUIRE(std::abs(a(s, t) - b(s, t) * std::ldexp(1.0, -TERRAIN_FRACTION_BITS)) < 0.01 * depth);
+        }
+
+    }
+
+    SECTION("golden") {
+
+        // any change here breaks lockstep with other builds and saved worlds
+
+        matrix<i32> a = terrain_fixed(-64, 64, 32, 32, 1, TERRAIN_MAX_DEPTH);
+        u64 h = 0;
+        for (i64 s = 0; s != 32; ++s)
+            for (i64 t = 0; t != 32; ++t)
+                h = hash(h ^ (u64) (u32) a(s, t));
+        REQUIRE(h == 0x41690a9b47e7f405);
+
+    }
+
+}
+
+TEST_CASE("terrain_cache benchmark", "[.benchmark]") {
+
+    using ms = std::chrono::duration<double, std::milli>;
+
+    // a 32 x 32 block of chunks, as the prefetcher streams them
+    for (isize depth : {isize(2), isize(4), isize(TERRAIN_MAX_DEPTH)}) {
+        terrain_cache c(5, depth);
+        auto t0 = std::chrono::steady_clock::now();
+        for (i64 u = 0; u != 32; ++u)
+            for (i64 v = 0; v != 32; ++v)
+                c(u * 16, v * 16, 16, 16);
+        auto t1 = std::chrono::steady_clock::now();
+        for (i64 u = 0; u != 32; ++u)
+            for (i64 v = 0; v != 32; ++v)
+                terrain_fixed(u * 16, v * 16, 16, 16, 5, depth);
+        auto t2 = std::chrono::steady_clock::now();
+        auto s = c.get_statistics();
+        printf("terrain_cache depth %td: %.1f%% hits (%llu of %llu), cached %g ms, uncached %g ms\n",
+               depth, 100.0 * s.hits / (s.hits + s.misses),
+               (unsigned long long) s.hits, (unsigned long long) (s.hits + s.misses),
+               ms(t1 - t0).count(), ms(t2 - t1).count());
+    }
+
+}
+
+}
@@ -0,0 +1,111 @@
+//
+//  terrain_bake-test.cpp
+//  mania-test
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+
+#include <catch2/catch.hpp>
+
+#include "terrain_bake.hpp"
+
+namespace manic {
+
+namespace {
+
+template<typename T>
+bool _same(const_matrix_view<T> a, const_matrix_view<T> b) {
+    if (a.rows() != b.rows() || a.columns() != b.columns())
+        return false;
+    for (i64 i = 0; i != a.rows(); ++i)
+        for (i64 j = 0; j != a.columns(); ++j)
+            if (a(i, j) != b(i, j))
+                return false;
+    return true;
+}
+
+}
+
+TEST_CASE("terrain_bake") {
+
+    SECTION("explode_filter_transpose") {
+
+        auto f = _terrain_filter_fixed();
+        matrix<i32> a(37, 29);
+        for (i64 i = 0; i != a.rows(); ++i)
+            for (i64 j = 0; j != a.columns(); ++j)
+                a(i, j) = (i32) (hash(i * 1000 + j) >> 49) - (1 << 14);
+        for (isize offset = 0; offset != 2; ++offset) {
+            matrix<i32> b(2 * a.columns() - offset - f.size(), a.rows());
+            matrix<i32> c(b.rows(), b.columns());
+            explode_filter_transpose(b, a, offset, f, TERRAIN_FILTER_BITS);
+            _explode_filter_transpose_fft(c, a, offset, f, TERRAIN_FILTER_BITS, 3);
+            REQUIRE(_same<i32>(b, c));
+        }
+
+    }
+
+    SECTION("terrain_fixed") {
+
+        for (isize depth = 0; depth <= TERRAIN_MAX_DEPTH; ++depth) {
+            auto a = terrain_fixed(-37, 101, 45, 70, 9, depth);
+            auto b = terrain_fixed_fft(-37, 101, 45, 70, 9, depth, 4);
+            REQUIRE(_same<i32>(a, b));
+        }
+
+    }
+
+    SECTION("bake") {
+
+        char path[] = "/tmp/terrain_bake-test.XXXXXX";
+        int fd = mkstemp(path);
+        REQUIRE(fd >= 0);
+        close(fd);
+        {
+            _terrain_generator g(3, std::make_shared<terrain_store>(path));
+            REQUIRE(terrain_bake(g, {-64, -32}, {0, 48}, 3) == 4 * 5);
+            REQUIRE(terrain_bake(g, {-64, -32}, {0, 48}, 3) == 0);
+            REQUIRE(terrain_bake(g, {-64, -32}, {32, 48}, 3, true) == 2 * 5);
+        }
+        {
+            // the baked chunks are those the generator would produce
+            auto t = std::make_shared<terrain_store>(path);
+            REQUIRE(t->size() == 6 * 5);
+            _terrain_generator g(3);
+            for (i64 u = -64; u != 32; u += 16)
+                for (i64 v = -32; v != 48; v += 16)
+                    REQUIRE(_same<u8>(*t->try_get(3, {u, v}), g({u, v})()));
+        }
+        unlink(path);
+
+    }
+
+}
+
+TEST_CASE("terrain_bake benchmark", "[.benchmark]") {
+
+    const i64 N = 1024;
+    for (isize depth : {isize(1), isize(TERRAIN_MAX_DEPTH)}) {
+        auto t0 = std::chrono::steady_clock::now();
+        auto a = terrain_fixed(0, 0, N, N, 0, depth);
+        auto t1 = std::chrono::steady_clock::now();
+        auto b = terrain_fixed_fft(0, 0, N, N, 0, depth, 1);
+        auto t2 = std::chrono::steady_clock::now();
+        auto c = terrain_fixed_fft(0, 0, N, N, 0, depth);
+        auto t3 = std::chrono::steady_clock::now();
+        REQUIRE(_same<i32>(a, b));
+        REQUIRE(_same<i32>(a, c));
+        using ms = std::chrono::duration<double, std::milli>;
+        printf("terrain %lldx%lld depth %td: direct %g ms, fft %g ms, fft threaded %g ms\n",
+               (long long) N, (long long) N, depth, ms(t1 - t0).count(), ms(t2 - t1).count(), ms(t3 - t2).count());
+    }
+
+}
+
+} // namespace manic
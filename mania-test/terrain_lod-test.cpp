@@ -0,0 +1,134 @@
+//
+//  terrain_lod-test.cpp
+//  mania-test
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#include <cstdio>
+
+#include <catch2/catch.hpp>
+
+#include "terrain_lod.hpp"
+
+namespace manic {
+
+TEST_CASE("terrain_lod") {
+
+    terrain2 a(_terrain_generator(11));
+    terrain_lod b;
+
+    SECTION("level 0") {
+
+        matrix<u8> c = b(a, 0, {2, -1});
+        for (i64 s = 0; s != 16; ++s)
+            for (i64 t = 0; t != 16; ++t)
+                REQUIRE(c(s, t) == a({32 + s, -16 + t}));
+
+    }
+
+    SECTION("coarse levels do not touch chunks") {
+
+        for (isize level = 1; level != terrain_lod::LEVELS; ++level)
+            b(a, level, {-3, 5});
+        REQUIRE(a._table.size() == 0);
+
+    }
+
+    SECTION("edits") {
+
+        matrix<u8> before = b(a, 2, {0, 0});
+
+        // overwrite a whole 4x4 block with tracks
+        for (i64 i = 4; i != 8; ++i)
+            for (i64 j = 8; j != 12; ++j) {
+                u8& t = a({i, j});
+                b.did_write({i, j}, t, 255);
+                t = 255;
+            }
+
+        matrix<u8> after = b(a, 2, {0, 0});
+        for (i64 s = 0; s != 16; ++s)
+            for (i64 t = 0; t != 16; ++t) {
+                if (s == 1 && t == 2) {
+                    // the mean of the block is now exactly that of the edit,
+                    // up to the approximation of the original mean
+                    REQUIRE(std::abs(after(s, t) - 255) <= 1);
+                } else {
+                    REQUIRE(after(s, t) == before(s, t));
+                }
+            }
+
+        // coarser levels see a fraction of the edit
+        matrix<u8> c = b(a, 3, {0, 0});
+        terrain_lod d;
+        matrix<u8> e = d(a, 3, {0, 0});
+        REQUIRE(c(0, 1) > e(0, 1));
+
+    }
+
+    SECTION("bounded") {
+
+        // only blocks with net edits are kept
+
+        for (i64 j = 0; j != 16; ++j) {
+            u8& t = a({3, j});
+            b.did_write({3, j}, t, (u8) (t + 1));
+            ++t;
+        }
+        REQUIRE(b._edits[1].size() == 8);
+        REQUIRE(b._edits[4].size() == 1);
+        // undo them
+        for (i64 j = 0; j != 16; ++j) {
+            u8& t = a({3, j});
+            b.did_write({3, j}, t, (u8) (t - 1));
+            --t;
+        }
+        for (isize level = 0; level != terrain_lod::LEVELS; ++level)
+            REQUIRE(b._edits[level].size() == 0);
+
+    }
+
+    SECTION("serialization") {
+
+        // the edits survive a round trip, and a loaded view regenerates no
+        // chunks to apply them
+
+        for (i64 j = 0; j != 16; ++j) {
+            u8& t = a({40, j});
+            b.did_write({40, j}, t, 255);
+            t = 255;
+        }
+        {
+            u8& t = a({-100, 7});
+            b.did_write({-100, 7}, t, 0);
+            t = 0;
+        }
+        FILE* f = tmpfile();
+        REQUIRE(f);
+        serialize(b, f);
+        rewind(f);
+        terrain_lod c = deserialize<terrain_lod>(f);
+        fclose(f);
+        for (isize level = 0; level != terrain_lod::LEVELS; ++level) {
+            REQUIRE(c._edits[level].size() == b._edits[level].size());
+            for (auto&& [uv, d] : b._edits[level])
+                REQUIRE(*c._edits[level].try_get(uv) == d);
+        }
+        terrain2 e(_terrain_generator(11));
+        for (isize level = 1; level != 8; ++level)
+            for (vec<i64, 2> xy : {vec<i64, 2>{0, 0}, vec<i64, 2>{-1, 0}}) {
+                matrix<u8> g = b(a, level, xy);
+                matrix<u8> h = c(e, level, xy);
+                for (i64 s = 0; s != 16; ++s)
+                    for (i64 t = 0; t != 16; ++t)
+                        REQUIRE(g(s, t) == h(s, t));
+            }
+        REQUIRE(e._table.size() == 0);
+
+    }
+
+}
+
+} // namespace manic
@@ -0,0 +1,326 @@
+//
+//  terrain_store-test.cpp
+//  mania-test
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "terrain2.hpp"
+#include "terrain_store.hpp"
+
+namespace manic {
+
+TEST_CASE("terrain_store") {
+
+    char path[] = "/tmp/terrain_store-test.XXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE(fd >= 0);
+    close(fd);
+
+    auto same = [](const_matrix_view<u8> a, const_matrix_view<u8> b) {
+        for (i64 i = 0; i != 16; ++i)
+            for (i64 j = 0; j != 16; ++j)
+                if (a(i, j) != b(i, j))
+                    return false;
+        return true;
+    };
+
+    auto chunk = [](u8 x) {
+        matrix<u8> a(16, 16);
+        for (i64 i = 0; i != 16; ++i)
+            for (i64 j = 0; j != 16; ++j)
+                a(i, j) = (u8) (x + i * 16 + j);
+        return a;
+    };
+
+    SECTION("persistence") {
+
+        {
+            terrain_store s(path);
+            REQUIRE(s.is_open());
+            REQUIRE(s.size() == 0);
+            REQUIRE_FALSE(s.try_get(1, {0, 16}));
+            s.insert(1, {0, 16}, chunk(7));
+            s.insert(2, {0, 16}, chunk(8));
+            // present keys are not appended again
+            s.insert(1, {0, 16}, chunk(9));
+            REQUIRE(s.size() == 2);
+            REQUIRE(same(*s.try_get(1, {0, 16}), chunk(7)));
+        }
+        {
+            terrain_store s(path);
+            REQUIRE(s.size() == 2);
+            REQUIRE(same(*s.try_get(1, {0, 16}), chunk(7)));
+            REQUIRE(same(*s.try_get(2, {0, 16}), chunk(8)));
+            REQUIRE_FALSE(s.try_get(3, {0, 16}));
+            REQUIRE_FALSE(s.try_get(1, {16, 0}));
+        }
+        {
+            // other generator versions are ignored
+            terrain_store s(path, TERRAIN_GENERATOR_VERSION + 1);
+            REQUIRE(s.size() == 0);
+            s.insert(1, {0, 16}, chunk(10));
+            REQUIRE(same(*s.try_get(1, {0, 16}), chunk(10)));
+        }
+        {
+            terrain_store s(path);
+            REQUIRE(s.size() == 2);
+            REQUIRE(same(*s.try_get(1, {0, 16}), chunk(7)));
+        }
+
+    }
+
+    SECTION("torn") {
+
+        {
+            terrain_store s(path);
+            for (u8 i = 0; i != 3; ++i)
+                s.insert(0, {i * 16, 0}, chunk(i));
+        }
+        {
+            // corrupt the last record, as if a crash interrupted it; the
+            // first records follow the header and the initial index
+            FILE* f = fopen(path, "r+b");
+            REQUIRE(f);
+            fseek(f, (sizeof(terrain_store::_header)
+                      + terrain_store::SLOTS * sizeof(terrain_store::_slot)
+                      + 2 * sizeof(terrain_store::_record) + 100), SEEK_SET);
+            fputc(0xFF, f);
+            fclose(f);
+        }
+        {
+            terrain_store s(path);
+            REQUIRE(s.size() == 2);
+            REQUIRE(same(*s.try_get(0, {16, 0}), chunk(1)));
+            REQUIRE_FALSE(s.try_get(0, {32, 0}));
+            s.insert(0, {48, 0}, chunk(3));
+            // inserting the lost chunk again repairs it
+            s.insert(0, {32, 0}, chunk(2));
+            REQUIRE(same(*s.try_get(0, {32, 0}), chunk(2)));
+        }
+        {
+            terrain_store s(path);
+            REQUIRE(s.size() == 4);
+            REQUIRE(same(*s.try_get(0, {32, 0}), chunk(2)));
+            REQUIRE(same(*s.try_get(0, {48, 0}), chunk(3)));
+        }
+
+    }
+
+    SECTION("growth") {
+
+        // enough chunks to grow the index and the file several times, all
+        // found again through the persisted index
+
+        const i64 M = 4 * terrain_store::GROWTH / sizeof(terrain_store::_record);
+        {
+            terrain_store s(path);
+            for (i64 i = 0; i != M; ++i)
+                s.insert(1, {i * 16, -i * 16}, chunk((u8) i));
+            REQUIRE(s.size() == M);
+        }
+        {
+            terrain_store s(path);
+            REQUIRE(s.size() == M);
+            for (i64 i = 0; i != M; ++i)
+                REQUIRE(same(*s.try_get(1, {i * 16, -i * 16}), chunk((u8) i)));
+            REQUIRE_FALSE(s.try_get(1, {M * 16, -M * 16}));
+        }
+
+    }
+
+    SECTION("foreign") {
+
+        // a file that is not an indexed store, such as one in an older
+        // layout, is started afresh
+        {
+            FILE* f = fopen(path, "wb");
+            REQUIRE(f);
+            for (int i = 0; i != 4096; ++i)
+                fputc(i * 7, f);
+            fclose(f);
+        }
+        {
+            terrain_store s(path);
+            REQUIRE(s.is_open());
+            REQUIRE(s.size() == 0);
+            s.insert(2, {0, 0}, chunk(5));
+        }
+        {
+            terrain_store s(path);
+            REQUIRE(s.size() == 1);
+            REQUIRE(same(*s.try_get(2, {0, 0}), chunk(5)));
+        }
+
+    }
+
+    SECTION("full index") {
+
+        // an index with no vacant slot, whatever its header claims, would
+        // make probes for absent keys run forever; the store starts afresh
+        {
+            terrain_store s(path);
+            s.insert(0, {0, 0}, chunk(1));
+        }
+        {
+            FILE* f = fopen(path, "r+b");
+            REQUIRE(f);
+            fseek(f, sizeof(terrain_store::_header), SEEK_SET);
+            terrain_store::_slot x = {};
+            x._offset = 1;
+            for (i64 i = 0; i != terrain_store::SLOTS; ++i)
+                fwrite(&x, sizeof(x), 1, f);
+            fclose(f);
+        }
+        {
+            terrain_store s(path);
+            REQUIRE(s.is_open());
+            REQUIRE(s.size() == 0);
+            REQUIRE_FALSE(s.try_get(0, {16, 0}));
+            s.insert(0, {16, 0}, chunk(2));
+            REQUIRE(same(*s.try_get(0, {16, 0}), chunk(2)));
+        }
+
+    }
+
+    SECTION("misaligned") {
+
+        // offsets that are in bounds but not aligned are treated as corrupt,
+        // rather than dereferenced
+        {
+            terrain_store s(path);
+            s.insert(0, {0, 0}, chunk(1));
+            s.insert(0, {16, 0}, chunk(2));
+        }
+        {
+            // nudge the offset of every occupied slot
+            FILE* f = fopen(path, "r+b");
+            REQUIRE(f);
+            for (i64 i = 0; i != terrain_store::SLOTS; ++i) {
+                terrain_store::_slot x;
+                long o = sizeof(terrain_store::_header) + i * sizeof(x);
+                fseek(f, o, SEEK_SET);
+                REQUIRE(fread(&x, sizeof(x), 1, f) == 1);
+                if (x._offset) {
+                    ++x._offset;
+                    fseek(f, o, SEEK_SET);
+                    fwrite(&x, sizeof(x), 1, f);
+                }
+            }
+            fclose(f);
+        }
+        {
+            terrain_store s(path);
+            REQUIRE(s.size() == 0);
+            REQUIRE_FALSE(s.try_get(0, {0, 0}));
+            s.insert(0, {0, 0}, chunk(1));
+            REQUIRE(same(*s.try_get(0, {0, 0}), chunk(1)));
+        }
+        {
+            // and a misaligned index starts the file afresh
+            FILE* f = fopen(path, "r+b");
+            REQUIRE(f);
+            terrain_store::_header h;
+            REQUIRE(fread(&h, sizeof(h), 1, f) == 1);
+            ++h._table;
+            rewind(f);
+            fwrite(&h, sizeof(h), 1, f);
+            fclose(f);
+        }
+        {
+            terrain_store s(path);
+            REQUIRE(s.is_open());
+            REQUIRE(s.size() == 0);
+        }
+
+    }
+
+    SECTION("exclusive") {
+
+        // a second store on the same file is empty until the first closes
+        {
+            terrain_store s(path);
+            REQUIRE(s.is_open());
+            s.insert(0, {0, 0}, chunk(1));
+            terrain_store t(path);
+            REQUIRE_FALSE(t.is_open());
+            REQUIRE_FALSE(t.try_get(0, {0, 0}));
+            t.insert(0, {16, 0}, chunk(2));
+        }
+        {
+            terrain_store s(path);
+            REQUIRE(s.size() == 1);
+        }
+
+    }
+
+    SECTION("generator") {
+
+        matrix<u8> a;
+        {
+            auto t = std::make_shared<terrain_store>(path);
+            _terrain_generator g(5, t);
+            a = g({32, -16})();
+            REQUIRE(t->size() == 1);
+            REQUIRE(same(*t->try_get(5, {32, -16}), a));
+        }
+        // a fresh generator reads the stored chunk back
+        auto u = std::make_shared<terrain_store>(path);
+        REQUIRE(u->size() == 1);
+        REQUIRE(same(_terrain_generator(5, u)({32, -16})(), a));
+        REQUIRE(same(_terrain_generator(5)({32, -16})(), a));
+
+    }
+
+    SECTION("deserialized generator") {
+
+        // a generator loaded with a world uses this machine's store
+        auto t = std::make_shared<terrain_store>(path);
+        terrain_default_store() = t;
+        FILE* f = tmpfile();
+        REQUIRE(f);
+        serialize(_terrain_generator(7, nullptr), f);
+        rewind(f);
+        auto g = deserialize<_terrain_generator>(f);
+        fclose(f);
+        terrain_default_store() = nullptr;
+        REQUIRE(g._store == t);
+        matrix<u8> a = g({0, 16})();
+        REQUIRE(t->size() == 1);
+        REQUIRE(same(*t->try_get(7, {0, 16}), a));
+
+    }
+
+    SECTION("concurrent") {
+
+        terrain_store s(path);
+        std::vector<std::thread> v;
+        for (int k = 0; k != 4; ++k)
+            v.emplace_back([&, k] {
+                for (i64 i = 0; i != 256; ++i) {
+                    s.insert(0, {i * 16, 0}, chunk((u8) i));
+                    s.try_get(0, {((i * 7 + k) & 255) * 16, 0});
+                }
+            });
+        for (auto& t : v)
+            t.join();
+        REQUIRE(s.size() == 256);
+        for (i64 i = 0; i != 256; ++i)
+            REQUIRE(same(*s.try_get(0, {i * 16, 0}), chunk((u8) i)));
+
+    }
+
+    unlink(path);
+
+}
+
+} // namespace manic
@@ -0,0 +1,190 @@
+//
+//  tick_journal-test.cpp
+//  mania-test
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "hash.hpp"
+#include "task_graph.hpp"
+#include "tick_journal.hpp"
+#include "world.hpp"
+
+namespace manic {
+
+namespace {
+
+// Entity i writes a few cells around a position of its own, and wakes one
+void _record(tick_journal const& j, u64 i) {
+    auto w = j.open(i);
+    vec<i64, 2> xy{(i64) (hash(i) & 255) - 128, (i64) (hash(i + 1) & 255) - 128};
+    for (i64 k = 0; k != (i64) (i & 3) + 1; ++k)
+        w.write(xy + vec<i64, 2>{k, 0}, i * 10 + k);
+    w.wake(xy);
+}
+
+} // namespace
+
+TEST_CASE("tick_journal", "[tick_journal]") {
+
+    const u64 N = 1000;
+
+    SECTION("empty") {
+
+        tick_journal j;
+        REQUIRE(j.commit().empty());
+
+    }
+
+    SECTION("canonical order") {
+
+        // the same effects recorded by one thread in order, and by the pool
+        // in jobs of different sizes, commit identically
+        tick_journal j;
+        for (u64 i = 0; i != N; ++i)
+            _record(j, i);
+        std::vector<tick_journal::entry> expected = j.commit();
+        REQUIRE(expected.size() == N + (N / 4) * 10);
+        REQUIRE(std::is_sorted(expected.begin(), expected.end()));
+        for (auto const& e : expected)
+            REQUIRE(e._sequence < 5);
+
+        for (u64 width : { 1, 7, 64 }) {
+            // (each entity is opened once per tick)
+            task_graph g;
+            for (u64 a = 0; a < N; a += width)
+                g.add("record", [&j, a, b = std::min(a + width, N)] {
+                    // in reverse, so that buffers are out of order
+                    for (u64 i = b; i-- != a;)
+                        _record(j, i);
+                });
+            for (int tick = 0; tick != 3; ++tick) {
+                g.run();
+                auto const& actual = j.commit();
+                REQUIRE(actual.size() == expected.size());
+                for (usize k = 0; k != expected.size(); ++k) {
+                    REQUIRE(actual[k]._entity == expected[k]._entity);
+                    REQUIRE(actual[k]._sequence == expected[k]._sequence);
+                    REQUIRE(actual[k]._kind == expected[k]._kind);
+                    REQUIRE(actual[k]._xy == expected[k]._xy);
+                    REQUIRE(actual[k]._value == expected[k]._value);
+                }
+            }
+        }
+
+    }
+
+    SECTION("threads") {
+
+        // buffers of threads that have exited are still merged
+        tick_journal j;
+        std::vector<std::thread> t;
+        for (u64 k = 0; k != 4; ++k)
+            t.emplace_back([&j, k] {
+                for (u64 i = k; i < N; i += 4)
+                    _record(j, i);
+            });
+        for (auto& u : t)
+            u.join();
+        auto const& a = j.commit();
+        REQUIRE(a.size() == N + (N / 4) * 10);
+        REQUIRE(std::is_sorted(a.begin(), a.end()));
+        REQUIRE(j.commit().empty());
+
+    }
+
+    SECTION("many journals") {
+
+        // a thread alternating between journals finds its buffer in each,
+        // and one that uses many journals in turn keeps nothing of the old
+        tick_journal j, k;
+        for (u64 i = 0; i != N; ++i)
+            _record(i & 1 ? j : k, i);
+        REQUIRE(j.commit().size() == (N / 4) * 8); // <-- 3 or 5 effects each
+        REQUIRE(k.commit().size() == (N / 4) * 6); // <-- 2 or 4 effects each
+        for (u64 i = 0; i != N; ++i) {
+            tick_journal m;
+            _record(m, i);
+            REQUIRE(m.commit().size() == (i & 3) + 2);
+        }
+
+    }
+
+    SECTION("replay") {
+
+        // a parallel tick's effects reach the world in canonical order: the
+        // last entity to write a cell wins, whichever thread ran it, and
+        // writes and wake-ups move the waiters on their cells to the
+        // current time
+        tick_journal j;
+        world w;
+        entity2 a, b, c;
+        vec<i64, 2> shared{3, 4}, mine{5, 6}, woken{-7, 8}, far{1000, 1000};
+        w.wait_on_write(shared, &a);
+        w.wait_on_write(woken, &b);
+        w.wait_on_write(far, &c);
+        std::thread t([&j = std::as_const(j), shared] {
+            auto x = j.open(2);
+            x.write(shared, 22);
+        });
+        t.join();
+        {
+            auto x = j.open(1);
+            x.write(shared, 11);
+            x.write(mine, 12);
+            x.wake(woken);
+        }
+        w.replay(j);
+        REQUIRE(w.read(shared) == 22);
+        REQUIRE(w.read(mine) == 12);
+        REQUIRE(w.read(woken) == 0);
+        REQUIRE(!w._waiting_on_write.try_get(shared));
+        REQUIRE(!w._waiting_on_write.try_get(woken));
+        REQUIRE(w._waiting_on_write.try_get(far));
+        auto* now = w._waiting_on_time.try_get(w.counter);
+        REQUIRE(now);
+        REQUIRE(now->size() == 2);
+        REQUIRE(std::count(now->begin(), now->end(), &a) == 1);
+        REQUIRE(std::count(now->begin(), now->end(), &b) == 1);
+        REQUIRE(j.commit().empty());
+
+    }
+
+}
+
+TEST_CASE("tick_journal benchmark", "[.benchmark]") {
+
+    using ns = std::chrono::duration<double, std::nano>;
+
+    tick_journal j;
+    const u64 N = 1 << 20;
+    const int M = 10;
+    double record = 0, commit = 0;
+    for (int k = 0; k != M; ++k) {
+        auto t0 = std::chrono::steady_clock::now();
+        for (u64 i = 0; i != N; ++i) {
+            auto w = j.open(i);
+            w.write(vec<i64, 2>{(i64) i, 0}, i);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        auto const& a = j.commit();
+        auto t2 = std::chrono::steady_clock::now();
+        REQUIRE(a.size() == N);
+        record += ns(t1 - t0).count();
+        commit += ns(t2 - t1).count();
+    }
+    printf("tick_journal: %g ns/record, %g ns/entry commit\n", record / (M * N), commit / (M * N));
+
+}
+
+} // namespace manic
@@ -18,6 +18,16 @@ namespace manic {
                                                 ofType:[NSString stringWithUTF8String:string(ext).c_str()]] UTF8String];
     }
     
+    // Per-user cache directory; contents may be deleted by the system
+    string path_for_cache(string_view name) {
+        NSURL* url = [[NSFileManager defaultManager] URLForDirectory:NSCachesDirectory
+                                                            inDomain:NSUserDomainMask
+                                                   appropriateForURL:nil
+                                                              create:YES
+                                                               error:nil];
+        return [[[url path] stringByAppendingPathComponent:[NSString stringWithUTF8String:string(name).c_str()]] UTF8String];
+    }
+    
     string load(string name) {
         std::ifstream ifs(name.c_str());
         std::string s{std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()};
@@ -12,8 +12,8 @@
 #include <atomic>
 #include <cassert>
 
-#include "atomic_wait.hpp"
 #include "common.hpp"
+#include "parking_lot.hpp"
 
 namespace manic {
 
@@ -139,34 +139,23 @@ public:
     void wait(T, std::memory_order) noexcept = delete;
     void wait(T old, std::memory_order order) const noexcept {
         if constexpr(std::is_integral_v<T> || std::is_pointer_v<T>) {
-            std::atomic_wait_explicit(&_atomic, old, order);
+            parking_lot_wait(&_atomic, old, order);
         } else {
             using U = typename _uint_t<sizeof(T) * 8>::type;
-            std::atomic_wait_explicit((std::atomic<U>*) &_atomic,
-                                      (U&) old,
-                                      order);
+            parking_lot_wait((std::atomic<U> const*) &_atomic,
+                             (U&) old,
+                             order);
         }
     }
     
     void notify_one() noexcept = delete;
     void notify_one() const noexcept {
-        if constexpr(std::is_integral_v<T> || std::is_pointer_v<T>) {
-            std::atomic_notify_one(&_atomic);
-            
-        } else {
-            using U = typename _uint_t<sizeof(T) * 8>::type;
-            std::atomic_notify_one((std::atomic<U>*) &_atomic);
-        }
+        parking_lot_notify(&_atomic, false);
     }
     
     void notify_all() noexcept = delete;
     void notify_all() const noexcept {
-        if constexpr(std::is_integral_v<T> || std::is_pointer_v<T>) {
-            std::atomic_notify_all(&_atomic);
-        } else {
-            using U = typename _uint_t<sizeof(T) * 8>::type;
-            std::atomic_notify_all((std::atomic<U>*) &_atomic);
-        }
+        parking_lot_notify(&_atomic, true);
     }
     
 };
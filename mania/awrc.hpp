@@ -9,11 +9,15 @@
 #ifndef awrc_hpp
 #define awrc_hpp
 
+#include <algorithm>
 #include <atomic>
+#include <optional>
 #include <thread>
 #include <utility>
 
+#include "atomic.hpp"
 #include "common.hpp"
+#include "epoch.hpp"
 #include "hash.hpp"
 
 namespace manic {
@@ -72,161 +76,879 @@ struct unique_ptr {
 
 
 
+// Concurrent hash trie
+//
+// Prokopec, Bronson, Bagwell and Odersky, "Concurrent Tries with Efficient
+// Non-Blocking Snapshots", PPoPP 2012
+//
+// Lock-free lookup, insert and remove.  The O(1) snapshot marks the root with
+// a new generation via a restricted double-compare single-swap (RDCSS) on the
+// root, and thereafter every main node update uses a generation-compare-and-
+// swap (GCAS) that fails if the root has moved to a new generation, so that
+// each trie lazily copies the inode paths that it touches.
+//
+// The paper assumes a garbage collector.  Here, nodes are reference counted
+// by the nodes (and snapshots) that point to them, and the reference
+// released by unlinking a node is deferred with epoch-based reclamation, so
+// that a thread pinned before the unlink can still traverse it.  While pinned
+// a thread may therefore acquire any node it can reach.
+//
+// Member functions are const because they are safe to call concurrently; the
+// values are immutable once inserted and are returned by copy.
+
 template<typename K, typename V>
 struct ctrie {
+    
+    enum _kind_t : u32 {
+        INODE,
+        SNODE,
+        CNODE,
+        TNODE,
+        LNODE,
+        FAILED,
+        RDCSS,
+    };
+    
+    struct _node {
+        
+        Atomic<u64> _count;
+        _kind_t const _kind;
         
-    struct branch {
+        explicit _node(_kind_t k) : _count(1), _kind(k) {}
         
-        virtual ~branch() = default;
-        virtual V* lookup(u64 h) = 0;
+        void acquire() const {
+            _count.fetch_add(1, std::memory_order_relaxed);
+        }
         
     };
     
-    struct main_node {
+    // Main nodes are the targets of inodes.  While a GCAS is pending, _prev
+    // points to the main node being replaced, or to a _failed node wrapping
+    // it if the GCAS is being rolled back.  _prev does not own its target.
+    struct _main : _node {
+        
+        Atomic<_main const*> _prev;
+        
+        explicit _main(_kind_t k, _main const* p = nullptr) : _node(k), _prev(p) {}
         
-        virtual ~main_node() = default;
-        virtual V* lookup(u64 h) = 0;
     };
     
-    struct inode : branch {
+    struct _inode : _node {
+        
+        Atomic<_main const*> _mainnode;
+        u64 const _gen;
         
-        main_node* _child;
+        _inode(_main const* m, u64 g) : _node(INODE), _mainnode(m), _gen(g) {}
         
-        inode() : _child{nullptr} {}
+    };
+    
+    struct _snode : _node {
         
-        virtual V* lookup(u64 h) {
-            return _child ? _child->lookup(h) : nullptr;
+        u64 const _hash;
+        K const _key;
+        V const _value;
+        
+        template<typename Q, typename U>
+        _snode(u64 h, Q&& k, U&& v)
+        : _node(SNODE)
+        , _hash(h)
+        , _key(std::forward<Q>(k))
+        , _value(std::forward<U>(v)) {
         }
         
-        /*
-        virtual main_node* insert(u64 h, K k, V v) {
-            if (_child) {
-                _child = _child->insert(h, k, v);
-            } else {
-                _child = cnode::make(nullptr, h, new snode{k, v});
-            }
-            return nullptr;
+        bool matches(u64 h, K const& k) const {
+            return (_hash == h) && (_key == k);
         }
-         */
+        
     };
     
+    // A cnode holds popcount(_bitmap) inodes or snodes.  An lnode holds a
+    // list of snodes whose hashes are identical.  Both are allocated with
+    // their child arrays trailing.
     
-    struct snode : branch {
-        K _key;
-        V _value;
-
-        virtual V* lookup(u64 h) {
-            return &_value;
+    struct _cnode : _main {
+        
+        u64 const _bitmap;
+        u64 const _gen;
+        
+        _cnode(u64 b, u64 g) : _main(CNODE), _bitmap(b), _gen(g) {}
+        
+        isize size() const { return __builtin_popcountll(_bitmap); }
+        
+        _node const** begin() const { return (_node const**) (this + 1); }
+        _node const** end() const { return begin() + size(); }
+        
+        isize index(u64 flag) const {
+            return __builtin_popcountll(_bitmap & (flag - 1));
         }
         
-        virtual branch* insert(u64 h, K k, V v) {
-            
+        static _cnode* make(u64 b, u64 g) {
+            void* p = operator new(sizeof(_cnode) + __builtin_popcountll(b) * sizeof(_node const*));
+            return new (p) _cnode(b, g);
         }
         
     };
-
+    
+    struct _lnode : _main {
         
-    struct cnode : main_node {
+        isize const _size;
         
-        u64 _bitmap;
-        branch* _children[];
-
-        int size() const {
-            return __builtin_popcountll(_bitmap);
+        explicit _lnode(isize n) : _main(LNODE), _size(n) {}
+        
+        _snode const** begin() const { return (_snode const**) (this + 1); }
+        _snode const** end() const { return begin() + _size; }
+        
+        static _lnode* make(isize n) {
+            void* p = operator new(sizeof(_lnode) + n * sizeof(_snode const*));
+            return new (p) _lnode(n);
         }
         
-        virtual ~cnode() {
-            auto i = size();
-            while (i--)
-                std::destroy_at(_children + i);
+    };
+    
+    // A tomb marks an inode whose cnode has contracted to a single snode; the
+    // parent will resurrect the snode in its own cnode
+    struct _tnode : _main {
+        
+        _snode const* const _sn;
+        
+        explicit _tnode(_snode const* sn) : _main(TNODE), _sn(sn) {}
+        
+    };
+    
+    struct _failed : _main {
+        
+        explicit _failed(_main const* p) : _main(FAILED, p) {}
+        
+    };
+    
+    enum _state_t : u32 {
+        PENDING,
+        COMMITTED,
+        ABORTED,
+    };
+    
+    struct _rdcss : _node {
+        
+        _inode const* const _ov;
+        _main const* const _expected;
+        _inode const* const _nv;
+        Atomic<_state_t> _state;
+        
+        _rdcss(_inode const* ov, _main const* expected, _inode const* nv)
+        : _node(RDCSS)
+        , _ov(ov)
+        , _expected(expected)
+        , _nv(nv)
+        , _state(PENDING) {
         }
-
-        branch* operator[](u64 h) {
-            auto i = 1ull << (h & 63);
-            if (_bitmap & i) {
-                return _children[__builtin_popcountll(_bitmap & (i - 1))];
-            } else {
-                return nullptr;
+        
+    };
+    
+    static constexpr int W = 6;
+    
+    static u64 _flag(u64 h, int lev) {
+        return 1ull << ((h >> lev) & 63);
+    }
+    
+    static u64 _next_gen() {
+        static std::atomic<u64> gen{0};
+        return gen.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+    
+    // Reference counting
+    
+    static void _release(_node const* p) {
+        if (p->_count.fetch_sub(1, std::memory_order_release) == 1) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            _destroy(p);
+        }
+    }
+    
+    // release once no pinned thread can be traversing p
+    static void _retire(_node const* p) {
+        epoch::defer([](void const* q) {
+            _release(static_cast<_node const*>(q));
+        }, p);
+    }
+    
+    template<typename T>
+    static void _deallocate(T const* m) {
+        _main const* f = m->_prev.load(std::memory_order_relaxed);
+        if (f && (f->_kind == FAILED))
+            delete static_cast<_failed const*>(f);
+        m->~T();
+        operator delete(const_cast<T*>(m));
+    }
+    
+    static void _destroy(_node const* p) {
+        switch (p->_kind) {
+            case INODE: {
+                auto i = static_cast<_inode const*>(p);
+                _main const* m = i->_mainnode.load(std::memory_order_relaxed);
+                // a GCAS left pending owns the node it was replacing
+                if (_main const* q = m->_prev.load(std::memory_order_relaxed))
+                    _release((q->_kind == FAILED) ? q->_prev.load(std::memory_order_relaxed) : q);
+                _release(m);
+                delete i;
+                break;
+            }
+            case SNODE:
+                delete static_cast<_snode const*>(p);
+                break;
+            case CNODE: {
+                auto cn = static_cast<_cnode const*>(p);
+                for (_node const* c : *cn)
+                    _release(c);
+                _deallocate(cn);
+                break;
+            }
+            case TNODE: {
+                auto tn = static_cast<_tnode const*>(p);
+                _release(tn->_sn);
+                _deallocate(tn);
+                break;
             }
+            case LNODE: {
+                auto ln = static_cast<_lnode const*>(p);
+                for (_snode const* c : *ln)
+                    _release(c);
+                _deallocate(ln);
+                break;
+            }
+            case FAILED:
+                delete static_cast<_failed const*>(p);
+                break;
+            case RDCSS:
+                // the descriptor does not own _ov or _nv
+                delete static_cast<_rdcss const*>(p);
+                break;
         }
-
-        V* lookup(u64 h) {
-            auto p = operator[](h);
-            return p ? p->lookup(h >> 6) : nullptr;
-        }
-        
-        cnode* make(cnode* old, u64 h, branch* p) {
-            h &= 63;
-            auto i = 1ull << h;
-            if (old) {
-                auto b = old->_bitmap | i;
-                auto n = __builtin_popcountll(b);
-                auto a = (cnode*) malloc(sizeof(cnode) + sizeof(branch*) * n);
-                new (a) cnode{b};
-                auto k = __buildin_popccountll(b & (i - 1));
-                for (int j = 0; j != k; ++j)
-                    new (_children + j) branch*{old->_children[j]};
-                new (_children + k) branch*{p};
-                for (int j = k + 1; j != n; ++j) {
-                    assert(false);
+    }
+    
+    // State
+    
+    Atomic<_node const*> _root;
+    bool _read_only;
+    
+    ctrie()
+    : _root(nullptr)
+    , _read_only(false) {
+        u64 g = _next_gen();
+        _root = new _inode(_cnode::make(0, g), g);
+    }
+    
+    ctrie(_inode const* r, bool read_only)
+    : _root(r)
+    , _read_only(read_only) {
+    }
+    
+    ctrie(ctrie const&) = delete;
+    
+    ctrie(ctrie&& other)
+    : _root(std::exchange(static_cast<_node const*&>(other._root), nullptr))
+    , _read_only(other._read_only) {
+    }
+    
+    ~ctrie() {
+        if (_node const* r = _root)
+            _release(r);
+    }
+    
+    ctrie& operator=(ctrie const&) = delete;
+    
+    ctrie& operator=(ctrie&& other) {
+        using std::swap;
+        swap(static_cast<_node const*&>(_root), static_cast<_node const*&>(other._root));
+        swap(_read_only, other._read_only);
+        return *this;
+    }
+    
+    // RDCSS on the root
+    
+    _inode const* _rdcss_complete(bool abort) const {
+        for (;;) {
+            _node const* v = _root.load(std::memory_order_acquire);
+            if (v->_kind == INODE)
+                return static_cast<_inode const*>(v);
+            auto d = static_cast<_rdcss const*>(v);
+            _state_t s = d->_state.load(std::memory_order_acquire);
+            if (s == PENDING) {
+                _state_t t = (!abort && (_gcas_read(d->_ov) == d->_expected)) ? COMMITTED : ABORTED;
+                if (d->_state.compare_exchange_strong(s,
+                                                      t,
+                                                      std::memory_order_acq_rel,
+                                                      std::memory_order_acquire))
+                    s = t;
+            }
+            _inode const* w = (s == COMMITTED) ? d->_nv : d->_ov;
+            if (_root.compare_exchange_strong(v,
+                                              w,
+                                              std::memory_order_acq_rel,
+                                              std::memory_order_acquire)) {
+                _retire((s == COMMITTED) ? d->_ov : d->_nv);
+                _retire(d);
+                return w;
+            }
+        }
+    }
+    
+    _inode const* _read_root(bool abort = false) const {
+        _node const* r = _root.load(std::memory_order_acquire);
+        return (r->_kind == INODE) ? static_cast<_inode const*>(r) : _rdcss_complete(abort);
+    }
+    
+    // takes ownership of nv
+    bool _rdcss_root(_inode const* ov, _main const* expected, _inode const* nv) const {
+        _rdcss const* d = new _rdcss(ov, expected, nv);
+        _node const* e = ov;
+        if (_root.compare_exchange_strong(e,
+                                          d,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed)) {
+            _rdcss_complete(false);
+            return d->_state.load(std::memory_order_acquire) == COMMITTED;
+        }
+        _release(nv);
+        _release(d);
+        return false;
+    }
+    
+    // GCAS on inode main nodes
+    
+    _main const* _gcas_complete(_inode const* in, _main const* m) const {
+        for (;;) {
+            if (!m)
+                return nullptr;
+            _main const* prev = m->_prev.load(std::memory_order_acquire);
+            _inode const* ctr = _read_root(true);
+            if (!prev)
+                return m;
+            if (prev->_kind == FAILED) {
+                // roll back
+                _main const* old = prev->_prev.load(std::memory_order_acquire);
+                if (in->_mainnode.compare_exchange_strong(m,
+                                                      old,
+                                                      std::memory_order_acq_rel,
+                                                      std::memory_order_acquire)) {
+                    _retire(m);
+                    return old;
                 }
-                
-            } else {
-                auto a = (cnode*) malloc(sizeof(cnode) + sizeof(branch*) * 1);
-                new (a) cnode{i};
-                new (_children + 0) branch*{p};
+                continue;
             }
+            if ((ctr->_gen == in->_gen) && !_read_only) {
+                // commit
+                if (m->_prev.compare_exchange_strong(prev,
+                                                     nullptr,
+                                                     std::memory_order_acq_rel,
+                                                     std::memory_order_acquire)) {
+                    _retire(prev);
+                    return m;
+                }
+                continue;
+            }
+            // a snapshot intervened
+            auto f = new _failed(prev);
+            if (!m->_prev.compare_exchange_strong(prev,
+                                                  f,
+                                                  std::memory_order_acq_rel,
+                                                  std::memory_order_acquire))
+                delete f;
+            m = in->_mainnode.load(std::memory_order_acquire);
         }
-        
-        // ctor
-        cnode(u64 h, branch* p) {
-            _bitmap = 1ull << (h & 63);
-            _children[0] = p;
+    }
+    
+    _main const* _gcas_read(_inode const* in) const {
+        _main const* m = in->_mainnode.load(std::memory_order_acquire);
+        if (!m->_prev.load(std::memory_order_acquire))
+            return m;
+        return _gcas_complete(in, m);
+    }
+    
+    // takes ownership of n
+    bool _gcas(_inode const* in, _main const* old, _main const* n) const {
+        n->_prev.store(old, std::memory_order_relaxed);
+        _main const* e = old;
+        if (in->_mainnode.compare_exchange_strong(e,
+                                              n,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed)) {
+            _gcas_complete(in, n);
+            return !n->_prev.load(std::memory_order_acquire);
         }
-        
-                        
-        cnode* insert(u64 h, K k, V v) {
-            if (auto b = operator[](h)) {
-                b->insert(h >> 6, k, v);
-                return this;
+        n->_prev.store(nullptr, std::memory_order_relaxed);
+        _release(n);
+        return false;
+    }
+    
+    // Node construction.  Children copied from an existing node are acquired;
+    // new children are passed with ownership.
+    
+    _inode const* _copy_to_gen(_inode const* in, u64 gen) const {
+        _main const* m = _gcas_read(in);
+        m->acquire();
+        return new _inode(m, gen);
+    }
+    
+    _node const* _renew(_node const* c, u64 gen, bool renew) const {
+        if (renew && (c->_kind == INODE))
+            return _copy_to_gen(static_cast<_inode const*>(c), gen);
+        c->acquire();
+        return c;
+    }
+    
+    _cnode const* _renewed(_cnode const* cn, u64 gen) const {
+        auto ncn = _cnode::make(cn->_bitmap, gen);
+        std::transform(cn->begin(), cn->end(), ncn->begin(), [&](_node const* c) {
+            return _renew(c, gen, true);
+        });
+        return ncn;
+    }
+    
+    _cnode const* _inserted_at(_cnode const* cn, isize pos, u64 flag, _node const* nn, u64 gen) const {
+        bool renew = cn->_gen != gen;
+        auto ncn = _cnode::make(cn->_bitmap | flag, gen);
+        auto d = ncn->begin();
+        for (isize j = 0; j != cn->size(); ++j) {
+            if (j == pos)
+                *d++ = nn;
+            *d++ = _renew(cn->begin()[j], gen, renew);
+        }
+        if (pos == cn->size())
+            *d = nn;
+        return ncn;
+    }
+    
+    _cnode const* _updated_at(_cnode const* cn, isize pos, _node const* nn, u64 gen) const {
+        bool renew = cn->_gen != gen;
+        auto ncn = _cnode::make(cn->_bitmap, gen);
+        for (isize j = 0; j != cn->size(); ++j)
+            ncn->begin()[j] = (j == pos) ? nn : _renew(cn->begin()[j], gen, renew);
+        return ncn;
+    }
+    
+    _cnode const* _removed_at(_cnode const* cn, isize pos, u64 flag, u64 gen) const {
+        bool renew = cn->_gen != gen;
+        auto ncn = _cnode::make(cn->_bitmap & ~flag, gen);
+        auto d = ncn->begin();
+        for (isize j = 0; j != cn->size(); ++j)
+            if (j != pos)
+                *d++ = _renew(cn->begin()[j], gen, renew);
+        return ncn;
+    }
+    
+    // takes ownership of x and y
+    _main const* _dual(_snode const* x, _snode const* y, int lev, u64 gen) const {
+        if (lev < 64) {
+            u64 i = _flag(x->_hash, lev);
+            u64 j = _flag(y->_hash, lev);
+            auto ncn = _cnode::make(i | j, gen);
+            if (i == j) {
+                ncn->begin()[0] = new _inode(_dual(x, y, lev + W, gen), gen);
             } else {
-                u64 i = h & 0x3F;
-                u64 j = 1ull << i;
-                u64 k = __builtin_popcountll(_bitmap & (j - 1));
-                u64 n = size();
-                auto p = (cnode*) malloc((n + 2) * 8);
-                p->_bitmap = _bitmap | j;
-                for (u64 a = 0; a != k; ++a)
-                    p->_children[a] = _children[a];
-                for (u64 a = k; a != n; ++a)
-                    p->_children[a + 1] = _children[a];
-                auto q = new snode{k, v};
-                p->_children[k] = q;
-                return p;
+                ncn->begin()[i > j] = x;
+                ncn->begin()[i < j] = y;
             }
+            return ncn;
         }
-        
+        auto ln = _lnode::make(2);
+        ln->begin()[0] = x;
+        ln->begin()[1] = y;
+        return ln;
+    }
+    
+    // takes ownership of cn
+    _main const* _to_contracted(_cnode const* cn, int lev) const {
+        if ((lev > 0) && (cn->size() == 1) && (cn->begin()[0]->_kind == SNODE)) {
+            auto sn = static_cast<_snode const*>(cn->begin()[0]);
+            sn->acquire();
+            _release(cn);
+            return new _tnode(sn);
+        }
+        return cn;
+    }
+    
+    _main const* _to_compressed(_cnode const* cn, int lev, u64 gen) const {
+        auto ncn = _cnode::make(cn->_bitmap, gen);
+        std::transform(cn->begin(), cn->end(), ncn->begin(), [&](_node const* c) -> _node const* {
+            if (c->_kind == INODE) {
+                _main const* m = _gcas_read(static_cast<_inode const*>(c));
+                if (m->_kind == TNODE) {
+                    // resurrect
+                    _snode const* sn = static_cast<_tnode const*>(m)->_sn;
+                    sn->acquire();
+                    return sn;
+                }
+            }
+            c->acquire();
+            return c;
+        });
+        return _to_contracted(ncn, lev);
+    }
+    
+    void _clean(_inode const* in, int lev) const {
+        _main const* m = _gcas_read(in);
+        if (m->_kind == CNODE)
+            _gcas(in, m, _to_compressed(static_cast<_cnode const*>(m), lev, in->_gen));
+    }
+    
+    void _clean_parent(_inode const* parent, _inode const* in, u64 h, int lev, u64 startgen) const {
+        for (;;) {
+            _main const* m = _gcas_read(in);
+            _main const* pm = _gcas_read(parent);
+            if (pm->_kind != CNODE)
+                return;
+            auto cn = static_cast<_cnode const*>(pm);
+            u64 flag = _flag(h, lev);
+            if (!(cn->_bitmap & flag))
+                return;
+            isize pos = cn->index(flag);
+            if ((cn->begin()[pos] != in) || (m->_kind != TNODE))
+                return;
+            _snode const* sn = static_cast<_tnode const*>(m)->_sn;
+            sn->acquire();
+            auto ncn = _to_contracted(_updated_at(cn, pos, sn, parent->_gen), lev);
+            if (_gcas(parent, cn, ncn) || (_read_root()->_gen != startgen))
+                return;
+        }
+    }
+    
+    // Operations return RESTART when they encounter a concurrent
+    // modification that forces them to begin again from the root
+    
+    enum _result_t {
+        FOUND,
+        NOTFOUND,
+        RESTART,
     };
     
-    inode* _root = nullptr;
+    _result_t _lookup(_inode const* i, K const& k, u64 h, int lev, _inode const* parent, u64 startgen, std::optional<V>& out) const {
+        _main const* m = _gcas_read(i);
+        switch (m->_kind) {
+            case CNODE: {
+                auto cn = static_cast<_cnode const*>(m);
+                u64 flag = _flag(h, lev);
+                if (!(cn->_bitmap & flag))
+                    return NOTFOUND;
+                _node const* sub = cn->begin()[cn->index(flag)];
+                if (sub->_kind == INODE) {
+                    auto in = static_cast<_inode const*>(sub);
+                    if (_read_only || (startgen == in->_gen))
+                        return _lookup(in, k, h, lev + W, i, startgen, out);
+                    if (_gcas(i, m, _renewed(cn, startgen)))
+                        return _lookup(i, k, h, lev, parent, startgen, out);
+                    return RESTART;
+                }
+                auto sn = static_cast<_snode const*>(sub);
+                if (!sn->matches(h, k))
+                    return NOTFOUND;
+                out.emplace(sn->_value);
+                return FOUND;
+            }
+            case TNODE: {
+                if (!_read_only) {
+                    _clean(parent, lev - W);
+                    return RESTART;
+                }
+                auto sn = static_cast<_tnode const*>(m)->_sn;
+                if (!sn->matches(h, k))
+                    return NOTFOUND;
+                out.emplace(sn->_value);
+                return FOUND;
+            }
+            case LNODE: {
+                for (_snode const* sn : *static_cast<_lnode const*>(m)) {
+                    if (sn->matches(h, k)) {
+                        out.emplace(sn->_value);
+                        return FOUND;
+                    }
+                }
+                return NOTFOUND;
+            }
+            default:
+                assert(false);
+                return RESTART;
+        }
+    }
     
-    V* lookup(K const& k) {
-        return _root ? _root->lookup(hash(k)) : nullptr;
+    // FOUND: the key was present, and its previous value is in out
+    // NOTFOUND: the key was inserted
+    _result_t _insert(_inode const* i, K const& k, V const& v, u64 h, bool only_if_absent, int lev, _inode const* parent, u64 startgen, std::optional<V>& out) const {
+        _main const* m = _gcas_read(i);
+        switch (m->_kind) {
+            case CNODE: {
+                auto cn = static_cast<_cnode const*>(m);
+                u64 flag = _flag(h, lev);
+                isize pos = cn->index(flag);
+                if (!(cn->_bitmap & flag)) {
+                    auto ncn = _inserted_at(cn, pos, flag, new _snode(h, k, v), i->_gen);
+                    return _gcas(i, m, ncn) ? NOTFOUND : RESTART;
+                }
+                _node const* sub = cn->begin()[pos];
+                if (sub->_kind == INODE) {
+                    auto in = static_cast<_inode const*>(sub);
+                    if (startgen == in->_gen)
+                        return _insert(in, k, v, h, only_if_absent, lev + W, i, startgen, out);
+                    if (_gcas(i, m, _renewed(cn, startgen)))
+                        return _insert(i, k, v, h, only_if_absent, lev, parent, startgen, out);
+                    return RESTART;
+                }
+                auto sn = static_cast<_snode const*>(sub);
+                if (sn->matches(h, k)) {
+                    out.emplace(sn->_value);
+                    if (only_if_absent)
+                        return FOUND;
+                    auto ncn = _updated_at(cn, pos, new _snode(h, k, v), i->_gen);
+                    return _gcas(i, m, ncn) ? FOUND : RESTART;
+                }
+                // push both down a level
+                sn->acquire();
+                auto nin = new _inode(_dual(sn, new _snode(h, k, v), lev + W, i->_gen), i->_gen);
+                auto ncn = _updated_at(cn, pos, nin, i->_gen);
+                return _gcas(i, m, ncn) ? NOTFOUND : RESTART;
+            }
+            case TNODE: {
+                _clean(parent, lev - W);
+                return RESTART;
+            }
+            case LNODE: {
+                auto ln = static_cast<_lnode const*>(m);
+                auto it = std::find_if(ln->begin(), ln->end(), [&](_snode const* sn) {
+                    return sn->matches(h, k);
+                });
+                bool found = it != ln->end();
+                if (found) {
+                    out.emplace((*it)->_value);
+                    if (only_if_absent)
+                        return FOUND;
+                }
+                auto nln = _lnode::make(ln->_size + !found);
+                auto d = nln->begin();
+                for (_snode const* sn : *ln) {
+                    if (!sn->matches(h, k)) {
+                        sn->acquire();
+                        *d++ = sn;
+                    }
+                }
+                *d = new _snode(h, k, v);
+                return _gcas(i, m, nln) ? (found ? FOUND : NOTFOUND) : RESTART;
+            }
+            default:
+                assert(false);
+                return RESTART;
+        }
     }
     
-    void insert(K const& k, V const& v) {
-        if (!_root) {
-            _root = new inode;
+    _result_t _remove(_inode const* i, K const& k, u64 h, int lev, _inode const* parent, u64 startgen, std::optional<V>& out) const {
+        _main const* m = _gcas_read(i);
+        switch (m->_kind) {
+            case CNODE: {
+                auto cn = static_cast<_cnode const*>(m);
+                u64 flag = _flag(h, lev);
+                if (!(cn->_bitmap & flag))
+                    return NOTFOUND;
+                isize pos = cn->index(flag);
+                _node const* sub = cn->begin()[pos];
+                _result_t result = RESTART;
+                if (sub->_kind == INODE) {
+                    auto in = static_cast<_inode const*>(sub);
+                    if (startgen == in->_gen)
+                        result = _remove(in, k, h, lev + W, i, startgen, out);
+                    else if (_gcas(i, m, _renewed(cn, startgen)))
+                        result = _remove(i, k, h, lev, parent, startgen, out);
+                } else {
+                    auto sn = static_cast<_snode const*>(sub);
+                    if (!sn->matches(h, k))
+                        return NOTFOUND;
+                    auto ncn = _to_contracted(_removed_at(cn, pos, flag, i->_gen), lev);
+                    if (_gcas(i, m, ncn)) {
+                        out.emplace(sn->_value);
+                        result = FOUND;
+                    }
+                }
+                // a tombed inode is never left at the root
+                if ((result == FOUND) && parent && (_gcas_read(i)->_kind == TNODE))
+                    _clean_parent(parent, i, h, lev - W, startgen);
+                return result;
+            }
+            case TNODE: {
+                _clean(parent, lev - W);
+                return RESTART;
+            }
+            case LNODE: {
+                auto ln = static_cast<_lnode const*>(m);
+                auto it = std::find_if(ln->begin(), ln->end(), [&](_snode const* sn) {
+                    return sn->matches(h, k);
+                });
+                if (it == ln->end())
+                    return NOTFOUND;
+                _main const* nn = nullptr;
+                if (ln->_size > 2) {
+                    auto nln = _lnode::make(ln->_size - 1);
+                    auto d = nln->begin();
+                    for (_snode const* sn : *ln) {
+                        if (sn != *it) {
+                            sn->acquire();
+                            *d++ = sn;
+                        }
+                    }
+                    nn = nln;
+                } else {
+                    // a single survivor is entombed, to be compressed into
+                    // the parent on a later access
+                    _snode const* sn = ln->begin()[ln->begin()[0] == *it];
+                    sn->acquire();
+                    nn = new _tnode(sn);
+                }
+                if (!_gcas(i, m, nn))
+                    return RESTART;
+                out.emplace((*it)->_value);
+                return FOUND;
+            }
+            default:
+                assert(false);
+                return RESTART;
         }
-        _root->insert(hash(k), k, v);
     }
     
-};
-
-
-
-
-
+    // Public interface
+    
+    std::optional<V> lookup(K const& k) const {
+        epoch::guard guard;
+        u64 h = hash(k);
+        for (;;) {
+            std::optional<V> out;
+            _inode const* r = _read_root();
+            if (_lookup(r, k, h, 0, nullptr, r->_gen, out) != RESTART)
+                return out;
+        }
+    }
+    
+    bool contains(K const& k) const {
+        return lookup(k).has_value();
+    }
+    
+    // Insert or replace, returning the previous value if any
+    std::optional<V> insert(K const& k, V const& v) const {
+        assert(!_read_only);
+        epoch::guard guard;
+        u64 h = hash(k);
+        for (;;) {
+            std::optional<V> out;
+            _inode const* r = _read_root();
+            if (_insert(r, k, v, h, false, 0, nullptr, r->_gen, out) != RESTART)
+                return out;
+        }
+    }
+    
+    // Insert if absent, returning the value now present.  Racing threads
+    // agree on a single winner.
+    V try_emplace(K const& k, V const& v) const {
+        assert(!_read_only);
+        epoch::guard guard;
+        u64 h = hash(k);
+        for (;;) {
+            std::optional<V> out;
+            _inode const* r = _read_root();
+            switch (_insert(r, k, v, h, true, 0, nullptr, r->_gen, out)) {
+                case FOUND:
+                    return std::move(*out);
+                case NOTFOUND:
+                    return v;
+                case RESTART:
+                    break;
+            }
+        }
+    }
+    
+    // Remove, returning the removed value if any
+    std::optional<V> remove(K const& k) const {
+        assert(!_read_only);
+        epoch::guard guard;
+        u64 h = hash(k);
+        for (;;) {
+            std::optional<V> out;
+            _inode const* r = _read_root();
+            if (_remove(r, k, h, 0, nullptr, r->_gen, out) != RESTART)
+                return out;
+        }
+    }
+    
+    // O(1) snapshot.  Both tries lazily copy the paths they mutate.
+    ctrie snapshot() const {
+        assert(!_read_only);
+        epoch::guard guard;
+        for (;;) {
+            _inode const* r = _read_root();
+            _main const* expmain = _gcas_read(r);
+            if (_rdcss_root(r, expmain, _copy_to_gen(r, _next_gen())))
+                return ctrie(_copy_to_gen(r, _next_gen()), false);
+        }
+    }
+    
+    // O(1) snapshot that cannot be mutated, and so never copies
+    ctrie read_only_snapshot() const {
+        if (_read_only) {
+            _inode const* r = _read_root();
+            r->acquire();
+            return ctrie(r, true);
+        }
+        epoch::guard guard;
+        for (;;) {
+            _inode const* r = _read_root();
+            _main const* expmain = _gcas_read(r);
+            r->acquire();
+            if (_rdcss_root(r, expmain, _copy_to_gen(r, _next_gen())))
+                return ctrie(r, true);
+            _retire(r);
+        }
+    }
+    
+    template<typename F>
+    void _for_each(_inode const* i, F& f) const {
+        _main const* m = _gcas_read(i);
+        switch (m->_kind) {
+            case CNODE:
+                for (_node const* c : *static_cast<_cnode const*>(m)) {
+                    if (c->_kind == INODE) {
+                        _for_each(static_cast<_inode const*>(c), f);
+                    } else {
+                        auto sn = static_cast<_snode const*>(c);
+                        f(sn->_key, sn->_value);
+                    }
+                }
+                break;
+            case TNODE: {
+                auto sn = static_cast<_tnode const*>(m)->_sn;
+                f(sn->_key, sn->_value);
+                break;
+            }
+            case LNODE:
+                for (_snode const* sn : *static_cast<_lnode const*>(m))
+                    f(sn->_key, sn->_value);
+                break;
+            default:
+                // (a read-only snapshot has no failed or in-flight nodes)
+                assert(false);
+                break;
+        }
+    }
+    
+    // Visit a consistent snapshot of the (key, value) pairs in hash order
+    template<typename F>
+    void for_each(F&& f) const {
+        if (!_read_only)
+            return read_only_snapshot().for_each(std::forward<F>(f));
+        epoch::guard guard;
+        _for_each(_read_root(), f);
+    }
+    
+    isize size() const {
+        isize n = 0;
+        for_each([&](K const&, V const&) { ++n; });
+        return n;
+    }
+    
+}; // struct ctrie
 
 
 
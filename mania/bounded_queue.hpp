@@ -0,0 +1,243 @@
+//
+//  bounded_queue.hpp
+//  mania
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#ifndef bounded_queue_hpp
+#define bounded_queue_hpp
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <utility>
+
+#include "atomic.hpp"
+#include "common.hpp"
+#include "maybe.hpp"
+
+namespace manic {
+
+// Bounded multi-producer multi-consumer queue, after Vyukov's ring buffer
+//
+// Each cell carries a sequence number that says whose turn it is: a cell at
+// position p is free for the producer claiming p when its sequence is p, and
+// full for the consumer claiming p when it is p + 1.  Producers and
+// consumers claim positions by CAS on _tail and _head, which sit on their
+// own cache lines, and then touch only their cells, so in the steady state
+// there is no allocation and no contention between the two ends beyond the
+// cells themselves.
+//
+// The batch operations claim a run of consecutive ready cells with a single
+// CAS, amortizing the contended step over the batch.  They transfer as many
+// elements as are ready, and return the count.
+//
+// The blocking operations park on the sequence number of the cell they are
+// waiting for, with atomic_wait.  The low bit of the stored sequence flags
+// a parked waiter, and is seen by the exchange that next publishes the
+// cell, so a publisher pays for a notify only when someone waits on that
+// very cell.
+//
+// Methods are const and thread-safe, except construction and destruction.
+
+template<typename T>
+struct bounded_queue {
+
+    struct _cell {
+        Atomic<u64> _sequence; // <-- (sequence << 1) | waiting
+        mutable maybe<T> _value;
+    };
+
+    alignas(64) Atomic<u64> _tail; // <-- next position to push
+    alignas(64) Atomic<u64> _head; // <-- next position to pop
+    alignas(64) _cell const* _cells;
+    u64 _mask;
+
+    // capacity is rounded up to a power of two
+    explicit bounded_queue(isize capacity)
+    : _tail(0)
+    , _head(0)
+    , _mask(bit_ceil((u64) std::max<isize>(capacity, 2)) - 1) {
+        auto p = new _cell[_mask + 1];
+        for (u64 i = 0; i != _mask + 1; ++i)
+            p[i]._sequence = i << 1;
+        _cells = p;
+    }
+
+    bounded_queue(bounded_queue const&) = delete;
+
+    ~bounded_queue() {
+        u64 head = _head;
+        u64 tail = _tail;
+        for (; head != tail; ++head)
+            _cells[head & _mask]._value.erase();
+        delete[] _cells;
+    }
+
+    bounded_queue& operator=(bounded_queue const&) = delete;
+
+    isize capacity() const {
+        return _mask + 1;
+    }
+
+    // approximate, under concurrent modification
+    isize size() const {
+        i64 n = (i64) (_tail.load(std::memory_order_relaxed) - _head.load(std::memory_order_relaxed));
+        return std::clamp<i64>(n, 0, _mask + 1);
+    }
+
+    // Claims up to n consecutive positions from end, where the cell at
+    // position p is ready when its sequence is p + offset; returns the
+    // first position and sets n to the number claimed
+    u64 _claim(Atomic<u64> const& end, u64 offset, isize& n) const {
+        if (n <= 0) {
+            n = 0;
+            return 0;
+        }
+        u64 pos = end.load(std::memory_order_relaxed);
+        for (;;) {
+            isize k = 0;
+            while (k != n && (_cells[(pos + k) & _mask]._sequence.load(std::memory_order_acquire) >> 1) == pos + k + offset)
+                ++k;
+            if (!k) {
+                u64 s = _cells[pos & _mask]._sequence.load(std::memory_order_relaxed) >> 1;
+                if ((i64) (s - (pos + offset)) < 0) {
+                    // the cell is a lap behind; the queue is full (or empty)
+                    n = 0;
+                    return pos;
+                }
+                // another thread has claimed pos
+                pos = end.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (end.compare_exchange_weak(pos, pos + k, std::memory_order_relaxed, std::memory_order_relaxed)) {
+                n = k;
+                return pos;
+            }
+        }
+    }
+
+    static void _publish(_cell const& c, u64 sequence) {
+        if (c._sequence.exchange(sequence << 1, std::memory_order_release) & 1)
+            c._sequence.notify_all();
+    }
+
+    // Fill and release a claimed cell
+    template<typename... Args>
+    void _put(u64 pos, Args&&... args) const {
+        _cell const& c = _cells[pos & _mask];
+        c._value.emplace(std::forward<Args>(args)...);
+        _publish(c, pos + 1);
+    }
+
+    // Empty and release a claimed cell
+    T _take(u64 pos) const {
+        _cell const& c = _cells[pos & _mask];
+        T x{std::move(c._value.value)};
+        c._value.erase();
+        _publish(c, pos + _mask + 1);
+        return x;
+    }
+
+    // Waits until the cell at the current position of end may be ready
+    void _wait(Atomic<u64> const& end, u64 offset) const {
+        u64 pos = end.load(std::memory_order_relaxed);
+        _cell const& c = _cells[pos & _mask];
+        u64 s = c._sequence.load(std::memory_order_acquire);
+        if ((s >> 1) == pos + offset)
+            return;
+        // flag the cell, unless it changes first
+        if (!(s & 1) && !c._sequence.compare_exchange_strong(s, s | 1, std::memory_order_relaxed, std::memory_order_relaxed))
+            return;
+        if (end.load(std::memory_order_relaxed) == pos)
+            c._sequence.wait(s | 1, std::memory_order_acquire);
+    }
+
+    template<typename... Args>
+    bool try_emplace(Args&&... args) const {
+        isize n = 1;
+        u64 pos = _claim(_tail, 0, n);
+        if (!n)
+            return false;
+        _put(pos, std::forward<Args>(args)...);
+        return true;
+    }
+
+    // Leaves x alone if the queue is full
+    bool try_push(T&& x) const {
+        return try_emplace(std::move(x));
+    }
+
+    bool try_push(T const& x) const {
+        return try_emplace(x);
+    }
+
+    bool try_pop(T& x) const {
+        isize n = 1;
+        u64 pos = _claim(_head, 1, n);
+        if (!n)
+            return false;
+        x = _take(pos);
+        return true;
+    }
+
+    // Moves from the first of n elements; returns the number moved
+    isize try_push_n(T* first, isize n) const {
+        u64 pos = _claim(_tail, 0, n);
+        for (isize i = 0; i != n; ++i)
+            _put(pos + i, std::move(first[i]));
+        return n;
+    }
+
+    // Moves up to n elements into first; returns the number moved
+    isize try_pop_n(T* first, isize n) const {
+        u64 pos = _claim(_head, 1, n);
+        for (isize i = 0; i != n; ++i)
+            first[i] = _take(pos + i);
+        return n;
+    }
+
+    void push(T x) const {
+        while (!try_push(std::move(x)))
+            _wait(_tail, 0);
+    }
+
+    T pop() const {
+        for (;;) {
+            isize n = 1;
+            u64 pos = _claim(_head, 1, n);
+            if (n)
+                return _take(pos);
+            _wait(_head, 1);
+        }
+    }
+
+    // Pushes all n, blocking while the queue is full
+    void push_n(T* first, isize n) const {
+        for (;;) {
+            isize k = try_push_n(first, n);
+            first += k;
+            n -= k;
+            if (!n)
+                return;
+            _wait(_tail, 0);
+        }
+    }
+
+    // Pops between 1 and n, blocking while the queue is empty
+    isize pop_n(T* first, isize n) const {
+        assert(n > 0);
+        for (;;) {
+            if (isize k = try_pop_n(first, n))
+                return k;
+            _wait(_head, 1);
+        }
+    }
+
+}; // struct bounded_queue
+
+} // namespace manic
+
+#endif /* bounded_queue_hpp */
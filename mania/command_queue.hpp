@@ -0,0 +1,154 @@
+//
+//  command_queue.hpp
+//  mania
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#ifndef command_queue_hpp
+#define command_queue_hpp
+
+#include <algorithm>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "atomic.hpp"
+#include "common.hpp"
+#include "entity2.hpp"
+#include "matrix.hpp"
+#include "vec.hpp"
+
+namespace manic {
+
+// Commands from other threads to the simulation
+//
+// The UI and network threads do not touch the world; they send commands
+// through a command_queue, and world::tick drains it in one batch at the
+// start of each tick and applies the commands as if they had been made at
+// that time.
+//
+// Senders push onto an intrusive lock-free stack with a CAS; the consumer
+// takes the whole stack with an exchange.  Neither ever waits for the
+// other.  Each sender stamps its commands with its source and a sequence
+// number, and a batch is applied in (source, sequence) order, so the order
+// within a batch does not depend on how the senders' pushes interleaved.
+
+struct command {
+
+    enum : u64 {
+        WRITE, // <-- _xy takes _value
+        ADD, // <-- _xy takes _xy + _value, wrapping
+        SPAWN, // <-- _entity joins the world, if its cell is vacant
+        PASTE, // <-- the cells from _xy take _region
+    };
+
+    u64 _kind;
+    u64 _source;
+    u64 _sequence;
+    vec<i64, 2> _xy;
+    u64 _value;
+    entity2* _entity;
+    matrix<u64> _region;
+
+};
+
+struct command_queue;
+
+// A sender's handle, used by one thread at a time
+struct command_sender {
+
+    command_queue const* _queue;
+    u64 _source;
+    u64 _sequence;
+
+    void _send(command c);
+
+    void write(vec<i64, 2> xy, u64 value) {
+        _send(command{command::WRITE, 0, 0, xy, value, nullptr, {}});
+    }
+
+    void add(vec<i64, 2> xy, u64 value) {
+        _send(command{command::ADD, 0, 0, xy, value, nullptr, {}});
+    }
+
+    // The world takes ownership of the entity, and deletes it if its cell
+    // is occupied
+    void spawn(entity2* p) {
+        _send(command{command::SPAWN, 0, 0, {}, 0, p, {}});
+    }
+
+    // Cell (xy.x + i, xy.y + j) takes region(i, j)
+    void paste(vec<i64, 2> xy, matrix<u64> region) {
+        _send(command{command::PASTE, 0, 0, xy, 0, nullptr, std::move(region)});
+    }
+
+};
+
+struct command_queue {
+
+    struct _node {
+        _node* _next;
+        command _command;
+    };
+
+    Atomic<_node*> _head;
+
+    command_queue() : _head(nullptr) {}
+
+    command_queue(command_queue const&) = delete;
+
+    command_queue(command_queue&& other)
+    : _head(std::exchange(other._head, nullptr)) {
+    }
+
+    ~command_queue() {
+        for (_node* p = _head; p;) {
+            // undrained spawns still own their entities
+            if (p->_command._kind == command::SPAWN)
+                delete p->_command._entity;
+            delete std::exchange(p, p->_next);
+        }
+    }
+
+    command_queue& operator=(command_queue const&) = delete;
+    command_queue& operator=(command_queue&&) = delete;
+
+    // Each concurrent sender needs a distinct source
+    command_sender sender(u64 source) const {
+        return command_sender{this, source, 0};
+    }
+
+    void push(command c) const {
+        _node* p = new _node{_head.load(std::memory_order_relaxed), std::move(c)};
+        while (!_head.compare_exchange_weak(p->_next, p, std::memory_order_release, std::memory_order_relaxed))
+            ;
+    }
+
+    // Takes every command sent so far, in (source, sequence) order
+    std::vector<command> drain() const {
+        std::vector<command> v;
+        if (!_head.load(std::memory_order_relaxed))
+            return v;
+        for (_node* p = _head.exchange(nullptr, std::memory_order_acquire); p;) {
+            v.push_back(std::move(p->_command));
+            delete std::exchange(p, p->_next);
+        }
+        std::sort(v.begin(), v.end(), [](command const& a, command const& b) {
+            return std::tie(a._source, a._sequence) < std::tie(b._source, b._sequence);
+        });
+        return v;
+    }
+
+}; // struct command_queue
+
+inline void command_sender::_send(command c) {
+    c._source = _source;
+    c._sequence = _sequence++;
+    _queue->push(std::move(c));
+}
+
+} // namespace manic
+
+#endif /* command_queue_hpp */
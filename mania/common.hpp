@@ -9,6 +9,7 @@
 #ifndef common_hpp
 #define common_hpp
 
+#include <bit>
 #include <cstddef>
 #include <cstdint>
 #include <cmath>
@@ -69,6 +70,24 @@ F(isize)
 
 #undef F
 
+// The power-of-two functions of <bit> were renamed late in C++20 (ceil2 to
+// bit_ceil, ispow2 to has_single_bit, log2p1 to bit_width); we spell them
+// once, here, for standard libraries from either side of the rename
+
+#if defined(__cpp_lib_int_pow2) && (__cpp_lib_int_pow2 >= 202002L)
+
+using std::bit_ceil;
+using std::has_single_bit;
+using std::bit_width;
+
+#else
+
+template<typename T> constexpr T bit_ceil(T x) noexcept { return std::ceil2(x); }
+template<typename T> constexpr bool has_single_bit(T x) noexcept { return std::ispow2(x); }
+template<typename T> constexpr T bit_width(T x) noexcept { return std::log2p1(x); }
+
+#endif
+
 } // namespace manic
 
 #endif /* common_h */
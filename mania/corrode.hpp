@@ -9,13 +9,23 @@
 #ifndef corrode_hpp
 #define corrode_hpp
 
-#include <experimental/coroutine>
+#include <coroutine>
+#include <future>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
 
+#include "atomic.hpp"
+#include "file_io.hpp"
 #include "maybe.hpp"
 #include "reactor.hpp"
 #include "pool.hpp"
+#include "slab.hpp"
 
-namespace std::experimental {
+namespace std {
         
     template<typename... Args>
     struct coroutine_traits<void, Args...> {
@@ -24,7 +34,7 @@ namespace std::experimental {
             void get_return_object() {}
             suspend_never initial_suspend() { return {}; }
             void return_void() {}
-            suspend_never final_suspend() { return {}; }
+            suspend_never final_suspend() noexcept { return {}; }
             void unhandled_exception() { terminate(); }
         };
         
@@ -40,19 +50,25 @@ namespace std::experimental {
 inline constexpr struct  {
     bool await_ready() const { return false; }
     template<typename Promise>
-    void await_suspend(std::experimental::coroutine_handle<Promise> h) const {
+    void await_suspend(std::coroutine_handle<Promise> h) const {
         manic::pool_submit_one(std::move(h));
     }
     void await_resume() const {};
 } transfer;
 
+// await forever
+//
+// never resumes; the frame is leaked
+
+inline constexpr std::suspend_always forever;
+
 template<typename Rep, typename Period>
 struct await_duration {
     std::chrono::duration<Rep, Period> _t;
     explicit await_duration(std::chrono::duration<Rep, Period> t) : _t(t) {}
     bool await_ready() { return false; }
     template<typename T>
-    void await_suspend(std::experimental::coroutine_handle<T> h) {
+    void await_suspend(std::coroutine_handle<T> h) {
         manic::reactor::get().after(std::move(_t), h);
     }
     void await_resume() {}
@@ -69,7 +85,7 @@ struct await_time_point {
     explicit await_time_point(std::chrono::time_point<Clock, Duration> t) : _t(std::move(t)) {}
     bool await_ready() { return false; }
     template<typename T>
-    void await_suspend(std::experimental::coroutine_handle<T> h) {
+    void await_suspend(std::coroutine_handle<T> h) {
         manic::reactor::get().when(std::move(_t), h);
     }
     void await_resume() {}
@@ -107,7 +123,7 @@ struct async_read {
                 && ((void) _execute(), true));
     }
     
-    void await_suspend(std::experimental::coroutine_handle<> handle) {
+    void await_suspend(std::coroutine_handle<> handle) {
         manic::reactor::get().when_readable(_fd, [=]() mutable {
             _execute();
             handle();
@@ -150,7 +166,7 @@ struct async_write {
                 && ((void) _execute(), true));
     }
     
-    void await_suspend(std::experimental::coroutine_handle<> handle) {
+    void await_suspend(std::coroutine_handle<> handle) {
         manic::reactor::get().when_writeable(_fd, [=]() mutable {
             _execute();
             handle();
@@ -164,173 +180,510 @@ struct async_write {
 };
 
 
-template<typename T = void>
-struct future {
+// await positional file I/O
+//
+// ssize_t r = co_await read_at(fd, offset, buffer);
+//
+// the coroutine resumes on the pool when the transfer completes, with what
+// pread or pwrite would have returned, or -errno; the calling thread is
+// never blocked (see file_io.hpp)
+
+struct read_at : manic::file_io {
     
-    struct promise_type {
-        
-        std::experimental::coroutine_handle<> _continuation;
-        manic::maybe<T> _value;
+    read_at(int fd, manic::u64 offset, void* buf, size_t count)
+    : manic::file_io{READ, fd, offset, buf, count, -1, {}} {
+    }
+    
+    template<typename Buffer>
+    read_at(int fd, manic::u64 offset, Buffer& buffer)
+    : read_at(fd, offset, std::data(buffer), std::size(buffer) * sizeof(*std::data(buffer))) {
+    }
+    
+    bool await_ready() { return false; }
+    
+    void await_suspend(std::coroutine_handle<> handle) {
+        _continuation = handle;
+        manic::file_io_submit(this);
+    }
+    
+    ssize_t await_resume() {
+        return _result;
+    }
+    
+};
+
+struct write_at : manic::file_io {
+    
+    write_at(int fd, manic::u64 offset, void const* buf, size_t count)
+    : manic::file_io{WRITE, fd, offset, const_cast<void*>(buf), count, -1, {}} {
+    }
+    
+    template<typename Buffer>
+    write_at(int fd, manic::u64 offset, Buffer const& buffer)
+    : write_at(fd, offset, std::data(buffer), std::size(buffer) * sizeof(*std::data(buffer))) {
+    }
+    
+    bool await_ready() { return false; }
+    
+    void await_suspend(std::coroutine_handle<> handle) {
+        _continuation = handle;
+        manic::file_io_submit(this);
+    }
+    
+    ssize_t await_resume() {
+        return _result;
+    }
+    
+};
+
+
+namespace manic {
+
+// Cooperative cancellation
+//
+// A cancellation is a shared flag, optionally chained to a parent whose
+// cancellation it also reports.  A task inherits the cancellation of the
+// coroutine that awaits it, and when_any gives its children a fresh one,
+// chained to its own, which it cancels when the first child completes.
+// Coroutines poll with co_await cancelled at convenient points and return
+// early; nothing is interrupted.  A default-constructed cancellation is
+// never cancelled.
+
+struct cancellation {
+    
+    struct _node {
+        Atomic<bool> _cancelled;
+        std::shared_ptr<_node const> _parent;
+    };
+    
+    std::shared_ptr<_node const> _ptr;
+    
+    static cancellation make(cancellation const& parent = {}) {
+        return cancellation{std::shared_ptr<_node const>(new _node{false, parent._ptr})};
+    }
+    
+    void cancel() const {
+        assert(_ptr);
+        _ptr->_cancelled.store(true, std::memory_order_release);
+    }
+    
+    bool is_cancelled() const {
+        for (auto p = _ptr.get(); p; p = p->_parent.get())
+            if (p->_cancelled.load(std::memory_order_acquire))
+                return true;
+        return false;
+    }
+    
+    explicit operator bool() const {
+        return (bool) _ptr;
+    }
+    
+};
+
+
+// State shared by the children of a when_all or when_any, which lives in the
+// frame of the parent
+
+struct _fork_state {
+    Atomic<isize> _count; // <-- children yet to complete
+    Atomic<isize> _winner; // <-- first child to complete
+    cancellation _cancellation; // <-- for when_any, cancelled by the winner
+    std::coroutine_handle<> _continuation;
+};
+
+
+struct _task_promise_base {
+    
+    std::coroutine_handle<> _self;
+    std::coroutine_handle<> _continuation;
+    cancellation _cancellation;
+    _fork_state const* _fork = nullptr;
+    isize _index = 0;
+    
+    // frames come from the slab allocator, like fn nodes
+    static void* operator new(std::size_t count) {
+        return slab::allocate(count);
+    }
+    
+    static void operator delete(void* ptr, std::size_t count) {
+        slab::deallocate(ptr, count);
+    }
+    
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    
+    struct final_awaitable {
         
-        auto get_return_object() {
-            return future<T>{
-                std::experimental::coroutine_handle<promise_type>::from_promise(*this)
-            };
-        }
-        auto initial_suspend() { return std::experimental::suspend_always{}; } // <-- do we really want to be lazy?
-        void return_value(T x) { _value.emplace(std::move(x)); }
+        bool await_ready() noexcept { return false; }
         
-        struct final_awaitable {
-            
-            bool await_ready() { return false; }
-            auto await_suspend(std::experimental::coroutine_handle<promise_type> handle) {
-                return handle.promise()._continuation;
+        // symmetric transfer to the continuation, or for a forked child, to
+        // the parent if this is the last child to complete
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            _task_promise_base& p = handle.promise();
+            if (_fork_state const* f = p._fork) {
+                if (f->_cancellation) {
+                    isize expected = -1;
+                    if (f->_winner.compare_exchange_strong(expected, p._index, std::memory_order_relaxed, std::memory_order_relaxed))
+                        f->_cancellation.cancel();
+                }
+                // (the parent may destroy us as soon as we count down)
+                if (f->_count.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                    return std::noop_coroutine();
+                return f->_continuation;
             }
-            void await_resume() {};
-        };
+            return p._continuation ? p._continuation : std::noop_coroutine();
+        }
         
-        auto final_suspend() { return final_awaitable{}; }
-        void unhandled_exception() { std::terminate(); }
+        void await_resume() noexcept {}
         
     };
     
-    std::experimental::coroutine_handle<promise_type> _continuation;
+    final_awaitable final_suspend() noexcept { return {}; }
     
-    bool await_ready() {
-        return _continuation.done();
+    void unhandled_exception() { std::terminate(); }
+    
+};
+
+template<typename T>
+struct _task_promise : _task_promise_base {
+    
+    maybe<T> _value;
+    bool _ready = false;
+    
+    _task_promise() = default;
+    _task_promise(_task_promise const&) = delete;
+    
+    ~_task_promise() {
+        if (_ready)
+            _value.erase();
     }
     
-    auto await_suspend(std::experimental::coroutine_handle<> continuation) {
-        _continuation.promise()._continuation = continuation;
-        return _continuation;
+    template<typename U>
+    void return_value(U&& x) {
+        _value.emplace(std::forward<U>(x));
+        _ready = true;
     }
     
-    T await_resume() {
-        return std::move(_continuation.promise()._value.value);
+    T _take() {
+        assert(_ready);
+        T x{std::move(_value.value)};
+        _value.erase();
+        _ready = false;
+        return x;
     }
     
 };
 
-
-// fixme: refactor out common parts
 template<>
-struct future<void> {
+struct _task_promise<void> : _task_promise_base {
     
-    struct promise_type {
-        
-        std::experimental::coroutine_handle<> _continuation;
+    void return_void() {}
+    
+    void _take() {}
+    
+};
+
+
+// Lazy coroutine returning a T
+//
+// A task starts when it is awaited, and the awaiting coroutine resumes by
+// symmetric transfer when it completes, without passing through the pool or
+// growing the stack.  Awaiting a task starts it on the awaiting thread; use
+// co_await transfer, or when_all, to go parallel.  The task owns the
+// coroutine frame.
+
+template<typename T = void>
+struct task {
+    
+    struct promise_type : _task_promise<T> {
         
-        auto get_return_object() {
-            return future<void>{
-                std::experimental::coroutine_handle<promise_type>::from_promise(*this)
-            };
+        task get_return_object() {
+            auto h = std::coroutine_handle<promise_type>::from_promise(*this);
+            this->_self = h;
+            return task{h};
         }
-        auto initial_suspend() { return std::experimental::suspend_always{}; }
-        void return_void() {};
-        
-        struct final_awaitable {
-            
-            bool await_ready() { return false; }
-            auto await_suspend(std::experimental::coroutine_handle<promise_type> handle) {
-                return handle.promise()._continuation;
-            }
-            void await_resume() {};
-        };
-        
-        auto final_suspend() { return final_awaitable{}; }
-        void unhandled_exception() { std::terminate(); }
         
     };
     
-    std::experimental::coroutine_handle<promise_type> _continuation;
+    std::coroutine_handle<promise_type> _handle;
+    
+    task() : _handle(nullptr) {}
+    
+    explicit task(std::coroutine_handle<promise_type> h) : _handle(h) {}
+    
+    task(task const&) = delete;
+    
+    task(task&& other) : _handle(std::exchange(other._handle, nullptr)) {}
+    
+    ~task() {
+        if (_handle)
+            _handle.destroy();
+    }
+    
+    void swap(task& other) {
+        using std::swap;
+        swap(_handle, other._handle);
+    }
+    
+    task& operator=(task const&) = delete;
+    
+    task& operator=(task&& other) {
+        task(std::move(other)).swap(*this);
+        return *this;
+    }
     
     bool await_ready() {
-        return _continuation.done();
+        return _handle.done();
     }
     
-    auto await_suspend(std::experimental::coroutine_handle<> continuation) {
-        _continuation.promise()._continuation = continuation;
-        return _continuation;
+    template<typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> continuation) {
+        promise_type& p = _handle.promise();
+        p._continuation = continuation;
+        if constexpr (std::is_base_of_v<_task_promise_base, Promise>)
+            if (!p._cancellation)
+                p._cancellation = continuation.promise()._cancellation;
+        return _handle;
+    }
+    
+    T await_resume() {
+        return _handle.promise()._take();
     }
     
-    void await_resume() {}
-        
 };
 
+// Runs a task with a cancellation other than that of its awaiter
+template<typename T>
+task<T> with_cancellation(task<T> t, cancellation c) {
+    t._handle.promise()._cancellation = std::move(c);
+    return t;
+}
 
 
+struct _cancelled_awaitable {
+    
+    bool _result = false;
+    
+    bool await_ready() { return false; }
+    
+    template<typename Promise>
+    bool await_suspend(std::coroutine_handle<Promise> handle) {
+        _result = handle.promise()._cancellation.is_cancelled();
+        return false; // <-- resume at once
+    }
+    
+    bool await_resume() { return _result; }
+    
+};
+
+// await the cancellation of the current task
+//
+// if (co_await cancelled)
+//     co_return {};
+
+inline constexpr struct {
+    _cancelled_awaitable operator co_await() const { return {}; }
+} cancelled;
+
+
+// Starts the children on the pool, except the first, to which it transfers,
+// and resumes the awaiting task when all have completed; returns the index
+// of the first to complete if _any
+
+struct _fork_awaitable {
+    
+    _task_promise_base* const* _children;
+    isize _size;
+    bool _any;
+    _fork_state _state;
+    
+    bool await_ready() { return !_size; }
+    
+    template<typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> continuation) {
+        cancellation const& c = continuation.promise()._cancellation;
+        _state._count = _size;
+        _state._winner = -1;
+        if (_any)
+            _state._cancellation = cancellation::make(c);
+        _state._continuation = continuation;
+        for (isize i = 0; i != _size; ++i) {
+            _task_promise_base* p = _children[i];
+            p->_fork = &_state;
+            p->_index = i;
+            p->_cancellation = _any ? _state._cancellation : c;
+        }
+        for (isize i = 1; i != _size; ++i)
+            pool_submit_one(_children[i]->_self);
+        return _children[0]->_self;
+    }
+    
+    isize await_resume() {
+        return std::as_const(_state._winner).load(std::memory_order_relaxed);
+    }
+    
+};
+
 template<typename T>
-struct Generator {
-        
+using _value_t = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+template<typename T>
+_value_t<T> _take_value(task<T>& t) {
+    if constexpr (std::is_void_v<T>) {
+        return {};
+    } else {
+        return t._handle.promise()._take();
+    }
+}
+
+// Runs the tasks in parallel on the pool, and completes with all their
+// results (std::monostate for void) when all have completed
+
+template<typename... T>
+task<std::tuple<_value_t<T>...>> when_all(task<T>... children) {
+    _task_promise_base* p[] = { &children._handle.promise()... };
+    co_await _fork_awaitable{p, sizeof...(T), false, {}};
+    co_return std::tuple<_value_t<T>...>{_take_value(children)...};
+}
+
+template<typename T>
+task<std::vector<_value_t<T>>> when_all(std::vector<task<T>> children) {
+    std::vector<_task_promise_base*> p;
+    p.reserve(children.size());
+    for (auto& t : children)
+        p.push_back(&t._handle.promise());
+    co_await _fork_awaitable{p.data(), (isize) p.size(), false, {}};
+    std::vector<_value_t<T>> v;
+    v.reserve(children.size());
+    for (auto& t : children)
+        v.push_back(_take_value(t));
+    co_return v;
+}
+
+// Runs the tasks in parallel on the pool, cancels the others when the first
+// completes, and completes with its index and result when all have
+// completed, so that no child outlives the call
+
+template<typename T>
+task<std::pair<isize, _value_t<T>>> when_any(std::vector<task<T>> children) {
+    assert(!children.empty());
+    std::vector<_task_promise_base*> p;
+    p.reserve(children.size());
+    for (auto& t : children)
+        p.push_back(&t._handle.promise());
+    isize i = co_await _fork_awaitable{p.data(), (isize) p.size(), true, {}};
+    co_return std::pair<isize, _value_t<T>>(i, _take_value(children[i]));
+}
+
+
+template<typename T>
+void _sync_wait(task<T>& t, std::promise<T>& p) {
+    if constexpr (std::is_void_v<T>) {
+        co_await t;
+        p.set_value();
+    } else {
+        p.set_value(co_await t);
+    }
+}
+
+// Runs a task on the calling thread (and wherever it transfers to), blocking
+// until it completes
+
+template<typename T>
+T sync_wait(task<T> t) {
+    std::promise<T> p;
+    _sync_wait(t, p);
+    return p.get_future().get();
+}
+
+
+// Lazy sequence of T
+//
+// for (auto& x : generator())
+//     ...
+
+template<typename T>
+struct generator {
+    
     struct promise_type {
         
-        auto get_return_object() {
-            return Generator {
-                std::experimental::coroutine_handle<promise_type>::from_promise(*this)
-            };
-        }
+        T const* _value;
         
-        auto initial_suspend() {
-            return std::experimental::suspend_always{};
+        static void* operator new(std::size_t count) {
+            return slab::allocate(count);
         }
         
-        auto final_suspend() {
-            return std::experimental::suspend_always{};
+        static void operator delete(void* ptr, std::size_t count) {
+            slab::deallocate(ptr, count);
         }
         
-        template<typename U>
-        auto yield_value(U&& u) {
-            _value = &u;
-            return std::experimental::suspend_always{};
+        generator get_return_object() {
+            return generator{std::coroutine_handle<promise_type>::from_promise(*this)};
         }
         
-        void unhandled_exception() {
-            abort();
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        
+        std::suspend_always final_suspend() noexcept { return {}; }
+        
+        // (a converted temporary lives until we resume)
+        std::suspend_always yield_value(T const& x) {
+            _value = &x;
+            return {};
         }
         
         void return_void() {}
         
-        T* _value;
+        void unhandled_exception() { std::terminate(); }
         
     };
     
-    std::experimental::coroutine_handle<promise_type> _coroutine;
+    std::coroutine_handle<promise_type> _handle;
+    
+    explicit generator(std::coroutine_handle<promise_type> h) : _handle(h) {}
+    
+    generator(generator const&) = delete;
+    
+    generator(generator&& other) : _handle(std::exchange(other._handle, nullptr)) {}
+    
+    ~generator() {
+        if (_handle)
+            _handle.destroy();
+    }
+    
+    generator& operator=(generator const&) = delete;
     
     struct sentinel {};
     
     struct iterator {
-
-        std::experimental::coroutine_handle<promise_type> _coroutine;
+        
+        std::coroutine_handle<promise_type> _handle;
         
         iterator& operator++() {
-            _coroutine.resume();
+            _handle.resume();
             return *this;
         }
         
-        bool operator!=(sentinel) {
-            return !_coroutine.done();
+        bool operator!=(sentinel) const {
+            return !_handle.done();
         }
         
-        T& operator*() {
-            return *_coroutine.promise()._value;
+        T const& operator*() const {
+            return *_handle.promise()._value;
         }
-
+        
     };
     
     iterator begin() {
-        _coroutine.resume();
-        return iterator { _coroutine };
+        _handle.resume();
+        return iterator{_handle};
     }
     
     sentinel end() {
-        return sentinel {};
-    }
-    
-    ~Generator() {
-        _coroutine.destroy();
+        return sentinel{};
     }
     
-    
 };
 
+} // namespace manic
+
 #endif /* corrode_hpp */
@@ -359,9 +359,9 @@ void entity2::tick_truck(world& _world) {
                 vacate(k);
                 _world.write({this->x, this->y}, k);
                 // remove ourselves from the draw list
-                for (auto& pe : _world._entities) {
-                    if (pe == this) {
-                        _world._entities.swap_remove(&pe - _world._entities.begin());
+                for (isize i = 0; i != _world._entities.size(); ++i) {
+                    if (_world._entities[i] == this) {
+                        _world._entities.swap_remove(i);
                         delete this;
                         return;
                     }
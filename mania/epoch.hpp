@@ -9,6 +9,295 @@
 #ifndef epoch_hpp
 #define epoch_hpp
 
-#include <stdio.h>
+#include <atomic>
+#include <cassert>
+#include <utility>
+
+#include "common.hpp"
+
+namespace manic {
+
+// Epoch-based memory reclamation, after Fraser (2004) and crossbeam-epoch
+//
+// A thread pins itself while it is reading a lock-free structure.  Objects
+// unlinked from the structure are passed to defer, and destroyed only once
+// every thread that was pinned at the time of unlinking has unpinned.
+//
+// Usage:
+//
+//     epoch::guard g;              // pin (reentrant)
+//     node const* p = head.load(std::memory_order_acquire);
+//     ...                          // p may be dereferenced until g dies
+//     if (head.compare_exchange_strong(p, p->next, ...))
+//         epoch::defer_delete(p);  // p is freed some time after every
+//                                  // thread now pinned has unpinned
+//
+// Compared to split reference counts (counted.hpp, Atomic<queue<T>>),
+// readers write only to their own cache line: pinning is a store and a
+// fence, and unpinning a store.  The price is that garbage is freed late
+// and in batches, and a thread that stays pinned stalls reclamation for
+// everyone.  Don't block or wait for other threads while pinned.
+//
+// Deferred destructions go into a per-thread bag of fixed capacity.  A full
+// bag is sealed with the global epoch and pushed onto one of four global
+// lock-free lists, by epoch modulo 4.  Every COLLECT_PERIOD pins, and
+// whenever a bag is sealed, the thread tries to advance the global epoch
+// and destroys the bags of the list that has expired, so a collection
+// touches only garbage it can free.  An exiting thread seals its bag with
+// the current epoch like any other, so its garbage is not lost.
+
+namespace epoch {
+
+enum : u64 {
+    BAG_CAPACITY = 62,   // <-- so a _bag fits in 1 KB
+    COLLECT_PERIOD = 128,
+};
+
+struct _deferred {
+    void (*_fn)(void const*);
+    void const* _ptr;
+};
+
+struct _bag {
+
+    _bag* _next;
+    u64 _epoch;
+    u64 _size;
+    _deferred _items[BAG_CAPACITY];
+
+    _bag() : _next{nullptr}, _epoch{0}, _size{0} {}
+
+    bool full() const { return _size == BAG_CAPACITY; }
+
+    void run() const {
+        for (u64 i = 0; i != _size; ++i)
+            _items[i]._fn(_items[i]._ptr);
+    }
+
+};
+
+struct _participant {
+
+    // (epoch << 1) | pinned
+    std::atomic<u64> _state;
+    std::atomic<bool> _active;
+    _participant* _next; // <-- immutable once published
+
+    // owned by the thread that claimed the participant
+    u64 _depth;
+    u64 _pins;
+    _bag* _current;
+
+    _participant()
+    : _state{0}
+    , _active{true}
+    , _next{nullptr}
+    , _depth{0}
+    , _pins{0}
+    , _current{new _bag} {
+    }
+
+};
+
+struct _global {
+
+    std::atomic<u64> _epoch;
+    std::atomic<_participant*> _head;
+    // Sealed bags, by stamp modulo 4
+    std::atomic<_bag*> _sealed[4];
+
+    _global() : _epoch{0}, _head{nullptr}, _sealed{} {}
+
+    static _global& get() {
+        // deliberately leaked at shutdown, as are the participants
+        static _global* global = new _global;
+        return *global;
+    }
+
+    void push(_bag* b) {
+        std::atomic<_bag*>& head = _sealed[b->_epoch & 3];
+        b->_next = head.load(std::memory_order_relaxed);
+        while (!head.compare_exchange_weak(b->_next,
+                                           b,
+                                           std::memory_order_release,
+                                           std::memory_order_relaxed))
+            ;
+    }
+
+};
+
+inline _participant* _claim() {
+    _global& g = _global::get();
+    // reuse a participant abandoned by an exited thread
+    for (_participant* p = g._head.load(std::memory_order_acquire); p; p = p->_next) {
+        bool expected = false;
+        if (!p->_active.load(std::memory_order_relaxed)
+            && p->_active.compare_exchange_strong(expected,
+                                                  true,
+                                                  std::memory_order_acquire,
+                                                  std::memory_order_relaxed))
+            return p;
+    }
+    auto p = new _participant;
+    p->_next = g._head.load(std::memory_order_relaxed);
+    while (!g._head.compare_exchange_weak(p->_next,
+                                          p,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed))
+        ;
+    return p;
+}
+
+// Seal the local bag, if it is not empty, and hand it to the global list
+//
+// The items were deferred while pinned at epochs no later than the global
+// epoch read here, so it is a safe stamp for all of them
+inline void _seal(_participant& p) {
+    if (p._current->_size) {
+        _global& g = _global::get();
+        p._current->_epoch = g._epoch.load(std::memory_order_relaxed);
+        g.push(p._current);
+        p._current = new _bag;
+    }
+}
+
+inline _participant& _local() {
+    thread_local struct _handle {
+        _participant* _ptr;
+        _handle() : _ptr(_claim()) {}
+        ~_handle() {
+            assert(!_ptr->_depth);
+            // hand our garbage to whichever thread collects next
+            _seal(*_ptr);
+            _ptr->_active.store(false, std::memory_order_release);
+        }
+    } handle;
+    return *handle._ptr;
+}
+
+// Advance the global epoch if every pinned thread has observed it
+inline u64 _try_advance() {
+    _global& g = _global::get();
+    u64 e = g._epoch.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (_participant* p = g._head.load(std::memory_order_acquire); p; p = p->_next) {
+        // acquire, so that the critical sections each thread has left
+        // happen before anything we reclaim as a result
+        u64 s = p->_state.load(std::memory_order_acquire);
+        if ((s & 1) && ((s >> 1) != e))
+            return e;
+    }
+    if (g._epoch.compare_exchange_strong(e,
+                                         e + 1,
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed))
+        ++e;
+    return e;
+}
+
+// Garbage is stamped with (at least) the epoch its retiring thread was
+// pinned at.  While that thread is pinned at e, other pinned threads may be
+// at e - 1, e or e + 1, so the garbage is safe to destroy once the global
+// epoch reaches e + 3
+inline bool _is_expired(u64 stamp, u64 e) {
+    return stamp + 3 <= e;
+}
+
+// precondition: pinned
+inline void collect() {
+    assert(_local()._depth);
+    _global& g = _global::get();
+    u64 e = _try_advance();
+    // The list for stamp e - 3 holds the expired bags, and only rarely
+    // a bag stamped e + 1 by a thread that has seen a later epoch than we
+    // have, which we put back.  Take it whole, so that concurrent
+    // collectors don't contend on individual bags.
+    std::atomic<_bag*>& head = g._sealed[(e + 1) & 3];
+    if (!head.load(std::memory_order_relaxed))
+        return;
+    _bag* b = head.exchange(nullptr, std::memory_order_acquire);
+    while (b) {
+        _bag* next = b->_next;
+        if (_is_expired(b->_epoch, e)) {
+            // (the deferred functions may themselves defer, into the local
+            // bag)
+            b->run();
+            delete b;
+        } else {
+            g.push(b);
+        }
+        b = next;
+    }
+}
+
+inline void pin() {
+    _participant& p = _local();
+    if (!p._depth++) {
+        u64 e = _global::get()._epoch.load(std::memory_order_relaxed);
+        p._state.store((e << 1) | 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // threads that only read must still help the epoch along
+        if (!(++p._pins % COLLECT_PERIOD))
+            collect();
+    }
+}
+
+inline void unpin() {
+    _participant& p = _local();
+    assert(p._depth);
+    if (!--p._depth)
+        p._state.store(p._state.load(std::memory_order_relaxed) & ~(u64) 1,
+                       std::memory_order_release);
+}
+
+inline bool is_pinned() {
+    return _local()._depth;
+}
+
+// RAII pin
+class guard {
+
+    bool _pinned;
+
+public:
+
+    guard() : _pinned(true) { pin(); }
+    guard(guard const&) = delete;
+    guard(guard&& other) : _pinned(std::exchange(other._pinned, false)) {}
+    ~guard() { if (_pinned) unpin(); }
+    guard& operator=(guard const&) = delete;
+    guard& operator=(guard&&) = delete;
+
+};
+
+// Schedule fn(ptr) to be called once no thread can still hold ptr
+//
+// precondition: pinned, and ptr has been unlinked from any shared structure
+inline void defer(void (*fn)(void const*), void const* ptr) {
+    _participant& p = _local();
+    assert(p._depth);
+    p._current->_items[p._current->_size++] = _deferred{fn, ptr};
+    if (p._current->full()) {
+        _seal(p);
+        collect();
+    }
+}
+
+template<typename T>
+void defer_delete(T const* ptr) {
+    defer([](void const* p) { delete static_cast<T const*>(p); }, ptr);
+}
+
+// Hand the local bag to the global list, however full, and collect; for
+// threads about to go idle, so that their garbage does not wait on them
+inline void flush() {
+    guard g;
+    _seal(_local());
+    collect();
+}
+
+} // namespace epoch
+
+} // namespace manic
 
 #endif /* epoch_hpp */
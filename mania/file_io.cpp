@@ -0,0 +1,223 @@
+//
+//  file_io.cpp
+//  mania
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+#include "atomic.hpp"
+#include "file_io.hpp"
+#include "pool.hpp"
+
+#if defined(__linux__) && !defined(__NO_IO_URING) && __has_include(<linux/io_uring.h>)
+#define __IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace manic {
+
+namespace {
+
+void _execute(file_io* p) {
+    ssize_t r = (p->_opcode == file_io::READ)
+        ? pread(p->_fd, p->_buf, p->_count, (off_t) p->_offset)
+        : pwrite(p->_fd, p->_buf, p->_count, (off_t) p->_offset);
+    p->_result = (r < 0) ? -errno : r;
+}
+
+// (blocking, so kept off most of the workers)
+void _fallback(file_io* p) {
+    pool_submit_one([p] {
+        _execute(p);
+        p->_continuation();
+    }, qos::background);
+}
+
+// Submissions still to fail, for testing
+const Atomic<i64> _failures(0);
+
+#if defined(__IO_URING)
+
+// io_uring driven directly by system calls
+//
+// Submitters fill a submission queue entry under a lock and enter the ring
+// themselves, so the kernel starts the operation on the submitting thread
+// and there is no handoff.  A single thread waits on the completion queue
+// and moves the continuations of each batch of completions to the pool.
+// The rings are shared with the kernel, and their heads and tails are
+// accessed atomically.
+//
+// Deliberately leaked, with its detached thread, like the pool
+
+struct _uring {
+
+    enum : u32 {
+        ENTRIES = 256,
+    };
+
+    int _fd;
+
+    Atomic<u32> const* _sq_head;
+    Atomic<u32> const* _sq_tail;
+    u32 _sq_mask;
+    u32* _sq_array;
+    io_uring_sqe* _sqes;
+
+    Atomic<u32> const* _cq_head;
+    Atomic<u32> const* _cq_tail;
+    u32 _cq_mask;
+    io_uring_cqe const* _cqes;
+
+    mutable std::mutex _mutex; // <-- serializes submitters
+
+    // Returns nullptr if io_uring is unavailable
+    static _uring* _make() {
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        int fd = (int) syscall(__NR_io_uring_setup, ENTRIES, &p);
+        if (fd < 0)
+            return nullptr;
+        // IORING_OP_READ and IORING_OP_WRITE arrived with RW_CUR_POS (5.6)
+        if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_RW_CUR_POS)) {
+            close(fd);
+            return nullptr;
+        }
+        usize n = std::max<usize>(p.sq_off.array + p.sq_entries * sizeof(u32),
+                                  p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe));
+        void* r = mmap(nullptr, n, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        void* s = mmap(nullptr, p.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (r == MAP_FAILED || s == MAP_FAILED)
+            (void) perror(strerror(errno)), abort();
+        auto b = static_cast<unsigned char*>(r);
+        auto u = new _uring;
+        u->_fd = fd;
+        u->_sq_head = reinterpret_cast<Atomic<u32> const*>(b + p.sq_off.head);
+        u->_sq_tail = reinterpret_cast<Atomic<u32> const*>(b + p.sq_off.tail);
+        u->_sq_mask = *reinterpret_cast<u32 const*>(b + p.sq_off.ring_mask);
+        u->_sq_array = reinterpret_cast<u32*>(b + p.sq_off.array);
+        u->_sqes = static_cast<io_uring_sqe*>(s);
+        u->_cq_head = reinterpret_cast<Atomic<u32> const*>(b + p.cq_off.head);
+        u->_cq_tail = reinterpret_cast<Atomic<u32> const*>(b + p.cq_off.tail);
+        u->_cq_mask = *reinterpret_cast<u32 const*>(b + p.cq_off.ring_mask);
+        u->_cqes = reinterpret_cast<io_uring_cqe const*>(b + p.cq_off.cqes);
+        std::thread(&_uring::_run, u).detach();
+        return u;
+    }
+
+    static _uring const* get() {
+        static _uring* p = _make();
+        return p;
+    }
+
+    // Returns false if the submission queue is full
+    bool submit(file_io* p) const {
+        std::unique_lock lock(_mutex);
+        u32 tail = _sq_tail->load(std::memory_order_relaxed);
+        if (tail - _sq_head->load(std::memory_order_acquire) > _sq_mask)
+            return false;
+        u32 i = tail & _sq_mask;
+        io_uring_sqe* e = _sqes + i;
+        std::memset(e, 0, sizeof(io_uring_sqe));
+        e->opcode = (p->_opcode == file_io::READ) ? IORING_OP_READ : IORING_OP_WRITE;
+        e->fd = p->_fd;
+        e->off = p->_offset;
+        e->addr = reinterpret_cast<u64>(p->_buf);
+        e->len = (u32) std::min<usize>(p->_count, std::numeric_limits<u32>::max());
+        e->user_data = reinterpret_cast<u64>(p);
+        _sq_array[i] = i;
+        _sq_tail->store(tail + 1, std::memory_order_release);
+        // submit everything the kernel has not yet consumed, until it has
+        // consumed our entry
+        for (i64 backoff = 1;;) {
+            u32 head = _sq_head->load(std::memory_order_acquire);
+            if ((i32) (head - (tail + 1)) >= 0)
+                break;
+            u32 n = _sq_tail->load(std::memory_order_relaxed) - head;
+            if (_enter(n) >= 0)
+                continue;
+            if (errno == EAGAIN || errno == EBUSY) {
+                // out of resources until completions are reaped; the entry
+                // cannot be withdrawn, and the completion thread may be
+                // waiting with nothing in flight, so we retry ourselves
+                lock.unlock();
+                std::this_thread::sleep_for(std::chrono::microseconds(backoff));
+                backoff = std::min<i64>(2 * backoff, 1000);
+                lock.lock();
+                continue;
+            }
+            if (errno != EINTR)
+                (void) perror(strerror(errno)), abort();
+        }
+        return true;
+    }
+
+    // Submits n entries
+    long _enter(u32 n) const {
+        for (i64 k = _failures.load(std::memory_order_relaxed); k > 0;)
+            if (_failures.compare_exchange_weak(k, k - 1, std::memory_order_relaxed, std::memory_order_relaxed))
+                return errno = EAGAIN, -1;
+        return syscall(__NR_io_uring_enter, _fd, n, 0, 0, nullptr, 0);
+    }
+
+    void _run() const {
+        for (;;) {
+            u32 head = _cq_head->load(std::memory_order_relaxed);
+            u32 tail = _cq_tail->load(std::memory_order_acquire);
+            if (head == tail) {
+                // also flushes any submissions not yet consumed
+                std::unique_lock lock(_mutex);
+                u32 n = _sq_tail->load(std::memory_order_relaxed) - _sq_head->load(std::memory_order_acquire);
+                lock.unlock();
+                if (syscall(__NR_io_uring_enter, _fd, n, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0
+                    && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                    (void) perror(strerror(errno)), abort();
+                continue;
+            }
+            stack<fn<void()>> pending;
+            for (; head != tail; ++head) {
+                io_uring_cqe const& c = _cqes[head & _cq_mask];
+                auto p = reinterpret_cast<file_io*>(c.user_data);
+                p->_result = c.res;
+                pending.push(std::move(p->_continuation));
+            }
+            _cq_head->store(head, std::memory_order_release);
+            pool_submit_many(std::move(pending));
+        }
+    }
+
+}; // struct _uring
+
+#endif
+
+} // namespace
+
+void file_io_submit(file_io* p) {
+    assert(p && p->_continuation);
+#if defined(__IO_URING)
+    if (auto u = _uring::get())
+        if (u->submit(p))
+            return;
+#endif
+    _fallback(p);
+}
+
+void _file_io_fail_submissions(i64 n) {
+    _failures.store(n, std::memory_order_relaxed);
+}
+
+} // namespace manic
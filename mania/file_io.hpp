@@ -0,0 +1,57 @@
+//
+//  file_io.hpp
+//  mania
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#ifndef file_io_hpp
+#define file_io_hpp
+
+#include "common.hpp"
+#include "fn.hpp"
+
+namespace manic {
+
+// Asynchronous positional file I/O
+//
+// A file_io describes a pread or pwrite.  file_io_submit starts it and
+// returns at once; when it completes, _result holds what pread or pwrite
+// would have returned, or -errno on failure, and _continuation is submitted
+// to the pool.  The file_io must live until then, but is not touched after,
+// so the continuation may destroy it.  As for pread and pwrite, transfers
+// may be short.
+//
+// On Linux the operations are queued on an io_uring, whose completions are
+// reaped by a single thread.  Elsewhere, or where io_uring is unavailable
+// (old kernels, seccomp), or when built with __NO_IO_URING, each operation
+// runs as a blocking job on the pool instead.
+//
+// See read_at and write_at in corrode.hpp for the coroutine interface.
+
+struct file_io {
+
+    enum : u8 {
+        READ,
+        WRITE,
+    } _opcode;
+
+    int _fd;
+    u64 _offset;
+    void* _buf;
+    usize _count;
+    isize _result;
+    fn<void()> _continuation;
+
+};
+
+void file_io_submit(file_io* p);
+
+// Makes the next n submissions to the io_uring fail as if the kernel were
+// out of resources; for testing
+void _file_io_fail_submissions(i64 n);
+
+} // namespace manic
+
+#endif /* file_io_hpp */
@@ -15,6 +15,7 @@
 #include "atomic.hpp"
 #include "maybe.hpp"
 #include "finally.hpp"
+#include "slab.hpp"
 
 namespace manic {
 
@@ -23,6 +24,15 @@ namespace manic {
 // move-only (explicit maybe-clone)
 // reference-counted
 // ready to participate in intrusive lockfree data structures
+// nodes are allocated from the thread-caching slab allocator
+//
+// node::_extant counts live nodes, for leak checking; it is a contended
+// global, so it is maintained only when __FN_EXTANT is defined, as it is by
+// default in debug builds
+
+#if !defined(NDEBUG) && !defined(__FN_EXTANT)
+#define __FN_EXTANT
+#endif
 
 using u64 = std::uint64_t;
 
@@ -47,6 +57,24 @@ struct alignas(16) node<R(Args...)> {
     
     inline static const Atomic<u64> _extant{0};
     
+    static void* operator new(std::size_t count) {
+        return slab::allocate(count);
+    }
+    
+    // (the virtual destructor ensures count is that of the derived type)
+    static void operator delete(void* ptr, std::size_t count) {
+        slab::deallocate(ptr, count);
+    }
+
+    // (for derived nodes holding over-aligned callables)
+    static void* operator new(std::size_t count, std::align_val_t al) {
+        return slab::allocate(count, al);
+    }
+
+    static void operator delete(void* ptr, std::size_t count, std::align_val_t al) {
+        slab::deallocate(ptr, count, al);
+    }
+    
     //
     // layout:
     //
@@ -71,14 +99,18 @@ struct alignas(16) node<R(Args...)> {
     : _next{0}
     , _count{0}
     , _promise{0} {
+#ifdef __FN_EXTANT
         _extant.fetch_add(1, std::memory_order_relaxed);
+#endif
     }
     
     node(node const&) = delete;
             
     virtual ~node() noexcept {
-        auto n = _extant.fetch_sub(1, std::memory_order_relaxed);
+#ifdef __FN_EXTANT
+        [[maybe_unused]] auto n = _extant.fetch_sub(1, std::memory_order_relaxed);
         assert(n > 0);
+#endif
     }
     
     node& operator=(node const&) = delete;
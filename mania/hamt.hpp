@@ -0,0 +1,573 @@
+//
+//  hamt.hpp
+//  mania
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#ifndef hamt_hpp
+#define hamt_hpp
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "common.hpp"
+#include "hash.hpp"
+#include "serialize.hpp"
+
+namespace manic {
+
+// Persistent hash array mapped trie
+//
+// Copying a hamt is O(1); the copies share structure.  Mutation copies the
+// O(log N) nodes on the path to the touched entry, and the entry itself,
+// only if they are shared with another copy, so a hamt that has never been
+// copied is mutated in place.
+//
+// Reference counts are atomic, so an immutable copy (a snapshot) may be read
+// and released on another thread while the original continues to be mutated.
+// Any one hamt object is not itself thread-safe.
+//
+// As with table3, we rely on manic::hash being high-quality.  Each level of
+// the trie consumes 6 bits of the hash; distinct keys with identical hashes
+// end up in a collision node at the bottom of the trie.
+//
+// The mutable accessors (try_get, get, operator[], entry) return references
+// into nodes that are guaranteed unshared, so they always pay for path
+// copying.  Use the const overloads to read a snapshot.
+
+template<typename K, typename V>
+struct hamt {
+
+    using key_type = K;
+    using value_type = V;
+
+    enum _kind_t : u32 {
+        LEAF,
+        BRANCH,
+        COLLISION,
+    };
+
+    struct _node {
+
+        mutable std::atomic<u64> _count;
+        _kind_t _kind;
+
+        explicit _node(_kind_t k) : _count{1}, _kind{k} {}
+
+        void acquire() const {
+            _count.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        bool is_unique() const {
+            return _count.load(std::memory_order_acquire) == 1;
+        }
+
+    };
+
+    struct _leaf : _node {
+
+        u64 _hash;
+        K _key;
+        V _value;
+
+        template<typename Q, typename U>
+        _leaf(u64 h, Q&& k, U&& v)
+        : _node(LEAF)
+        , _hash(h)
+        , _key(std::forward<Q>(k))
+        , _value(std::forward<U>(v)) {
+        }
+
+    };
+
+    // A branch stores a bitmap of which 6-bit hash fragments are present,
+    // followed by an array of popcount(bitmap) child pointers.  A collision
+    // node has the same layout and stores the number of children in place of
+    // the bitmap.
+
+    struct _branch : _node {
+
+        u64 _bitmap;
+
+        _branch(_kind_t k, u64 b) : _node(k), _bitmap(b) {}
+
+        isize size() const {
+            return (this->_kind == BRANCH) ? __builtin_popcountll(_bitmap) : _bitmap;
+        }
+
+        _node** begin() { return reinterpret_cast<_node**>(this + 1); }
+        _node** end() { return begin() + size(); }
+        _node* const* begin() const { return reinterpret_cast<_node* const*>(this + 1); }
+        _node* const* end() const { return begin() + size(); }
+
+        // index of the child for a given fragment, whether or not present
+        isize _index(u64 bit) const {
+            return __builtin_popcountll(_bitmap & (bit - 1));
+        }
+
+        static _branch* make(_kind_t k, u64 b, isize n) {
+            void* p = operator new(sizeof(_branch) + n * sizeof(_node*));
+            return new (p) _branch(k, b);
+        }
+
+        // free the node without releasing its children
+        void _deallocate() {
+            this->~_branch();
+            operator delete(static_cast<void*>(this));
+        }
+
+    };
+
+    static_assert(sizeof(_branch) % alignof(_node*) == 0);
+
+    static constexpr int BITS = 6;
+    static constexpr u64 MASK = (1ull << BITS) - 1;
+
+    static u64 _fragment(u64 h, int shift) {
+        return 1ull << ((h >> shift) & MASK);
+    }
+
+    // Heterogeneous lookup may compare integer keys of mixed signedness
+    template<typename Q>
+    static bool _equal(K const& a, Q const& b) {
+        if constexpr (std::is_integral_v<K> && std::is_integral_v<Q>)
+            return std::cmp_equal(a, b);
+        else
+            return a == b;
+    }
+
+    static void _release(_node const* p) {
+        if (p && (p->_count.fetch_sub(1, std::memory_order_release) == 1)) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            auto q = const_cast<_node*>(p);
+            if (q->_kind == LEAF) {
+                delete static_cast<_leaf*>(q);
+            } else {
+                auto b = static_cast<_branch*>(q);
+                for (_node* c : *b)
+                    _release(c);
+                b->_deallocate();
+            }
+        }
+    }
+
+    _node* _root;
+    isize _size;
+
+    hamt() : _root(nullptr), _size(0) {}
+
+    hamt(hamt const& other)
+    : _root(other._root)
+    , _size(other._size) {
+        if (_root)
+            _root->acquire();
+    }
+
+    hamt(hamt&& other)
+    : _root(std::exchange(other._root, nullptr))
+    , _size(std::exchange(other._size, 0)) {
+    }
+
+    ~hamt() { _release(_root); }
+
+    void swap(hamt& other) {
+        using std::swap;
+        swap(_root, other._root);
+        swap(_size, other._size);
+    }
+
+    hamt& operator=(hamt const& other) {
+        hamt(other).swap(*this);
+        return *this;
+    }
+
+    hamt& operator=(hamt&& other) {
+        hamt(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    isize size() const { return _size; }
+    bool empty() const { return !_size; }
+
+    void clear() {
+        _release(std::exchange(_root, nullptr));
+        _size = 0;
+    }
+
+    // O(1) immutable view of the current state
+    hamt snapshot() const { return *this; }
+
+    // Lookup
+
+    template<typename Q>
+    _leaf const* _find(Q const& k, u64 h) const {
+        _node const* p = _root;
+        for (int shift = 0; p; shift += BITS) {
+            switch (p->_kind) {
+                case LEAF: {
+                    auto a = static_cast<_leaf const*>(p);
+                    return ((a->_hash == h) && _equal(a->_key, k)) ? a : nullptr;
+                }
+                case BRANCH: {
+                    auto b = static_cast<_branch const*>(p);
+                    u64 bit = _fragment(h, shift);
+                    p = (b->_bitmap & bit) ? b->begin()[b->_index(bit)] : nullptr;
+                    break;
+                }
+                case COLLISION: {
+                    for (_node const* c : *static_cast<_branch const*>(p)) {
+                        auto a = static_cast<_leaf const*>(c);
+                        if ((a->_hash == h) && _equal(a->_key, k))
+                            return a;
+                    }
+                    return nullptr;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    template<typename Q>
+    bool contains(Q const& k) const {
+        return _find(k, hash(k));
+    }
+
+    template<typename Q>
+    value_type const* try_get(Q const& k) const {
+        auto a = _find(k, hash(k));
+        return a ? &a->_value : nullptr;
+    }
+
+    // preconditions: contains(k)
+    template<typename Q>
+    value_type const& get(Q const& k) const {
+        auto p = try_get(k);
+        assert(p);
+        return *p;
+    }
+
+    template<typename Q>
+    value_type const& operator[](Q const& k) const {
+        return get(k);
+    }
+
+    // Path copying
+
+    // Ensure that the node in slot is not shared, copying it if necessary.
+    // The slot itself must already be unshared.
+    static _node* _make_unique(_node*& slot) {
+        _node* p = slot;
+        if (p->is_unique())
+            return p;
+        if (p->_kind == LEAF) {
+            auto a = static_cast<_leaf*>(p);
+            slot = new _leaf(a->_hash, a->_key, a->_value);
+        } else {
+            auto b = static_cast<_branch*>(p);
+            auto c = _branch::make(b->_kind, b->_bitmap, b->size());
+            _node** d = c->begin();
+            for (_node* e : *b) {
+                e->acquire();
+                *d++ = e;
+            }
+            slot = c;
+        }
+        _release(p);
+        return slot;
+    }
+
+    // Replace an unshared branch with a copy that has one more child at
+    // index i
+    static _branch* _grow(_node*& slot, isize i, u64 bitmap, _node* child) {
+        auto b = static_cast<_branch*>(slot);
+        isize n = b->size();
+        auto c = _branch::make(b->_kind, bitmap, n + 1);
+        std::copy(b->begin(), b->begin() + i, c->begin());
+        c->begin()[i] = child;
+        std::copy(b->begin() + i, b->end(), c->begin() + i + 1);
+        b->_deallocate();
+        slot = c;
+        return c;
+    }
+
+    // Replace an unshared branch with a copy that lacks the child at index i
+    static _branch* _shrink(_node*& slot, isize i, u64 bitmap) {
+        auto b = static_cast<_branch*>(slot);
+        isize n = b->size();
+        auto c = _branch::make(b->_kind, bitmap, n - 1);
+        std::copy(b->begin(), b->begin() + i, c->begin());
+        std::copy(b->begin() + i + 1, b->end(), c->begin() + i);
+        b->_deallocate();
+        slot = c;
+        return c;
+    }
+
+    // Build the smallest subtrie distinguishing two leaf or collision nodes
+    // with different hashes
+    static _node* _join(_node* a, u64 g, _node* b, u64 h, int shift) {
+        assert(g != h);
+        u64 i = _fragment(g, shift);
+        u64 j = _fragment(h, shift);
+        if (i == j) {
+            auto c = _branch::make(BRANCH, i, 1);
+            c->begin()[0] = _join(a, g, b, h, shift + BITS);
+            return c;
+        }
+        auto c = _branch::make(BRANCH, i | j, 2);
+        c->begin()[i > j] = a;
+        c->begin()[i < j] = b;
+        return c;
+    }
+
+    // Find or insert the leaf for k, making every node on the path unshared.
+    // The slot must already be unshared.
+    template<typename Q, typename F>
+    _leaf* _emplace(_node*& slot, u64 h, Q&& k, int shift, F&& f) {
+        if (!slot) {
+            ++_size;
+            auto a = new _leaf(h, std::forward<Q>(k), std::forward<F>(f)());
+            slot = a;
+            return a;
+        }
+        _node* p = slot;
+        switch (p->_kind) {
+            case LEAF: {
+                auto a = static_cast<_leaf*>(p);
+                if ((a->_hash == h) && _equal(a->_key, k))
+                    return static_cast<_leaf*>(_make_unique(slot));
+                ++_size;
+                auto b = new _leaf(h, std::forward<Q>(k), std::forward<F>(f)());
+                if (a->_hash == h) {
+                    auto c = _branch::make(COLLISION, 2, 2);
+                    c->begin()[0] = a;
+                    c->begin()[1] = b;
+                    slot = c;
+                } else {
+                    slot = _join(a, a->_hash, b, h, shift);
+                }
+                return b;
+            }
+            case BRANCH: {
+                auto b = static_cast<_branch*>(_make_unique(slot));
+                u64 bit = _fragment(h, shift);
+                isize i = b->_index(bit);
+                if (b->_bitmap & bit)
+                    return _emplace(b->begin()[i], h, std::forward<Q>(k), shift + BITS, std::forward<F>(f));
+                ++_size;
+                auto a = new _leaf(h, std::forward<Q>(k), std::forward<F>(f)());
+                _grow(slot, i, b->_bitmap | bit, a);
+                return a;
+            }
+            case COLLISION: {
+                auto b = static_cast<_branch*>(p);
+                u64 g = static_cast<_leaf*>(b->begin()[0])->_hash;
+                if (g != h) {
+                    ++_size;
+                    auto a = new _leaf(h, std::forward<Q>(k), std::forward<F>(f)());
+                    slot = _join(b, g, a, h, shift);
+                    return a;
+                }
+                b = static_cast<_branch*>(_make_unique(slot));
+                for (_node*& c : *b) {
+                    auto a = static_cast<_leaf*>(c);
+                    if (_equal(a->_key, k))
+                        return static_cast<_leaf*>(_make_unique(c));
+                }
+                ++_size;
+                auto a = new _leaf(h, std::forward<Q>(k), std::forward<F>(f)());
+                _grow(slot, b->size(), b->_bitmap + 1, a);
+                return a;
+            }
+        }
+        assert(false);
+        return nullptr;
+    }
+
+    // precondition: the key is present beneath slot, and slot is unshared
+    template<typename Q>
+    void _erase(_node*& slot, u64 h, Q const& k, int shift) {
+        _node* p = slot;
+        switch (p->_kind) {
+            case LEAF: {
+                assert(_equal(static_cast<_leaf*>(p)->_key, k));
+                _release(p);
+                slot = nullptr;
+                return;
+            }
+            case BRANCH: {
+                auto b = static_cast<_branch*>(_make_unique(slot));
+                u64 bit = _fragment(h, shift);
+                isize i = b->_index(bit);
+                assert(b->_bitmap & bit);
+                _node*& c = b->begin()[i];
+                _erase(c, h, k, shift + BITS);
+                if (!c) {
+                    if (b->size() == 1) {
+                        b->_deallocate();
+                        slot = nullptr;
+                        return;
+                    }
+                    b = _shrink(slot, i, b->_bitmap & ~bit);
+                }
+                // keep the trie canonical: a branch with a sole leaf child
+                // is replaced by the leaf
+                if ((b->size() == 1) && (b->begin()[0]->_kind != BRANCH)) {
+                    slot = b->begin()[0];
+                    b->_deallocate();
+                }
+                return;
+            }
+            case COLLISION: {
+                auto b = static_cast<_branch*>(_make_unique(slot));
+                isize i = 0;
+                while (!_equal(static_cast<_leaf*>(b->begin()[i])->_key, k))
+                    ++i;
+                _release(b->begin()[i]);
+                b = _shrink(slot, i, b->_bitmap - 1);
+                if (b->size() == 1) {
+                    slot = b->begin()[0];
+                    b->_deallocate();
+                }
+                return;
+            }
+        }
+    }
+
+    // Mutation
+
+    template<typename Q>
+    value_type* try_get(Q const& k) {
+        u64 h = hash(k);
+        if (!_find(k, h))
+            return nullptr;
+        return &_emplace(_root, h, k, 0, []() -> V { assert(false); __builtin_unreachable(); })->_value;
+    }
+
+    // preconditions: contains(k)
+    template<typename Q>
+    value_type& get(Q const& k) {
+        auto p = try_get(k);
+        assert(p);
+        return *p;
+    }
+
+    // preconditions: contains(k)
+    template<typename Q>
+    value_type& operator[](Q const& k) {
+        return get(k);
+    }
+
+    template<typename Q, typename U>
+    value_type& insert(Q&& k, U&& u) {
+        u64 h = hash(k);
+        bool inserted = false;
+        _leaf* a = _emplace(_root, h, std::forward<Q>(k), 0, [&]() -> U&& {
+            inserted = true;
+            return std::forward<U>(u);
+        });
+        if (!inserted)
+            a->_value = std::forward<U>(u);
+        return a->_value;
+    }
+
+    template<typename Q>
+    bool erase(Q const& k) {
+        u64 h = hash(k);
+        if (!_find(k, h))
+            return false;
+        _erase(_root, h, k, 0);
+        --_size;
+        return true;
+    }
+
+    // Entry API, after table3
+
+    struct _deferred_entry {
+
+        K _key;
+        hamt* _target;
+        u64 _hash;
+
+        template<typename F>
+        value_type& or_insert_with(F&& f) {
+            return _target->_emplace(_target->_root,
+                                     _hash,
+                                     std::move(_key),
+                                     0,
+                                     std::forward<F>(f))->_value;
+        }
+
+        template<typename U>
+        value_type& or_insert(U&& u) {
+            return or_insert_with([&]() -> U&& { return std::forward<U>(u); });
+        }
+
+        value_type& or_default() {
+            return or_insert_with([]() { return V(); });
+        }
+
+    };
+
+    template<typename Q>
+    _deferred_entry entry(Q&& q) {
+        u64 h = hash(q);
+        return _deferred_entry{std::forward<Q>(q), this, h};
+    }
+
+    // Visit every (key, value) pair in unspecified (hash) order
+
+    template<typename F>
+    static void _for_each(_node const* p, F& f) {
+        if (!p)
+            return;
+        if (p->_kind == LEAF) {
+            auto a = static_cast<_leaf const*>(p);
+            f(a->_key, a->_value);
+        } else {
+            for (_node const* c : *static_cast<_branch const*>(p))
+                _for_each(c, f);
+        }
+    }
+
+    template<typename F>
+    void for_each(F&& f) const {
+        _for_each(_root, f);
+    }
+
+}; // struct hamt
+
+template<typename K, typename V>
+void swap(hamt<K, V>& a, hamt<K, V>& b) {
+    a.swap(b);
+}
+
+template<typename K, typename V, typename Serializer>
+void serialize(hamt<K, V> const& x, Serializer& s) {
+    serialize((usize) x.size(), s);
+    x.for_each([&](K const& k, V const& v) {
+        serialize(k, s);
+        serialize(v, s);
+    });
+}
+
+template<typename K, typename V, typename Deserializer>
+auto deserialize(placeholder<hamt<K, V>>, Deserializer& d) {
+    auto n = deserialize<usize>(d);
+    hamt<K, V> x;
+    while (n--) {
+        auto k = deserialize<K>(d);
+        auto v = deserialize<V>(d);
+        x.insert(std::move(k), std::move(v));
+    }
+    return x;
+}
+
+} // namespace manic
+
+#endif /* hamt_hpp */
@@ -12,6 +12,7 @@
 #include <cassert>
 #include <cstdint>
 #include <cmath>
+#include <cstring>
 #include <tuple>
 #include <utility>
 
@@ -96,15 +97,22 @@ public:
 // unlike libc++'s trivial std::hash implementation, suitable for direct
 // use in hash tables (in non-adversarial environments)
 //
-inline u64 hash(u64 x) {
+// The bodies of hash and hash32, written once for both scalars and GCC/Clang
+// vector types, to which the operators apply lanewise, so that the batched
+// forms below compute exactly the same function.  They update in place,
+// because passing or returning a 32-byte vector by value has a different
+// ABI with and without AVX.
+
+template<typename T>
+inline void _hash_lanes(T& x) {
     x = x * 3935559000370003845ull + 2691343689449507681ull;
     x ^= x >> 21; x ^= x << 37; x ^= x >> 4;
     x *= 4768777513237032717ull;
     x ^= x << 20; x ^= x >> 41; x ^= x << 5;
-    return x;
 }
 
-inline u32 hash32(u32 x) {
+template<typename T>
+inline void _hash32_lanes(T& x) {
     // NR does not provide a 32-bit version of hash(), but we construct one
     // from the 32-bit versions of the components.  Test to make sure we
     // haven't gotten unlucky.
@@ -112,9 +120,70 @@ inline u32 hash32(u32 x) {
     x ^= x >> 13; x ^= x << 17; x ^= x >> 5;
     x *= 1597334677u;
     x ^= x <<  9; x ^= x >> 17; x ^= x << 6;
+}
+
+inline u64 hash(u64 x) {
+    _hash_lanes(x);
+    return x;
+}
+
+inline u32 hash32(u32 x) {
+    _hash32_lanes(x);
     return x;
 }
 
+// Batched forms, filling a whole row per call
+//
+// We operate on 32 bytes of lanes at a time; each step is independent, so
+// the compiler is free to use SIMD (or, where the target lacks wide 64-bit
+// multiplies, at least to interleave the lanes' dependency chains)
+
+typedef u64 _hash_u64x4 __attribute__((vector_size(32)));
+typedef u32 _hash_u32x8 __attribute__((vector_size(32)));
+
+// dst[k] = hash(src[k]); dst may be src
+inline void hash_n(u64 const* src, u64* dst, isize n) {
+    isize k = 0;
+    for (; k + 4 <= n; k += 4) {
+        _hash_u64x4 x;
+        std::memcpy(&x, src + k, sizeof(x));
+        _hash_lanes(x);
+        std::memcpy(dst + k, &x, sizeof(x));
+    }
+    for (; k < n; ++k)
+        dst[k] = hash(src[k]);
+}
+
+// dst[k] = hash32(src[k]); dst may be src
+inline void hash32_n(u32 const* src, u32* dst, isize n) {
+    isize k = 0;
+    for (; k + 8 <= n; k += 8) {
+        _hash_u32x8 x;
+        std::memcpy(&x, src + k, sizeof(x));
+        _hash32_lanes(x);
+        std::memcpy(dst + k, &x, sizeof(x));
+    }
+    for (; k < n; ++k)
+        dst[k] = hash32(src[k]);
+}
+
+// dst[k] = hash(hash(seed ^ i) ^ (j + k)), the row of lattice noise used by
+// terrain; the first hash is common to the row
+inline void hash_row(u64 seed, i64 i, i64 j, u64* dst, isize n) {
+    u64 h = hash(seed ^ i);
+    _hash_u64x4 x = {0, 1, 2, 3};
+    x += (u64) j;
+    isize k = 0;
+    for (; k + 4 <= n; k += 4) {
+        _hash_u64x4 y = x ^ h;
+        _hash_lanes(y);
+        std::memcpy(dst + k, &y, sizeof(y));
+        x += 4;
+    }
+    for (; k < n; ++k)
+        dst[k] = hash(h ^ (u64) (j + k));
+}
+
 // Interleave bits to achieve a 1D indexing of 2D space with decent
 // locality properties.  Good for spatial hashing
 //
@@ -9,6 +9,7 @@
 #ifndef matrix_hpp
 #define matrix_hpp
 
+#include <cstring>
 #include <numeric>
 #include <vector>
 #include <iostream>
@@ -74,7 +75,7 @@ namespace manic {
         
         matrix(isize rows, isize columns, const T& x)
         : matrix_view<T>(nullptr, columns, columns, rows)
-        , raw_vector<T>(rows * columns) {
+        , raw_vector<T>(rows * columns, uninitialized) {
             this->_begin = this->_allocation;
             std::uninitialized_fill_n(this->_begin, rows * columns, x);
             assert(_invariant());
@@ -104,7 +105,7 @@ namespace manic {
             assert(_invariant());
             _destroy_all();
             if (this->_capacity < r.rows() * r.columns()) {
-                raw_vector<T> v(std::max(r.rows() * r.columns(), this->_capacity * 2));
+                raw_vector<T> v(std::max(r.rows() * r.columns(), this->_capacity * 2), uninitialized);
                 v.swap(*this);
             }
             this->_begin = this->_allocation;
@@ -184,7 +185,7 @@ namespace manic {
         void discard_and_resize(isize rows, isize columns) {
             _destroy_all();
             if (this->_capacity < rows * columns) {
-                raw_vector<T> v(std::max(rows * columns, 2 * this->_capacity));
+                raw_vector<T> v(std::max(rows * columns, 2 * this->_capacity), uninitialized);
                 v.swap(*this);
             }
             this->_begin = this->_allocation;
@@ -269,6 +270,9 @@ namespace manic {
     
     template<typename A, typename B, typename C>
     void filter_rows(matrix_view<C> c, const_matrix_view<A> a, const_vector_view<B> b) {
+#ifdef __clang__
+#pragma clang fp contract(off)
+#endif
         assert(c.rows() == a.rows());
         assert(c.columns() + b.columns() == a.columns());
         for (isize i = 0; i != c.rows(); ++i)
@@ -280,6 +284,9 @@ namespace manic {
     
     template<typename A, typename B, typename C>
     void filter_columns(matrix_view<C> c, const_matrix_view<A> a, const_vector_view<B> b) {
+#ifdef __clang__
+#pragma clang fp contract(off)
+#endif
         assert(c.columns() == a.columns());
         assert(c.rows() + b.size() == a.rows());
         for (isize i = 0; i != c.rows(); ++i)
@@ -289,6 +296,73 @@ namespace manic {
             }
     }
     
+    // Fused equivalent of exploding the columns of a, cropping offset columns
+    // from the front, applying filter_rows with f, and transposing into c:
+    //
+    //     c(j, i) = sum_k e(i, j + k) * f(k)
+    //
+    // where e(i, 2 * m - offset) = a(i, m) and is zero elsewhere.  Only the
+    // taps that land on nonzero e are evaluated, in the same order, so the
+    // result is bitwise identical to the unfused sequence, provided neither
+    // contracts its multiply-adds into fused multiply-adds.  We forbid that
+    // here and in filter_rows and filter_columns with a pragma on clang;
+    // other compilers need -ffp-contract=off.  Calling it twice upsamples
+    // and filters both axes and restores the original orientation.
+    //
+    // For integral T, the taps are fixed-point with the given number of
+    // fraction bits, and each sum is rounded back to the precision of a.
+    //
+    // We vectorize across 32 bytes' worth of rows of a, which become
+    // contiguous elements of a row of c.
+    template<typename T>
+    void explode_filter_transpose(matrix_view<T> c,
+                                  const_matrix_view<T> a,
+                                  isize offset,
+                                  const_vector_view<T> f,
+                                  int fraction_bits = 0) {
+#ifdef __clang__
+#pragma clang fp contract(off)
+#endif
+        assert((offset == 0) || (offset == 1));
+        assert(c.columns() == a.rows());
+        assert(c.rows() + f.size() <= 2 * a.columns() - offset);
+        assert(std::is_integral_v<T> || !fraction_bits);
+
+        constexpr isize W = 32 / sizeof(T);
+        typedef T V __attribute__((vector_size(W * sizeof(T))));
+
+        // (vector types can't be template arguments, so we memcpy them in
+        // and out of a scalar buffer; it is kept between calls, and every
+        // element read is written first)
+        static thread_local std::vector<T> v;
+        if ((isize) v.size() < a.columns() * W)
+            v.resize(a.columns() * W);
+        for (isize i = 0; i < a.rows(); i += W) {
+            isize w = std::min(W, a.rows() - i);
+            // transpose a W-row strip of a into W-element columns
+            for (isize m = 0; m != a.columns(); ++m)
+                for (isize l = 0; l != W; ++l)
+                    v[m * W + l] = (l < w) ? a(i + l, m) : T();
+            for (isize j = 0; j != c.rows(); ++j) {
+                V x = {};
+                for (isize k = (j + offset) & 1; k < f.size(); k += 2) {
+                    V y;
+                    std::memcpy(&y, v.data() + ((j + k + offset) >> 1) * W, sizeof(V));
+                    x += y * f[k];
+                }
+                if constexpr (std::is_integral_v<T>)
+                    if (fraction_bits)
+                        x = (x + (T(1) << (fraction_bits - 1))) >> fraction_bits;
+                if (w == W) {
+                    std::memcpy(&c(j, i), &x, sizeof(V));
+                } else {
+                    for (isize l = 0; l != w; ++l)
+                        c(j, i + l) = x[l];
+                }
+            }
+        }
+    }
+
     template<typename A, typename B>
     void explode(matrix_view<B> b, const_matrix_view<A> a) {
         assert(b.rows() == 2 * a.rows());
@@ -0,0 +1,160 @@
+//
+//  parking_lot.cpp
+//  mania
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#include <algorithm>
+#include <thread>
+#include <utility>
+
+#include "parking_lot.hpp"
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+namespace manic {
+
+namespace {
+
+enum : i64 {
+    BUCKETS = 512,
+    SPIN_MINIMUM = 250, // <-- nanoseconds
+    SPIN_LIMIT = 10'000, // <-- about what parking and waking costs
+};
+
+// (zero-initialized, so usable during static initialization)
+_parking_bucket _buckets[BUCKETS];
+
+#if !defined(__linux__)
+std::mutex _mutexes[BUCKETS]; // <-- for the condition variables of nodes
+#endif
+
+// (false until initialized, so nothing spins during static initialization)
+const bool _multiprocessor = std::thread::hardware_concurrency() > 1;
+
+} // namespace
+
+_parking_bucket& _parking_lot_bucket(void const* address) noexcept {
+    // Fibonacci hashing of the address
+    static_assert(BUCKETS == 1 << 9);
+    auto h = (u64) reinterpret_cast<uintptr_t>(address) * 0x9E3779B97F4A7C15ull;
+    return _buckets[h >> (64 - 9)];
+}
+
+i64 _parking_bucket::budget() const noexcept {
+    i64 average = _average.load(std::memory_order_relaxed);
+    if (!_multiprocessor || average >= SPIN_LIMIT)
+        return 0;
+    return std::clamp<i64>(2 * average, SPIN_MINIMUM, SPIN_LIMIT);
+}
+
+void _parking_bucket::learn(i64 nanoseconds) noexcept {
+    // an exponentially weighted moving average, with the samples clamped so
+    // that one very long wait does not stop spinning for long; racing
+    // updates lose samples, which does not matter
+    nanoseconds = std::min<i64>(nanoseconds, 4 * SPIN_LIMIT);
+    i64 average = _average.load(std::memory_order_relaxed);
+    _average.store(average + (nanoseconds - average) / 8, std::memory_order_relaxed);
+}
+
+void _parking_bucket::lock() noexcept {
+    while (_lock.exchange(1, std::memory_order_acquire))
+        for (int i = 0; _lock.load(std::memory_order_relaxed); ++i) {
+            if (_multiprocessor && i < 64)
+                _parking_lot_pause();
+            else
+                std::this_thread::yield();
+        }
+}
+
+void _parking_bucket::unlock() noexcept {
+    _lock.store(0, std::memory_order_release);
+}
+
+void _parking_bucket::enqueue(_parking_node* n) noexcept {
+    n->_next = nullptr;
+    if (_tail)
+        _tail->_next = n;
+    else
+        _head = n;
+    _tail = n;
+}
+
+void _parking_bucket::unpark(void const* address, bool all) noexcept {
+    // unlink the nodes to wake, oldest first, onto a list of our own
+    _parking_node* woken = nullptr;
+    _parking_node** last = &woken;
+    lock();
+    _parking_node* previous = nullptr;
+    for (_parking_node* n = _head; n;) {
+        _parking_node* next = n->_next;
+        if (n->_address == address) {
+            (previous ? previous->_next : _head) = next;
+            if (_tail == n)
+                _tail = previous;
+            *std::exchange(last, &n->_next) = n;
+            if (!all)
+                break;
+        } else {
+            previous = n;
+        }
+        n = next;
+    }
+    *last = nullptr;
+    unlock();
+    if (woken)
+        _wakes.fetch_add(1, std::memory_order_relaxed);
+    while (woken) {
+        // (a node is gone as soon as its thread sees it unparked)
+        _parking_node* n = std::exchange(woken, woken->_next);
+#if defined(__linux__)
+        n->_unparked.store(1, std::memory_order_release);
+        // a wake on the address of a node already gone is harmless
+        syscall(SYS_futex, reinterpret_cast<u32 const*>(&n->_unparked), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+        isize i = this - _buckets;
+        std::unique_lock lock(_mutexes[i]);
+        n->_unparked.store(1, std::memory_order_release);
+        n->_condvar.notify_one();
+#endif
+    }
+}
+
+#if defined(__linux__)
+
+void _parking_bucket::park(_parking_node* n) noexcept {
+    while (!n->_unparked.load(std::memory_order_acquire))
+        syscall(SYS_futex, reinterpret_cast<u32 const*>(&n->_unparked), FUTEX_WAIT_PRIVATE, 0, nullptr, nullptr, 0);
+}
+
+#else
+
+void _parking_bucket::park(_parking_node* n) noexcept {
+    isize i = this - _buckets;
+    std::unique_lock lock(_mutexes[i]);
+    while (!n->_unparked.load(std::memory_order_relaxed))
+        n->_condvar.wait(lock);
+}
+
+#endif
+
+parking_lot_statistics parking_lot_statistics::get() noexcept {
+    parking_lot_statistics s = {};
+    for (_parking_bucket const& b : _buckets) {
+        s.spins += b._spins.load(std::memory_order_relaxed);
+        s.parks += b._parks.load(std::memory_order_relaxed);
+        s.wakes += b._wakes.load(std::memory_order_relaxed);
+    }
+    return s;
+}
+
+} // namespace manic
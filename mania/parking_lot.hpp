@@ -0,0 +1,163 @@
+//
+//  parking_lot.hpp
+//  mania
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#ifndef parking_lot_hpp
+#define parking_lot_hpp
+
+#include <atomic>
+#include <chrono>
+
+#if !defined(__linux__)
+#include <condition_variable>
+#endif
+
+#include "common.hpp"
+
+namespace manic {
+
+// Address-keyed parking lot, behind Atomic<T>::wait and notify
+//
+// Addresses hash to one of a fixed table of buckets, each on its own cache
+// line.  A waiter first spins, re-reading the atomic, for the bucket's spin
+// budget; if the value is still unchanged it registers in the bucket's
+// _waiters, appends a node tagged with the address to the bucket's queue,
+// and parks on the node's own word (a futex on Linux, a condition variable
+// elsewhere).  A notifier publishes its store, then reads _waiters and, if
+// it is zero, returns without a system call.  The seq_cst fences between
+// each pair ensure that at least one of them sees the other, so no wakeup
+// is lost; a waiter checks the atomic again under the queue's lock.
+//
+// The spin budget is learned per bucket from an average of recent wait
+// durations: while waits are short enough that parking would cost more than
+// they do, waiters spin for about twice the average; once they are longer,
+// waiters barely spin and park at once.  Waits that park still update the
+// average, so a bucket whose waits become short again relearns to spin.
+// There is no point spinning with only one hardware thread, so the budget
+// is then always zero.
+//
+// Unrelated addresses can share a bucket, so the queue is searched for the
+// address: notify_one unparks only the longest-parked waiter on it, and
+// notify_all every waiter on it.  The queue's lock is held only to link and
+// unlink nodes, so it spins, and cannot itself park.
+//
+// Each bucket counts waits that ended while spinning, parks, and notifies
+// that woke parked waiters; parking_lot_statistics sums them.  Notifies
+// that found no waiters are not counted, as that would write to the bucket
+// on the path the elision exists to make cheap.
+
+// A parked thread, on its own stack
+struct _parking_node {
+
+    _parking_node* _next;
+    void const* _address;
+    std::atomic<u32> _unparked; // <-- futex word
+#if !defined(__linux__)
+    std::condition_variable _condvar;
+#endif
+
+};
+
+struct alignas(64) _parking_bucket {
+
+    std::atomic<i32> _waiters; // <-- threads parked, or about to park
+    std::atomic<u32> _lock; // <-- of the queue
+    _parking_node* _head; // <-- the queue, oldest first
+    _parking_node* _tail;
+    std::atomic<i64> _average; // <-- of recent wait durations, in nanoseconds
+    std::atomic<u64> _spins;
+    std::atomic<u64> _parks;
+    std::atomic<u64> _wakes;
+
+    i64 budget() const noexcept;
+    void learn(i64 nanoseconds) noexcept;
+    void lock() noexcept;
+    void unlock() noexcept;
+    void enqueue(_parking_node* n) noexcept; // <-- under the lock
+    void park(_parking_node* n) noexcept; // <-- until n is unparked
+    void unpark(void const* address, bool all) noexcept;
+
+};
+
+_parking_bucket& _parking_lot_bucket(void const* address) noexcept;
+
+inline void _parking_lot_pause() noexcept {
+#if defined(__x86_64__)
+    asm volatile ("pause" ::: "memory");
+#elif defined(__aarch64__)
+    asm volatile ("yield" ::: "memory");
+#endif
+}
+
+template<typename T>
+void parking_lot_wait(std::atomic<T> const* a, T old, std::memory_order order) noexcept {
+    if (a->load(order) != old)
+        return;
+    using clock = std::chrono::steady_clock;
+    _parking_bucket& b = _parking_lot_bucket(a);
+    auto t0 = clock::now();
+    auto elapsed = [&] {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t0).count();
+    };
+    // spin, reading the clock only every few iterations
+    if (i64 budget = b.budget()) {
+        for (int i = 1;; ++i) {
+            _parking_lot_pause();
+            if (a->load(order) != old) {
+                b._spins.fetch_add(1, std::memory_order_relaxed);
+                b.learn(elapsed());
+                return;
+            }
+            if (!(i & 15) && elapsed() >= budget)
+                break;
+        }
+    }
+    // park
+    _parking_node n;
+    n._address = a;
+    for (;;) {
+        b._waiters.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        b.lock();
+        bool parking = a->load(std::memory_order_seq_cst) == old;
+        if (parking) {
+            n._unparked.store(0, std::memory_order_relaxed);
+            b.enqueue(&n);
+        }
+        b.unlock();
+        if (parking) {
+            b._parks.fetch_add(1, std::memory_order_relaxed);
+            b.park(&n);
+        }
+        b._waiters.fetch_sub(1, std::memory_order_relaxed);
+        if (a->load(order) != old)
+            break;
+    }
+    b.learn(elapsed());
+}
+
+inline void parking_lot_notify(void const* address, bool all) noexcept {
+    _parking_bucket& b = _parking_lot_bucket(address);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (b._waiters.load(std::memory_order_relaxed))
+        b.unpark(address, all);
+}
+
+struct parking_lot_statistics {
+
+    u64 spins; // <-- waits that ended while spinning
+    u64 parks; // <-- times a waiter parked
+    u64 wakes; // <-- notifies that found waiters
+
+    // Sums the counters of every bucket
+    static parking_lot_statistics get() noexcept;
+
+};
+
+} // namespace manic
+
+#endif /* parking_lot_hpp */
@@ -0,0 +1,400 @@
+//
+//  pool.cpp
+//  mania
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#include <algorithm>
+#include <thread>
+#include <utility>
+
+#include "atomic.hpp"
+#include "bounded_queue.hpp"
+#include "hash.hpp"
+#include "pool.hpp"
+
+namespace manic {
+
+namespace {
+
+// Chase-Lev work-stealing deque, after Lê, Pop, Cohen and Zappa Nardelli,
+// "Correct and efficient work-stealing for weak memory models" (2013)
+//
+// The owning worker pushes and pops at the bottom (LIFO, so it works on
+// what is hot in its cache); thieves steal from the top (FIFO, taking the
+// oldest jobs, which tend to be the largest).  Jobs are held as the raw
+// fn<void()>::_value, so a slot is a single word.
+//
+// push and pop may only be called by the owner; steal by anyone.  The
+// methods are const because the state is all atomic.
+
+struct _deque {
+
+    // Circular buffer.  When the owner grows it, the old ring is kept
+    // (chained through _previous) because a thief may still be reading it;
+    // the total is bounded by twice the largest ring.
+    struct _ring {
+
+        i64 _mask;
+        Atomic<u64> const* _slots;
+        _ring const* _previous;
+
+        _ring(i64 capacity, _ring const* previous)
+        : _mask(capacity - 1)
+        , _slots(new Atomic<u64>[capacity])
+        , _previous(previous) {
+            assert(!(capacity & _mask));
+        }
+
+        // Release and acquire (rather than the paper's relaxed) publish
+        // the job itself to the thief on any path, at no cost on x86 and
+        // little on ARM, and keep ThreadSanitizer, which does not model
+        // fences, informed
+        u64 get(i64 i) const {
+            return _slots[i & _mask].load(std::memory_order_acquire);
+        }
+
+        void put(i64 i, u64 x) const {
+            _slots[i & _mask].store(x, std::memory_order_release);
+        }
+
+    };
+
+    alignas(64) Atomic<i64> _top;
+    alignas(64) Atomic<i64> _bottom;
+    Atomic<_ring const*> _array;
+
+    _deque()
+    : _top(0)
+    , _bottom(0)
+    , _array(new _ring(256, nullptr)) {
+    }
+
+    _deque(_deque const&) = delete;
+
+    _ring const* _grow(_ring const* a, i64 t, i64 b) const {
+        auto c = new _ring((a->_mask + 1) * 2, a);
+        for (i64 i = t; i != b; ++i)
+            c->put(i, a->get(i));
+        _array.store(c, std::memory_order_release);
+        return c;
+    }
+
+    void push(u64 x) const {
+        assert(x);
+        i64 b = _bottom.load(std::memory_order_relaxed);
+        i64 t = _top.load(std::memory_order_acquire);
+        _ring const* a = _array.load(std::memory_order_relaxed);
+        if (b - t > a->_mask)
+            a = _grow(a, t, b);
+        a->put(b, x);
+        std::atomic_thread_fence(std::memory_order_release);
+        _bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // Returns zero if empty
+    u64 pop() const {
+        i64 b = _bottom.load(std::memory_order_relaxed) - 1;
+        _ring const* a = _array.load(std::memory_order_relaxed);
+        _bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        i64 t = _top.load(std::memory_order_relaxed);
+        u64 x = 0;
+        if (t <= b) {
+            x = a->get(b);
+            if (t == b) {
+                // last job; race the thieves for it
+                if (!_top.compare_exchange_strong(t, t + 1,
+                                                  std::memory_order_seq_cst,
+                                                  std::memory_order_relaxed))
+                    x = 0;
+                _bottom.store(b + 1, std::memory_order_relaxed);
+            }
+        } else {
+            _bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return x;
+    }
+
+    // Returns zero if empty, or if it lost a race, in which case it sets
+    // contended and the caller should look again
+    u64 steal(bool& contended) const {
+        i64 t = _top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        i64 b = _bottom.load(std::memory_order_acquire);
+        if (t < b) {
+            _ring const* a = _array.load(std::memory_order_acquire);
+            u64 x = a->get(t);
+            if (_top.compare_exchange_strong(t, t + 1,
+                                             std::memory_order_seq_cst,
+                                             std::memory_order_relaxed))
+                return x;
+            contended = true;
+        }
+        return 0;
+    }
+
+}; // struct _deque
+
+u64 _release(fn<void()>&& f) {
+    return std::exchange(f._value, 0);
+}
+
+// A queue of jobs shared by all workers, taken in submission order
+//
+// Jobs wait in a bounded MPMC queue (see bounded_queue.hpp), as raw
+// fn<void()>::_value.  If it is full, they spill to a stack, which is taken
+// only when the queue is empty, and whose jobs are run in no particular
+// order; a lane that overflows has fallen so far behind that its order is
+// the least of its problems.
+
+struct _lane {
+
+    enum : isize {
+        CAPACITY = 1024,
+    };
+
+    bounded_queue<u64> _queue;
+    stack<fn<void()>> _overflow;
+
+    _lane() : _queue(CAPACITY) {}
+
+    _lane(_lane const&) = delete;
+
+    bool empty() const {
+        return !_queue.size() && _overflow.empty();
+    }
+
+    void push(fn<void()> f) const {
+        u64 x = _release(std::move(f));
+        if (!_queue.try_push(std::move(x)))
+            _overflow.push(fn<void()>(x));
+    }
+
+    void splice(stack<fn<void()>> s) const {
+        // (the top of the stack is the newest)
+        s.reverse();
+        while (!s.empty())
+            push(s.pop());
+    }
+
+    // Returns the oldest job, or zero if the lane is empty; sets more if
+    // jobs taken from the overflow were put back
+    u64 pop(bool& more) const {
+        u64 x = 0;
+        if (_queue.try_pop(x))
+            return x;
+        if (_overflow.empty())
+            return 0; // <-- without writing to the shared line
+        auto s = _overflow.take();
+        if (s.empty())
+            return 0;
+        x = _release(s.pop());
+        if (!s.empty()) {
+            _overflow.splice(std::move(s));
+            more = true;
+        }
+        return x;
+    }
+
+}; // struct _lane
+
+// Work-stealing pool
+//
+// Each worker owns a deque.  Jobs submitted by a worker go to the bottom of
+// its own deque; jobs submitted from other threads go to a shared
+// injection stack, which idle workers take whole and move to their deques.
+// An idle worker first pops its own deque, then takes the injection stack,
+// then tries to steal from every other worker, starting at a random one.
+//
+// Critical and background jobs (see qos in pool.hpp) go to lanes of their
+// own, shared by all workers, which start them in submission order.  A
+// worker takes the critical lane first, before even its own deque, so
+// critical jobs start at the next job boundary of any worker; it takes the
+// background lane last, and only while fewer than _background_limit
+// background jobs are running.
+//
+// Idle workers park on _epoch (see parking_lot.hpp).  A worker about to
+// park registers in _sleepers and then looks for work once more; a
+// submitter publishes its work and then checks _sleepers.  The seq_cst
+// fences between each pair ensure that at least one of them sees the
+// other, so no wakeup is lost, and submitters pay only a fence and a load
+// when every worker is busy.
+//
+// Deliberately leaked, with detached workers, so that jobs may be
+// submitted during static destruction
+
+struct _pool {
+
+    isize _size;
+    isize _background_limit;
+    _deque* _deques;
+
+    alignas(64) stack<fn<void()>> _injector;
+    alignas(64) _lane _critical;
+    alignas(64) _lane _background;
+    alignas(64) Atomic<i64> _background_running;
+    alignas(64) Atomic<u32> _epoch;
+    alignas(64) Atomic<i64> _sleepers;
+
+    // Index of the current thread's deque, or -1 if it is not a worker
+    static thread_local isize _index;
+
+    _pool()
+    : _size(std::max(1u, std::thread::hardware_concurrency()))
+    , _background_limit(std::max<isize>(1, _size / 4))
+    , _deques(new _deque[_size])
+    , _background_running(0)
+    , _epoch(0)
+    , _sleepers(0) {
+        for (isize i = 0; i != _size; ++i)
+            std::thread(&_pool::_run, this, i).detach();
+    }
+
+    void _wake(bool all) const {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_sleepers.load(std::memory_order_seq_cst)) {
+            _epoch.fetch_add(1, std::memory_order_seq_cst);
+            if (all)
+                _epoch.notify_all();
+            else
+                _epoch.notify_one();
+        }
+    }
+
+    // Returns the oldest job of a lane, or zero if it is empty
+    u64 _take_one(_lane const& lane) const {
+        bool more = false;
+        u64 x = lane.pop(more);
+        if (more)
+            _wake(false);
+        return x;
+    }
+
+    // Sets background if it returns a background job
+    u64 _find(isize i, rand& r, bool& background) const {
+        if (u64 x = _take_one(_critical))
+            return x;
+        _deque const& d = _deques[i];
+        if (u64 x = d.pop())
+            return x;
+        if (auto s = _injector.take(); !s.empty()) {
+            // keep the oldest to run now, and make the rest stealable in
+            // submission order
+            s.reverse();
+            u64 x = _release(s.pop());
+            if (!s.empty()) {
+                do {
+                    d.push(_release(s.pop()));
+                } while (!s.empty());
+                _wake(false);
+            }
+            return x;
+        }
+        for (;;) {
+            bool contended = false;
+            isize k = r() % _size;
+            for (isize n = 0; n != _size; ++n) {
+                if (k != i)
+                    if (u64 x = _deques[k].steal(contended))
+                        return x;
+                if (++k == _size)
+                    k = 0;
+            }
+            if (!contended)
+                break;
+        }
+        if (!_background.empty()) {
+            i64 n = _background_running.load(std::memory_order_relaxed);
+            while (n < _background_limit) {
+                if (_background_running.compare_exchange_weak(n, n + 1, std::memory_order_relaxed, std::memory_order_relaxed)) {
+                    if (u64 x = _take_one(_background)) {
+                        background = true;
+                        return x;
+                    }
+                    _background_running.fetch_sub(1, std::memory_order_relaxed);
+                    break;
+                }
+            }
+        }
+        return 0;
+    }
+
+    void _run(isize i) const {
+        _index = i;
+        rand r(i);
+        for (;;) {
+            bool background = false;
+            u64 x = _find(i, r, background);
+            if (!x) {
+                u32 e = _epoch.load(std::memory_order_seq_cst);
+                _sleepers.fetch_add(1, std::memory_order_seq_cst);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                x = _find(i, r, background);
+                if (!x)
+                    _epoch.wait(e, std::memory_order_seq_cst);
+                _sleepers.fetch_sub(1, std::memory_order_relaxed);
+            }
+            if (x) {
+                fn<void()> f(x);
+                f();
+                if (background) {
+                    // a parked worker may now take the next one
+                    _background_running.fetch_sub(1, std::memory_order_relaxed);
+                    if (!_background.empty())
+                        _wake(false);
+                }
+            }
+        }
+    }
+
+    static _pool const& _get() {
+        static _pool* p = new _pool;
+        return *p;
+    }
+
+}; // struct _pool
+
+thread_local isize _pool::_index = -1;
+
+} // namespace
+
+void pool_submit_one(fn<void()> f, qos q) {
+    auto& p = _pool::_get();
+    if (q == qos::critical)
+        p._critical.push(std::move(f));
+    else if (q == qos::background)
+        p._background.push(std::move(f));
+    else if (_pool::_index >= 0)
+        p._deques[_pool::_index].push(_release(std::move(f)));
+    else
+        p._injector.push(std::move(f));
+    p._wake(false);
+}
+
+void pool_submit_many(stack<fn<void()>> s, qos q) {
+    if (s.empty())
+        return;
+    auto& p = _pool::_get();
+    if (q == qos::critical) {
+        p._critical.splice(std::move(s));
+    } else if (q == qos::background) {
+        p._background.splice(std::move(s));
+    } else if (_pool::_index >= 0) {
+        _deque const& d = p._deques[_pool::_index];
+        s.reverse();
+        while (!s.empty())
+            d.push(_release(s.pop()));
+    } else {
+        p._injector.splice(std::move(s));
+    }
+    p._wake(true);
+}
+
+bool pool_should_yield() {
+    return !_pool::_get()._critical.empty();
+}
+
+} // namespace manic
@@ -21,8 +21,26 @@
 
 namespace manic {
 
-void pool_submit_one(fn<void()> f);
-void pool_submit_many(stack<fn<void()>> s);
+// Quality of service of a job
+//
+// Workers look for critical jobs first, at every job boundary, then normal
+// jobs, and take background jobs only when there is nothing else to do, and
+// on at most a quarter of the workers at once, so that long background work
+// (saves, terrain bakes) leaves room for the simulation.  Running jobs are
+// never interrupted; long background jobs should be split into short ones,
+// or poll pool_should_yield and resubmit their remainder.
+
+enum class qos {
+    critical,
+    normal,
+    background,
+};
+
+void pool_submit_one(fn<void()> f, qos q = qos::normal);
+void pool_submit_many(stack<fn<void()>> s, qos q = qos::normal);
+
+// True when critical jobs are waiting for a worker
+bool pool_should_yield();
 
 }
 
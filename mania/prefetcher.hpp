@@ -0,0 +1,119 @@
+//
+//  prefetcher.hpp
+//  mania
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#ifndef prefetcher_hpp
+#define prefetcher_hpp
+
+#include <cmath>
+#include <memory>
+#include <utility>
+
+#include "mutex.hpp"
+#include "pool.hpp"
+#include "table3.hpp"
+#include "vec.hpp"
+#include "vector.hpp"
+
+namespace manic {
+
+// Generates the chunks of a space2 on the thread pool before they are needed
+//
+// Each frame, the owner requests the chunks around the view, projected along
+// its velocity, and around other interesting locations such as entities.
+// Chunks that are neither present nor in flight are generated on the pool,
+// and the completed chunks are installed into the space by the owner, so the
+// space itself is never touched by another thread.  The generator must be
+// safe to call concurrently.
+//
+// get_chunk remains the synchronous fallback; if it wins the race, the late
+// chunk is discarded on install.
+
+template<typename Space>
+struct prefetcher {
+
+    using M = typename Space::M;
+
+    enum : i64 {
+        N = Space::N,
+        LOOKAHEAD = 60, // <-- frames of motion to anticipate
+        STEPS = 4, // <-- samples along the projected path
+        MAX_PENDING = 64, // <-- chunks in flight
+    };
+
+    // Jobs hold a reference, so may outlive the prefetcher
+    struct _completed {
+        mutex<vector<std::pair<vec<i64, 2>, M>>> _chunks;
+    };
+
+    std::shared_ptr<_completed const> _ready;
+    table3<vec<i64, 2>, bool> _pending;
+
+    prefetcher() : _ready(std::make_shared<_completed>()) {}
+
+    prefetcher(prefetcher const&) = delete;
+    prefetcher(prefetcher&&) = default;
+    prefetcher& operator=(prefetcher const&) = delete;
+    prefetcher& operator=(prefetcher&&) = default;
+
+    isize pending() const { return _pending.size(); }
+
+    // Move completed chunks into the space
+    void install(Space& space) {
+        vector<std::pair<vec<i64, 2>, M>> v;
+        v.swap(*_ready->_chunks.lock());
+        for (auto& [uv, m] : v) {
+            _pending.erase(uv);
+            space._table.entry(uv).or_insert(std::move(m));
+        }
+    }
+
+    // Request the chunk containing xy; returns false if we are saturated
+    bool request(Space& space, vec<i64, 2> xy) {
+        auto uv = Space::_high(xy);
+        if (space._table.contains(uv) || _pending.contains(uv))
+            return true;
+        if (_pending.size() >= MAX_PENDING)
+            return false;
+        _pending.insert(uv, true);
+        pool_submit_one([f = space._generator(uv), r = _ready, uv]() mutable {
+            M m = f();
+            r->_chunks.lock()->emplace_back(uv, std::move(m));
+        }, qos::background);
+        return true;
+    }
+
+    // Request the chunks overlapping [lo, hi)
+    bool request(Space& space, vec<i64, 2> lo, vec<i64, 2> hi) {
+        for (i64 u = lo.x & ~(N - 1); u < hi.x; u += N)
+            for (i64 v = lo.y & ~(N - 1); v < hi.y; v += N)
+                if (!request(space, vec<i64, 2>{u, v}))
+                    return false;
+        return true;
+    }
+
+    // Request the view [lo, hi), then where it will be if it keeps moving at
+    // velocity (cells per frame), nearest first
+    bool request(Space& space, vec<i64, 2> lo, vec<i64, 2> hi, vec<double, 2> velocity) {
+        if (!request(space, lo - N, hi + N))
+            return false;
+        for (i64 i = 1; i <= STEPS; ++i) {
+            vec<i64, 2> d{
+                (i64) std::round(velocity.x * (LOOKAHEAD * i / STEPS)),
+                (i64) std::round(velocity.y * (LOOKAHEAD * i / STEPS))
+            };
+            if (!request(space, lo + d, hi + d))
+                return false;
+        }
+        return true;
+    }
+
+}; // struct prefetcher
+
+} // namespace manic
+
+#endif /* prefetcher_hpp */
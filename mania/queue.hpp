@@ -72,36 +72,40 @@ union Atomic<queue<T>> {
         }
     };
     
-    alignas(64) Atomic<u64> _head;
-    alignas(64) Atomic<u64> _tail;
+    // (the ends are wrapped in a struct, or as members of the union they
+    // would alias)
+    struct {
+        alignas(64) Atomic<u64> _head;
+        alignas(64) Atomic<u64> _tail;
+    } _ends;
     
-    Atomic() {
-        _head = _tail = CNT | (u64) new node{0x2'0000, 0};
+    Atomic() : _ends() {
+        _ends._head = _ends._tail = CNT | (u64) new node{0x2'0000, 0};
     }
     
     ~Atomic() {
         u64 a, b;
         for (;;) {
-            a = _tail;
+            a = _ends._tail;
             b = mptr(a)->_next;
             if (!b)
                 break;
-            _tail = b;
+            _ends._tail = b;
             ptr(a)->release(cnt(a));
             ptr(b)->release(1); // <-- coalesce this somehow?
         }
         // advance head
         for (;;) {
-            a = _head;
+            a = _ends._head;
             b = mptr(a)->_next;
             if (!b)
                 break;
-            _head = b;
+            _ends._head = b;
             ptr(a)->release(cnt(a));
             ptr(b)->erase_and_release(1);
         }
-        assert(ptr(_head) == ptr(_tail));
-        ptr(_head)->release(cnt(_head) + cnt(_tail));
+        assert(ptr(_ends._head) == ptr(_ends._tail));
+        ptr(_ends._head)->release(cnt(_ends._head) + cnt(_ends._tail));
     }
     
     static node const* ptr(u64 a) { return (node const*) (a & PTR); }
@@ -148,7 +152,7 @@ union Atomic<queue<T>> {
         std::uint64_t z = 0xFFFE'0000'0000'0000 | (std::uint64_t) ptr_mut;
         ptr_mut = nullptr;
         node const* ptr = nullptr;
-        std::uint64_t a = _tail.load(std::memory_order_relaxed);
+        std::uint64_t a = _ends._tail.load(std::memory_order_relaxed);
         std::uint64_t b = 0;
         std::uint64_t c = 0;
         for (;;) {
@@ -156,7 +160,7 @@ union Atomic<queue<T>> {
             assert(a & PTR);
             assert(a & CNT);
             b = a - INC;
-            if (_tail.compare_exchange_weak(a, b, std::memory_order_acquire, std::memory_order_relaxed)) {
+            if (_ends._tail.compare_exchange_weak(a, b, std::memory_order_acquire, std::memory_order_relaxed)) {
                 // we take partial ownership of _tail and can dereference it
             alpha:
                 ptr = (node const*) (b & PTR);
@@ -168,7 +172,7 @@ union Atomic<queue<T>> {
                     // not clear if this is an optimization (we do less total work)
                     // or a pessimization (we increase contention on _tail)
                     z |= CNT;
-                    do if (_tail.compare_exchange_weak(b, z, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                    do if (_ends._tail.compare_exchange_weak(b, z, std::memory_order_acq_rel, std::memory_order_acquire)) {
                         // release tail's current count plus our one unit
                         ptr->release((b >> 48) + 2);
                         return;
@@ -180,7 +184,7 @@ union Atomic<queue<T>> {
                     
                 } while (!c);
                 // we failed to install the node and instead must swing tail to next
-                do if (_tail.compare_exchange_weak(b, c, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                do if (_ends._tail.compare_exchange_weak(b, c, std::memory_order_acq_rel, std::memory_order_acquire)) {
                     // we swung tail and are awarded one unit of ownership
                     ptr->release((b >> 48) + 2); // release old tail
                     a = b = c;
@@ -198,7 +202,7 @@ union Atomic<queue<T>> {
     }
     
     bool try_pop(T& x) const {
-        std::uint64_t a = _head.load(std::memory_order_relaxed);
+        std::uint64_t a = _ends._head.load(std::memory_order_relaxed);
         std::uint64_t b = 0;
         node const* ptr = nullptr;
         std::uint64_t c = 0;
@@ -207,12 +211,12 @@ union Atomic<queue<T>> {
             assert(a & PTR);
             assert(a & CNT); // <-- sentinel was drained, can happen if hammering on empty
             b = a - INC;
-            if (_head.compare_exchange_weak(a, b, std::memory_order_acquire, std::memory_order_relaxed)) {
+            if (_ends._head.compare_exchange_weak(a, b, std::memory_order_acquire, std::memory_order_relaxed)) {
                 // we can now read _head->_next
                 ptr = (node*) (b & PTR);
                 c = ptr->_next.load(std::memory_order_acquire);
                 if (c & PTR) {
-                    do if (_head.compare_exchange_weak(b, c, std::memory_order_release, std::memory_order_relaxed)) {
+                    do if (_ends._head.compare_exchange_weak(b, c, std::memory_order_release, std::memory_order_relaxed)) {
                         // we installed _head and have one unit of ownership of the new head node
                         ptr->release((b >> 48) + 2); // release old head node
                         ptr = (node*) (c & PTR);
@@ -228,7 +232,7 @@ union Atomic<queue<T>> {
                     a = b;
                 } else {
                     // queue is empty
-                    do if (_head.compare_exchange_weak(b, b + INC, std::memory_order_relaxed, std::memory_order_relaxed)) {
+                    do if (_ends._head.compare_exchange_weak(b, b + INC, std::memory_order_relaxed, std::memory_order_relaxed)) {
                         // we put back the local weight we took
                         return false;
                     } while ((b & PTR) == (a & PTR));
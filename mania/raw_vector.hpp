@@ -9,13 +9,19 @@
 #ifndef raw_vector_hpp
 #define raw_vector_hpp
 
+#include <cassert>
 #include <cstdlib>
+#include <new>
 #include <utility>
 
 #ifdef __APPLE__
 #include <malloc/malloc.h>
 #endif
 
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
 
 #include "common.hpp"
 #include "vector_view.hpp"
@@ -23,11 +29,80 @@
 
 namespace manic {
 
-// raw_vector manages a slab of callocated raw memory.  It will free the memory
-// on destruction, but will not attempt to construct or destruct any objects in
-// the memory.  It must be combined with some external management to determine
-// which slots are occupied; a std::vector maintains a _size, partioning
-// occupied and unoccupied slots, for example.
+// Tag requesting that a raw_vector's memory not be zeroed, for when the
+// caller will overwrite every slot it later reads
+struct uninitialized_t { explicit uninitialized_t() = default; };
+inline constexpr uninitialized_t uninitialized{};
+
+// Allocations of at least this many bytes bypass malloc.  On Linux they are
+// mapped directly, aligned to and padded out to whole 2 MB huge pages, and
+// advised to use transparent huge pages; the kernel supplies them zeroed on
+// first touch, so even zeroed requests skip the memset, and large tables and
+// matrices put less pressure on the TLB.
+enum : usize { _RAW_VECTOR_HUGE = usize(1) << 21 };
+
+inline usize _raw_vector_huge_round(usize bytes) {
+    return (bytes + _RAW_VECTOR_HUGE - 1) & ~(usize) (_RAW_VECTOR_HUGE - 1);
+}
+
+// Returns a block of at least bytes, updating bytes to its actual size
+inline void* _raw_vector_allocate(usize& bytes, bool zeroed) {
+    if (!bytes)
+        return nullptr;
+#if defined _WIN64
+    HANDLE heap = GetProcessHeap();
+    void* p = HeapAlloc(heap, zeroed ? HEAP_ZERO_MEMORY : 0, bytes);
+    bytes = HeapSize(heap, 0, p);
+    return p;
+#elif defined __APPLE__
+    void* p = zeroed ? std::calloc(bytes, 1) : std::malloc(bytes);
+    bytes = malloc_size(p);
+    return p;
+#elif defined __linux__
+    if (bytes >= _RAW_VECTOR_HUGE) {
+        // over-allocate so we can trim to a huge page boundary
+        bytes = _raw_vector_huge_round(bytes);
+        usize n = bytes + _RAW_VECTOR_HUGE;
+        void* p = mmap(nullptr, n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        // (malloc cannot stand in, as deallocation picks munmap by size)
+        if (p == MAP_FAILED)
+            throw std::bad_alloc();
+        unsigned char* a = (unsigned char*) p;
+        unsigned char* b = (unsigned char*) _raw_vector_huge_round((usize) a);
+        if (b != a)
+            munmap(a, b - a);
+        if (b + bytes != a + n)
+            munmap(b + bytes, (a + n) - (b + bytes));
+        madvise(b, bytes, MADV_HUGEPAGE);
+        return b;
+    }
+    return zeroed ? std::calloc(bytes, 1) : std::malloc(bytes);
+#else
+    return zeroed ? std::calloc(bytes, 1) : std::malloc(bytes);
+#endif
+}
+
+// bytes is the size reported by _raw_vector_allocate, or a value that rounds
+// to the same number of huge pages
+inline void _raw_vector_deallocate(void* p, usize bytes) {
+#if defined _WIN64
+    HeapFree(GetProcessHeap(), 0, p);
+#elif defined __linux__
+    if (bytes >= _RAW_VECTOR_HUGE)
+        munmap(p, _raw_vector_huge_round(bytes));
+    else
+        std::free(p);
+#else
+    std::free(p);
+#endif
+}
+
+// raw_vector manages a slab of raw memory, zeroed unless constructed with
+// uninitialized.  It will free the memory on destruction, but will not
+// attempt to construct or destruct any objects in the memory.  It must be
+// combined with some external management to determine which slots are
+// occupied; a std::vector maintains a _size, partioning occupied and
+// unoccupied slots, for example.
 
 template<typename T>
 struct raw_vector {
@@ -39,33 +114,28 @@ struct raw_vector {
     
     raw_vector(const raw_vector&) = delete;
     raw_vector(raw_vector&& v) : raw_vector() { swap(v); }
-    explicit raw_vector(isize capacity) {
-#if defined _WIN64
-        HANDLE heap = GetProcessHeap();
-        _allocation = (T*) HeapAlloc(heap, HEAP_ZERO_MEMORY, capacity * sizeof(T));
-        _capacity = HeapSize(heap, _allocation) / sizeof(T);
-#elif defined __APPLE__
-        _allocation = (T*) std::calloc(capacity, sizeof(T));
-        _capacity = malloc_size(_allocation) / sizeof(T);
-        assert(_capacity >= capacity);
-#else
-        _allocation = (T*) std::calloc(capacity, sizeof(T));
-        _capacity = capacity;
-#endif
-    }
+    
+    explicit raw_vector(isize capacity) { _allocate(capacity, true); }
+    raw_vector(isize capacity, uninitialized_t) { _allocate(capacity, false); }
+    
+    // ptr must come from std::malloc and be smaller than _RAW_VECTOR_HUGE, or
+    // have been released from another raw_vector
     raw_vector(T* ptr, isize n) : _allocation(ptr), _capacity(n) {}
     
     ~raw_vector() {
-#if defined _WIN64
-        HeapFree(GetProcessHeap(), _allocation);
-#else
-        free(_allocation);
-#endif
+        _raw_vector_deallocate(_allocation, _capacity * sizeof(T));
     }
     
     raw_vector& operator=(const raw_vector&) = delete;
     raw_vector& operator=(raw_vector<T>&&);
     
+    void _allocate(isize capacity, bool zeroed) {
+        usize bytes = capacity * sizeof(T);
+        _allocation = (T*) _raw_vector_allocate(bytes, zeroed);
+        _capacity = bytes / sizeof(T);
+        assert(_capacity >= capacity);
+    }
+    
     void swap(raw_vector& v) {
         using std::swap;
         swap(_allocation, v._allocation);
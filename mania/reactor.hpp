@@ -12,6 +12,13 @@
 #include <unistd.h>
 #include <sys/select.h>
 
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
+
+#include <algorithm>
+#include <cassert>
 #include <functional>
 #include <list>
 #include <map>
@@ -19,19 +26,76 @@
 #include <queue>
 #include <stack>
 #include <thread>
+#include <vector>
 
+#include "common.hpp"
 #include "stack.hpp"
 #include "pool.hpp"
 
 namespace manic {
 
+// Min-heap of timers by deadline, taking new timers in batches
+//
+// Pushing M timers one by one onto a heap of N costs about M log2(N)
+// comparisons, while appending them all and rebuilding costs about 3(N + M);
+// splice picks the cheaper.
+
+struct _timer_heap {
+    
+    std::vector<fn<void()>> _heap;
+    
+    static bool _later(fn<void()> const& a, fn<void()> const& b) {
+        return a->_t > b->_t; // <-- reverse order puts earliest at front
+    }
+    
+    bool empty() const {
+        return _heap.empty();
+    }
+    
+    auto earliest() const {
+        assert(!empty());
+        return _heap.front()->_t;
+    }
+    
+    void splice(stack<fn<void()>> s) {
+        std::size_t n = _heap.size();
+        while (!s.empty())
+            _heap.push_back(s.pop());
+        std::size_t m = _heap.size() - n;
+        if (m * bit_width(_heap.size()) > 3 * _heap.size()) {
+            std::make_heap(_heap.begin(), _heap.end(), _later);
+        } else {
+            for (std::size_t i = n; i != _heap.size(); ++i)
+                std::push_heap(_heap.begin(), _heap.begin() + i + 1, _later);
+        }
+    }
+    
+    // Moves the timers due by now to pending
+    template<typename TimePoint>
+    void expire(TimePoint now, stack<fn<void()>>& pending) {
+        while (!_heap.empty() && _heap.front()->_t <= now) {
+            std::pop_heap(_heap.begin(), _heap.end(), _later);
+            pending.push(std::move(_heap.back()));
+            _heap.pop_back();
+        }
+    }
+    
+}; // struct _timer_heap
+
 struct reactor {
     
-    // portable(?) lock-free reactor using select
-        
-    // todo: there is some threshold at which batch submission to the
-    // priority_queue and rebuilding the heap (3N) beats individually adding
-    // M elements (M ln(N))
+    // lock-free reactor
+    //
+    // On Linux, waits with epoll.  Each fd is registered edge-triggered, once,
+    // and the registration persists across waits, so a wake costs O(events)
+    // rather than O(fds), and is not limited to FD_SETSIZE.  When new waiters
+    // arrive for an fd its registration is modified, which makes the kernel
+    // re-evaluate it and report it again if it is already ready, so waiters
+    // still see level-triggered behaviour, while ready fds that nobody is
+    // waiting on do not wake us.  The earliest timer is armed on a timerfd.
+    //
+    // Elsewhere, waits with select, which is portable(?) but rebuilds the fd
+    // sets each wake.
     
     // undefined behaviour when two waiters on the same fd event (served in
     // reverse order but the first task will race to e.g. read all the data
@@ -49,6 +113,12 @@ struct reactor {
 
     // notification pipe
     int _pipe[2];
+    
+#if defined(__linux__)
+    int _epoll;
+    int _timer; // <-- timerfd armed for the earliest timer
+#endif
+    
     static constexpr std::uint64_t CANCELLED_BIT = 0x8000'0000'0000'0000;
 
     reactor();    
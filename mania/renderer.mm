@@ -37,8 +37,10 @@ struct game : pane::base {
     table3<u64, string> _periodic;
 
     world _thing;
+    command_sender _sender = _thing._commands.sender(0);
     
     vec<i64, 2> _camera_position;
+    vec<i64, 2> _camera_previous;
     string _text;
     
     u64 _selected_opcode;
@@ -61,11 +63,19 @@ struct game : pane::base {
 
 }; // struct game
 
+string path_for_cache(string_view name);
+
 game::game() {
         
     using namespace manic;
+    
+    // Reuse the terrain generated by previous launches, here and in worlds
+    // loaded later
+    terrain_default_store() = std::make_shared<terrain_store>(path_for_cache("terrain.tiles"));
+    _thing._terrain = terrain2(_terrain_generator(0));
         
     _camera_position = 0;
+    _camera_previous = 0;
     _selected_opcode = 0;
     
     using namespace element;
@@ -232,6 +242,11 @@ void game::draw(rect<f32> _ext, manic::draw_proxy* _draw_proxy) {
         i64 x_hi = ((i64) (_camera_position.x + (i64) _ext.b.x + 63)) >> 6;
         i64 y_lo = ((i64) _camera_position.y) >> 6;
         i64 y_hi = ((i64) (_camera_position.y + (i64) _ext.b.y + 63)) >> 6;
+        // Generate the terrain we are about to scroll into on the pool, so
+        // the loop below rarely has to
+        vec<i64, 2> d = _camera_position - _camera_previous;
+        _camera_previous = _camera_position;
+        _thing.prefetch({x_lo, y_lo}, {x_hi, y_hi}, {d.x / 64.0, d.y / 64.0});
         // Perf: we can lookup chunks and then render subsets of them to save
         // hashtable lookups
         for (i64 x = x_lo; x != x_hi; ++x) {
@@ -270,7 +285,7 @@ void game::draw(rect<f32> _ext, manic::draw_proxy* _draw_proxy) {
         for (i64 x = x_lo; x != x_hi; ++x)
             for (i64 y= y_lo; y != y_hi; ++y) {
                 // Perf: look up chunks once and then draw the block
-                u64 k = _thing._board({x, y});
+                u64 k = _thing.read({x, y});
                 blit3(translate(k), {x * 64, y * 64}, *_draw_proxy);
                 if (instruction::is_instruction(k)) {
                     string_view u(_translate_address[(k & 0x7)]);
@@ -457,14 +472,14 @@ bool game::handle_event(rect<f32>, event::key_down* e) {
             if (_selected_opcode) {
                 ++_selected_opcode;
             } else {
-                ++_thing._board({i, j});
+                _sender.add({i, j}, 1);
             }
             break;
         case 'R':
             if (_selected_opcode) {
                 --_selected_opcode;
             } else {
-                --_thing._board({i, j});
+                _sender.add({i, j}, (u64) -1);
             }
             break;
         case 'q': {
@@ -475,9 +490,7 @@ bool game::handle_event(rect<f32>, event::key_down* e) {
             p->x = selectee.x;
             p->y = selectee.y;
             p->s = instruction::newborn;
-            if (is_vacant(_thing._board({p->x, p->y}))) {
-                _thing.push_back(p);
-            }
+            _sender.spawn(p);
         }
             
         default:
@@ -496,7 +509,7 @@ bool game::handle_event(rect<f32> _ext, event::mouse_down* e) {
     } else {
         vec2 world_mouse = e->mouse() + _camera_position;
         vec2 selectee(((i64) world_mouse.x) >> 6, ((i64) world_mouse.y) >> 6);
-        _thing._board({selectee.x, selectee.y}) = 0;
+        _sender.write({selectee.x, selectee.y}, 0);
     }
     return true;
 }
@@ -512,7 +525,7 @@ bool game::handle_event(rect<f32> _ext, event::mouse_up* e) {
         if (_selected_opcode) {
             vec2 world_mouse = e->mouse() + _camera_position;
             vec2 selectee(((i64) world_mouse.x) >> 6, ((i64) world_mouse.y) >> 6);
-            _thing._board({selectee.x, selectee.y}) = _selected_opcode;
+            _sender.write({selectee.x, selectee.y}, _selected_opcode);
             std::cout << "writing" << std::hex << _selected_opcode << std::endl;
         }
     }
@@ -0,0 +1,237 @@
+//
+//  segmented_vector.hpp
+//  mania
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#ifndef segmented_vector_hpp
+#define segmented_vector_hpp
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <iterator>
+#include <memory>
+#include <utility>
+
+#include "common.hpp"
+
+namespace manic {
+
+// Dynamic array stored as a sequence of geometrically growing blocks.
+//
+// Block k holds B << k elements, so element i lives in block
+// floor(log2(i + B)) - log2(B), and indexing is a count-leading-zeros and a
+// lookup in a fixed table of block pointers.  Growth allocates a new block
+// and never moves existing elements, so pointers and references remain valid
+// until the element is removed, and push_back has no O(N) latency spikes.
+//
+// Elements are not contiguous; there is no data() and iterators are not
+// pointers.
+
+template<typename T>
+struct segmented_vector {
+
+    enum : isize {
+        LOG2_B = 4,
+        B = isize(1) << LOG2_B,
+        BLOCKS = 64 - LOG2_B,
+    };
+
+    T* _blocks[BLOCKS];
+    isize _size;
+    isize _allocated; // <-- number of blocks allocated
+
+    static isize _capacity_of(isize blocks) {
+        return B * ((isize(1) << blocks) - 1);
+    }
+
+    static std::pair<isize, isize> _locate(isize i) {
+        assert(i >= 0);
+        u64 j = (u64) i + B;
+        isize k = 63 - __builtin_clzll(j);
+        return { k - LOG2_B, (isize) (j - ((u64) 1 << k)) };
+    }
+
+    T* _address(isize i) const {
+        auto [k, j] = _locate(i);
+        assert(k < _allocated);
+        return _blocks[k] + j;
+    }
+
+    T* _reserve_back() {
+        auto [k, j] = _locate(_size);
+        if (k == _allocated) {
+            _blocks[k] = (T*) std::malloc(sizeof(T) * (B << k));
+            assert(_blocks[k]);
+            ++_allocated;
+        }
+        return _blocks[k] + j;
+    }
+
+    segmented_vector() : _size(0), _allocated(0) {}
+
+    segmented_vector(segmented_vector const& other) : segmented_vector() {
+        reserve(other._size);
+        for (isize i = 0; i != other._size; ++i)
+            push_back(other[i]);
+    }
+
+    segmented_vector(segmented_vector&& other)
+    : _size(std::exchange(other._size, 0))
+    , _allocated(std::exchange(other._allocated, 0)) {
+        std::copy(other._blocks, other._blocks + _allocated, _blocks);
+    }
+
+    ~segmented_vector() {
+        clear();
+        for (isize k = 0; k != _allocated; ++k)
+            std::free(_blocks[k]);
+    }
+
+    segmented_vector& operator=(segmented_vector const& other) {
+        if (this != &other)
+            segmented_vector(other).swap(*this);
+        return *this;
+    }
+
+    segmented_vector& operator=(segmented_vector&& other) {
+        segmented_vector(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    void swap(segmented_vector& other) {
+        using std::swap;
+        // block pointers beyond _allocated are uninitialized; swap the
+        // common prefix and copy the rest across
+        isize n = std::min(_allocated, other._allocated);
+        std::swap_ranges(_blocks, _blocks + n, other._blocks);
+        if (_allocated > n)
+            std::copy(_blocks + n, _blocks + _allocated, other._blocks + n);
+        else
+            std::copy(other._blocks + n, other._blocks + other._allocated, _blocks + n);
+        swap(_size, other._size);
+        swap(_allocated, other._allocated);
+    }
+
+    isize size() const { return _size; }
+    bool empty() const { return !_size; }
+    isize capacity() const { return _capacity_of(_allocated); }
+
+    T& operator[](isize i) {
+        assert(0 <= i && i < _size);
+        return *_address(i);
+    }
+
+    T const& operator[](isize i) const {
+        assert(0 <= i && i < _size);
+        return *_address(i);
+    }
+
+    T& front() { return (*this)[0]; }
+    T const& front() const { return (*this)[0]; }
+    T& back() { return (*this)[_size - 1]; }
+    T const& back() const { return (*this)[_size - 1]; }
+
+    void reserve(isize n) {
+        while (capacity() < n) {
+            _blocks[_allocated] = (T*) std::malloc(sizeof(T) * (B << _allocated));
+            assert(_blocks[_allocated]);
+            ++_allocated;
+        }
+    }
+
+    // Release blocks wholly beyond size()
+    void shrink_to_fit() {
+        while (_allocated && _capacity_of(_allocated - 1) >= _size)
+            std::free(_blocks[--_allocated]);
+    }
+
+    void clear() {
+        while (_size)
+            pop_back();
+    }
+
+    template<typename... Args>
+    T& emplace_back(Args&&... args) {
+        T* p = new (_reserve_back()) T(std::forward<Args>(args)...);
+        ++_size;
+        return *p;
+    }
+
+    void push_back(T const& x) { emplace_back(x); }
+    void push_back(T&& x) { emplace_back(std::move(x)); }
+
+    T pop_back() {
+        assert(_size);
+        T* p = _address(--_size);
+        T t(std::move(*p));
+        p->~T();
+        return t;
+    }
+
+    // O(1) unordered removal; only the last element moves
+    T swap_remove(isize i) {
+        using std::swap;
+        swap((*this)[i], back());
+        return pop_back();
+    }
+
+    template<typename U>
+    struct _iterator {
+
+        using difference_type = isize;
+        using value_type = std::remove_const_t<U>;
+        using pointer = U*;
+        using reference = U&;
+        using iterator_category = std::random_access_iterator_tag;
+
+        segmented_vector const* _vector;
+        isize _index;
+
+        U& operator*() const { return *_vector->_address(_index); }
+        U* operator->() const { return _vector->_address(_index); }
+        U& operator[](isize n) const { return *_vector->_address(_index + n); }
+
+        _iterator& operator++() { ++_index; return *this; }
+        _iterator& operator--() { --_index; return *this; }
+        _iterator operator++(int) { return _iterator{_vector, _index++}; }
+        _iterator operator--(int) { return _iterator{_vector, _index--}; }
+        _iterator& operator+=(isize n) { _index += n; return *this; }
+        _iterator& operator-=(isize n) { _index -= n; return *this; }
+        _iterator operator+(isize n) const { return _iterator{_vector, _index + n}; }
+        friend _iterator operator+(isize n, _iterator const& x) { return x + n; }
+        _iterator operator-(isize n) const { return _iterator{_vector, _index - n}; }
+        isize operator-(_iterator const& other) const { return _index - other._index; }
+
+        bool operator==(_iterator const& other) const { return _index == other._index; }
+        bool operator!=(_iterator const& other) const { return _index != other._index; }
+        bool operator<(_iterator const& other) const { return _index < other._index; }
+        bool operator>(_iterator const& other) const { return _index > other._index; }
+        bool operator<=(_iterator const& other) const { return _index <= other._index; }
+        bool operator>=(_iterator const& other) const { return _index >= other._index; }
+
+        operator _iterator<U const>() const { return {_vector, _index}; }
+
+    };
+
+    using iterator = _iterator<T>;
+    using const_iterator = _iterator<T const>;
+
+    iterator begin() { return iterator{this, 0}; }
+    iterator end() { return iterator{this, _size}; }
+    const_iterator begin() const { return const_iterator{this, 0}; }
+    const_iterator end() const { return const_iterator{this, _size}; }
+
+};
+
+template<typename T>
+void swap(segmented_vector<T>& a, segmented_vector<T>& b) {
+    a.swap(b);
+}
+
+} // namespace manic
+
+#endif /* segmented_vector_hpp */
@@ -0,0 +1,215 @@
+//
+//  slab.hpp
+//  mania
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#ifndef slab_hpp
+#define slab_hpp
+
+#include <cassert>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "common.hpp"
+#include "mutex.hpp"
+
+namespace manic {
+
+// Slab allocator for small, short-lived objects such as fn nodes
+//
+// Sizes up to MAX_SIZE are rounded up to a multiple of GRANULE, giving
+// CLASSES size classes.  Each thread keeps a free list per class, and
+// allocates and frees on it without atomics.  A block may be freed by a
+// thread other than the one that allocated it (the usual case for jobs
+// handed to a pool); it then joins the freeing thread's list.  When a list
+// grows past 2 * BATCH, BATCH blocks are moved as one batch to a global
+// list, and a thread whose list is empty takes a whole batch back before
+// carving a new slab, so the global lock is taken once per BATCH
+// operations at most.
+//
+// Slabs are never returned to the system; the population of blocks is
+// bounded by the peak number of live objects plus the per-thread caches.
+// Exiting threads return their caches to the global lists.
+
+namespace slab {
+
+enum : usize {
+    GRANULE = 16,
+    CLASSES = 16,
+    MAX_SIZE = GRANULE * CLASSES,
+    BATCH = 64,
+    SLAB_SIZE = 1 << 16,
+};
+
+struct _block {
+    _block* _next;
+};
+
+struct _list {
+
+    _block* _head = nullptr;
+    isize _size = 0;
+
+    void push(_block* b) {
+        b->_next = _head;
+        _head = b;
+        ++_size;
+    }
+
+    _block* pop() {
+        assert(_head);
+        --_size;
+        return std::exchange(_head, _head->_next);
+    }
+
+    // Split off the last n blocks, which are the least recently freed
+    _list split(isize n) {
+        assert(0 < n && n < _size);
+        _block* b = _head;
+        for (isize i = _size - n; --i;)
+            b = b->_next;
+        _list a;
+        a._head = std::exchange(b->_next, nullptr);
+        a._size = n;
+        _size -= n;
+        return a;
+    }
+
+};
+
+inline usize _class(usize n) {
+    assert(0 < n && n <= MAX_SIZE);
+    return (n - 1) / GRANULE;
+}
+
+struct _global {
+
+    ::mutex<std::vector<_list>> _batches[CLASSES];
+
+    static _global const& get() {
+        // deliberately leaked, with the slabs
+        static _global* p = new _global;
+        return *p;
+    }
+
+    void push(usize c, _list a) const {
+        if (a._size)
+            std::as_const(_batches[c]).lock()->push_back(a);
+    }
+
+    _list pop(usize c) const {
+        auto g = std::as_const(_batches[c]).lock();
+        if (g->empty())
+            return _list{};
+        _list a = g->back();
+        g->pop_back();
+        return a;
+    }
+
+};
+
+// Carve a fresh slab into blocks of class c
+inline _list _carve(usize c) {
+    usize n = (c + 1) * GRANULE;
+    auto p = static_cast<unsigned char*>(::operator new(SLAB_SIZE, std::align_val_t{64}));
+    _list a;
+    for (usize i = SLAB_SIZE / n; i--;)
+        a.push(reinterpret_cast<_block*>(p + i * n));
+    return a;
+}
+
+struct _cache {
+
+    // trivially destructible, so it can be consulted during and after the
+    // destruction of the cache at thread exit
+    static inline thread_local bool _dead = false;
+
+    _list _free[CLASSES];
+
+    ~_cache() {
+        for (usize c = 0; c != CLASSES; ++c)
+            _global::get().push(c, std::exchange(_free[c], _list{}));
+        _dead = true;
+    }
+
+    static _cache* get() {
+        if (_dead)
+            return nullptr;
+        thread_local _cache cache;
+        return &cache;
+    }
+
+    void* allocate(usize c) {
+        _list& a = _free[c];
+        if (!a._size) {
+            a = _global::get().pop(c);
+            if (!a._size)
+                a = _carve(c);
+        }
+        return a.pop();
+    }
+
+    void deallocate(usize c, void* p) {
+        _list& a = _free[c];
+        a.push(static_cast<_block*>(p));
+        if (a._size > (isize) (2 * BATCH))
+            _global::get().push(c, a.split(BATCH));
+    }
+
+};
+
+inline void* allocate(usize n) {
+    if (n > MAX_SIZE)
+        return ::operator new(n);
+    usize c = _class(n);
+    if (_cache* p = _cache::get())
+        return p->allocate(c);
+    // (during thread exit)
+    _list a = _global::get().pop(c);
+    if (!a._size)
+        a = _carve(c);
+    void* q = a.pop();
+    _global::get().push(c, a);
+    return q;
+}
+
+// n must be the size passed to allocate
+inline void deallocate(void* p, usize n) {
+    if (n > MAX_SIZE)
+        return ::operator delete(p);
+    usize c = _class(n);
+    if (_cache* q = _cache::get())
+        return q->deallocate(c, p);
+    // (during thread exit)
+    _list a;
+    a.push(static_cast<_block*>(p));
+    _global::get().push(c, a);
+}
+
+// Blocks are aligned to GRANULE, which is at least what operator new
+// guarantees (and what coroutine frames assume); stricter alignments
+// bypass the slabs
+static_assert(GRANULE >= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+
+inline void* allocate(usize n, std::align_val_t a) {
+    if ((usize) a <= GRANULE)
+        return allocate(n);
+    return ::operator new(n, a);
+}
+
+// n and a must be those passed to allocate
+inline void deallocate(void* p, usize n, std::align_val_t a) {
+    if ((usize) a <= GRANULE)
+        return deallocate(p, n);
+    ::operator delete(p, a);
+}
+
+} // namespace slab
+
+} // namespace manic
+
+#endif /* slab_hpp */
@@ -0,0 +1,203 @@
+//
+//  small_vector.hpp
+//  mania
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#ifndef small_vector_hpp
+#define small_vector_hpp
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+#include "common.hpp"
+
+namespace manic {
+
+// Dynamic array with inline storage for up to N elements, spilling to the
+// heap only when it grows beyond them.
+//
+// Unlike most small-buffer vectors, we do not store a pointer to the current
+// storage (which would point into ourself when inline); instead, _capacity
+// discriminates the inline and heap cases.  The small_vector is therefore
+// Relocatable (see relocate.hpp) if T is, and may be memcpy'd about by
+// containers such as table3 and vector.
+
+template<typename T, isize N>
+struct small_vector {
+
+    static_assert(N > 0);
+
+    isize _size;
+    isize _capacity; // <-- N when inline, > N when on the heap
+    union {
+        T* _heap;
+        alignas(T) unsigned char _inline[N * sizeof(T)];
+    };
+
+    bool _is_inline() const { return _capacity == N; }
+
+    T* _allocation() const {
+        return _is_inline() ? (T*) _inline : _heap;
+    }
+
+    // Relocate to storage for at least n elements
+    void _grow(isize n) {
+        assert(n > _capacity);
+        isize m = std::max(n, _capacity * 2);
+        T* p = (T*) std::malloc(m * sizeof(T));
+        assert(p);
+        std::memcpy(p, _allocation(), _size * sizeof(T));
+        if (!_is_inline())
+            std::free(_heap);
+        _heap = p;
+        _capacity = m;
+    }
+
+    void _reserve_back(isize n) {
+        if (_capacity - _size < n)
+            _grow(_size + n);
+    }
+
+    small_vector() : _size(0), _capacity(N) {}
+
+    small_vector(small_vector const& other) : small_vector() {
+        append(other.begin(), other.end());
+    }
+
+    small_vector(small_vector&& other) {
+        // relocate other's representation, then reset it
+        std::memcpy((void*) this, &other, sizeof(small_vector));
+        other._size = 0;
+        other._capacity = N;
+    }
+
+    ~small_vector() {
+        std::destroy_n(_allocation(), _size);
+        if (!_is_inline())
+            std::free(_heap);
+    }
+
+    small_vector& operator=(small_vector const& other) {
+        if (this != &other) {
+            clear();
+            append(other.begin(), other.end());
+        }
+        return *this;
+    }
+
+    small_vector& operator=(small_vector&& other) {
+        small_vector(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    void swap(small_vector& other) {
+        alignas(small_vector) unsigned char tmp[sizeof(small_vector)];
+        std::memcpy(tmp, (void*) this, sizeof(small_vector));
+        std::memcpy((void*) this, &other, sizeof(small_vector));
+        std::memcpy((void*) &other, tmp, sizeof(small_vector));
+    }
+
+    isize size() const { return _size; }
+    bool empty() const { return !_size; }
+    isize capacity() const { return _capacity; }
+
+    T* data() { return _allocation(); }
+    T const* data() const { return _allocation(); }
+
+    T* begin() { return _allocation(); }
+    T* end() { return _allocation() + _size; }
+    T const* begin() const { return _allocation(); }
+    T const* end() const { return _allocation() + _size; }
+
+    T& operator[](isize i) {
+        assert(0 <= i && i < _size);
+        return _allocation()[i];
+    }
+
+    T const& operator[](isize i) const {
+        assert(0 <= i && i < _size);
+        return _allocation()[i];
+    }
+
+    T& front() { return (*this)[0]; }
+    T const& front() const { return (*this)[0]; }
+    T& back() { return (*this)[_size - 1]; }
+    T const& back() const { return (*this)[_size - 1]; }
+
+    void reserve(isize n) {
+        if (n > _capacity)
+            _grow(n);
+    }
+
+    void clear() {
+        std::destroy_n(_allocation(), _size);
+        _size = 0;
+    }
+
+    template<typename... Args>
+    T& emplace_back(Args&&... args) {
+        _reserve_back(1);
+        T* p = new (_allocation() + _size) T(std::forward<Args>(args)...);
+        ++_size;
+        return *p;
+    }
+
+    void push_back(T const& x) { emplace_back(x); }
+    void push_back(T&& x) { emplace_back(std::move(x)); }
+
+    T pop_back() {
+        assert(_size);
+        T* p = _allocation() + --_size;
+        T t(std::move(*p));
+        p->~T();
+        return t;
+    }
+
+    // O(N); prefer iterating and then clearing
+    T pop_front() {
+        assert(_size);
+        T* p = _allocation();
+        T t(std::move(*p));
+        p->~T();
+        std::memmove((void*) p, p + 1, --_size * sizeof(T));
+        return t;
+    }
+
+    T swap_remove(isize i) {
+        using std::swap;
+        swap((*this)[i], back());
+        return pop_back();
+    }
+
+    void erase(isize i) {
+        assert(0 <= i && i < _size);
+        T* p = _allocation() + i;
+        p->~T();
+        std::memmove((void*) p, p + 1, (--_size - i) * sizeof(T));
+    }
+
+    template<typename It>
+    void append(It first, It last) {
+        _reserve_back(std::distance(first, last));
+        T* p = _allocation() + _size;
+        for (; first != last; ++first, ++p, ++_size)
+            new (p) T(*first);
+    }
+
+};
+
+template<typename T, isize N>
+void swap(small_vector<T, N>& a, small_vector<T, N>& b) {
+    a.swap(b);
+}
+
+} // namespace manic
+
+#endif /* small_vector_hpp */
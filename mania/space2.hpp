@@ -9,6 +9,7 @@
 #ifndef space2_hpp
 #define space2_hpp
 
+#include "hamt.hpp"
 #include "table3.hpp"
 #include "vec.hpp"
 #include "matrix.hpp"
@@ -66,6 +67,7 @@ struct _dumb_matrix {
     }
     
     T& operator()(vec<i64, 2> xy) { return *(_ptr + xy.x * 16 + xy.y); }
+    T const& operator()(vec<i64, 2> xy) const { return *(_ptr + xy.x * 16 + xy.y); }
     
 };
     
@@ -101,15 +103,19 @@ struct _space2_inline {
         return _space2_inline<T>{};
     }
 
-    
-template<typename F>
+
+// Table may be table3, for the fastest access, or hamt, when we want to take
+// O(1) snapshots of the chunks for saving, replay or rendering on another
+// thread
+
+template<typename F, template<typename, typename> typename Table = table3>
 struct space2 {
     
     using M = std::decay_t<decltype(std::declval<F>()(std::declval<vec<i64, 2>>())())>;
     using T = std::decay_t<decltype(std::declval<M>()(std::declval<vec<i64, 2>>()))>;
     
     F _generator;
-    table3<vec<i64, 2>, M> _table;
+    Table<vec<i64, 2>, M> _table;
         
     static constexpr i64 N = 16;
     static constexpr i64 MASK = N - 1;
@@ -142,7 +148,14 @@ struct space2 {
     
     T* try_get(vec<i64, 2> xy) {
         M* p = _table.try_get(_high(xy));
-        return p ? (*p)(_low(xy)) : nullptr;
+        return p ? &(*p)(_low(xy)) : nullptr;
+    }
+
+    // Neither generates nor, for a persistent Table, copies the chunk;
+    // nullptr if the chunk has not been generated
+    T const* try_get(vec<i64, 2> xy) const {
+        M const* p = _table.try_get(_high(xy));
+        return p ? &(*p)(_low(xy)) : nullptr;
     }
     
     T& get(vec<i64, 2> xy) {
@@ -153,17 +166,23 @@ struct space2 {
         return get(xy);
     }
     
+    // Requires a persistent Table; the chunks are shared with the snapshot
+    // until the next write to each of them
+    Table<vec<i64, 2>, M> snapshot() const {
+        return _table.snapshot();
+    }
+    
 }; // struct space2
     
-    template<typename F, typename Serializer>
-    void serialize(space2<F>& x, Serializer& s) {
+    template<typename F, template<typename, typename> typename Table, typename Serializer>
+    void serialize(space2<F, Table>& x, Serializer& s) {
         serialize(x._generator, s);
         serialize(x._table, s);
     }
     
-    template<typename F, typename Deserializer>
-    void deserialize(placeholder<space2<F>>, Deserializer& d) {
-        space2<F> x{deserialize<F>(d)};
+    template<typename F, template<typename, typename> typename Table, typename Deserializer>
+    void deserialize(placeholder<space2<F, Table>>, Deserializer& d) {
+        space2<F, Table> x{deserialize<F>(d)};
         x._table = deserialize<decltype(x._table)>(d);
     }
 
@@ -152,6 +152,11 @@ struct stack<fn<R(Args...)>> {
         return stack{_head.exchange(0, std::memory_order_acquire)};
     }
 
+    // a snapshot, under concurrent modification
+    bool empty() const {
+        return !(_head.load(std::memory_order_relaxed) & detail::PTR);
+    }
+
     void wait() = delete;
     void wait() const {
         _head.wait(0, std::memory_order_acquire);
@@ -175,7 +175,7 @@ struct table3 {
     
     usize _capacity_for_occupants(usize n) {
         // table resizes when 2/3 full.  tuning point.
-        return n ? std::ceil2(n + (n >> 1) + 1) : 0;
+        return n ? bit_ceil(n + (n >> 1) + 1) : 0;
     }
     
     template<typename Q>
@@ -184,7 +184,7 @@ struct table3 {
     }
     
     void _assert_invariant() const {
-        assert(std::ispow2((std::size_t) _vector._capacity) || !_vector._capacity);
+        assert(has_single_bit((std::size_t) _vector._capacity) || !_vector._capacity);
         assert(!_vector._capacity || (_occupants < _vector._capacity));
         usize n = 0;
         for (usize i = 0; i != _vector._capacity; ++i) {
@@ -370,6 +370,16 @@ struct table3 {
         return try_get(std::forward<Q>(k), hash(k));
     }
 
+    template<typename Q>
+    value_type const* try_get(Q&& k, u64 h) const {
+        return const_cast<table3*>(this)->try_get(std::forward<Q>(k), h);
+    }
+
+    template<typename Q>
+    value_type const* try_get(Q&& k) const {
+        return try_get(std::forward<Q>(k), hash(k));
+    }
+
     // preconditions: contains(k), h == hash(k)
     template<typename Q>
     value_type& _get_unsafe(Q&& k, u64 h) const {
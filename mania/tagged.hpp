@@ -348,17 +348,17 @@ public:
     
     void wait(TaggedPtr<T>, std::memory_order) noexcept = delete;
     void wait(TaggedPtr<T> old, std::memory_order order) const noexcept {
-        std::atomic_wait_explicit(&_atomic, old._raw, order);
+        parking_lot_wait(&_atomic, old._raw, order);
     }
     
     void notify_one() noexcept = delete;
     void notify_one() const noexcept {
-        std::atomic_notify_one(&_atomic);
+        parking_lot_notify(&_atomic, false);
     }
     
     void notify_all() noexcept = delete;
     void notify_all() const noexcept {
-        std::atomic_notify_all(&_atomic);
+        parking_lot_notify(&_atomic, true);
     }
     
 };
@@ -0,0 +1,161 @@
+//
+//  task_graph.hpp
+//  mania
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#ifndef task_graph_hpp
+#define task_graph_hpp
+
+#include <cassert>
+#include <chrono>
+#include <utility>
+#include <vector>
+
+#include "atomic.hpp"
+#include "common.hpp"
+#include "fn.hpp"
+#include "pool.hpp"
+
+namespace manic {
+
+// Static dependency graph of jobs, run in parallel on the pool
+//
+// Build the graph once per frame shape, with add and precede, and run it
+// every frame.  A node becomes ready when the last of its predecessors
+// completes, as counted down on an atomic; that thread then runs one ready
+// successor itself, continuing the chain without going through the pool,
+// and submits any others, which idle workers steal.  There are no barriers
+// between stages: express a per-chunk pipeline as a chain per chunk, and
+// the later stages of one chunk overlap the earlier stages of the next.
+//
+// Each node records how long its job took on the last run.
+//
+// run blocks, so call it from outside the pool (the main or render thread),
+// and not concurrently with itself.
+
+struct task_graph {
+
+    struct _node {
+
+        char const* _name;
+        mutable fn<void()> _job; // <-- called through mut_call, so it survives for the next run
+        std::vector<isize> _successors;
+        isize _predecessors = 0;
+        Atomic<isize> _pending; // <-- predecessors yet to complete this run
+        Atomic<i64> _nanoseconds; // <-- duration of the job on the last run
+
+        _node(char const* name, fn<void()> job)
+        : _name(name)
+        , _job(std::move(job))
+        , _pending(0)
+        , _nanoseconds(0) {
+        }
+
+    };
+
+    std::vector<_node> _nodes;
+    Atomic<isize> _remaining; // <-- nodes yet to complete this run
+
+    task_graph() : _remaining(0) {}
+
+    task_graph(task_graph const&) = delete;
+
+    task_graph& operator=(task_graph const&) = delete;
+
+    isize size() const {
+        return (isize) _nodes.size();
+    }
+
+    // Returns the index of the new node
+    isize add(char const* name, fn<void()> job) {
+        _nodes.emplace_back(name, std::move(job));
+        return size() - 1;
+    }
+
+    // a must complete before b starts
+    void precede(isize a, isize b) {
+        assert(0 <= a && a < size() && 0 <= b && b < size() && a != b);
+        _nodes[a]._successors.push_back(b);
+        ++_nodes[b]._predecessors;
+    }
+
+    char const* name(isize i) const {
+        return _nodes[i]._name;
+    }
+
+    std::chrono::nanoseconds elapsed(isize i) const {
+        return std::chrono::nanoseconds(_nodes[i]._nanoseconds.load(std::memory_order_relaxed));
+    }
+
+    // Kahn's algorithm
+    bool is_acyclic() const {
+        std::vector<isize> n(_nodes.size());
+        std::vector<isize> ready;
+        for (isize i = 0; i != size(); ++i)
+            if (!(n[i] = _nodes[i]._predecessors))
+                ready.push_back(i);
+        isize count = 0;
+        while (!ready.empty()) {
+            isize i = ready.back();
+            ready.pop_back();
+            ++count;
+            for (isize j : _nodes[i]._successors)
+                if (!--n[j])
+                    ready.push_back(j);
+        }
+        return count == size();
+    }
+
+    void _submit(isize i) const {
+        pool_submit_one([this, i] { _execute(i); });
+    }
+
+    void _execute(isize i) const {
+        while (i >= 0) {
+            _node const& a = _nodes[i];
+            auto t0 = std::chrono::steady_clock::now();
+            a._job->mut_call();
+            auto t1 = std::chrono::steady_clock::now();
+            a._nanoseconds.store(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count(),
+                                 std::memory_order_relaxed);
+            // keep the first ready successor, and give the rest away
+            isize next = -1;
+            for (isize j : a._successors) {
+                if (_nodes[j]._pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    if (next < 0)
+                        next = j;
+                    else
+                        _submit(j);
+                }
+            }
+            if (_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                _remaining.notify_all();
+            i = next;
+        }
+    }
+
+    void run() const {
+        assert(is_acyclic());
+        if (_nodes.empty())
+            return;
+        for (_node const& a : _nodes)
+            a._pending.store(a._predecessors, std::memory_order_relaxed);
+        _remaining.store(size(), std::memory_order_relaxed);
+        // (the pool's submission publishes the stores above)
+        stack<fn<void()>> roots;
+        for (isize i = 0; i != size(); ++i)
+            if (!_nodes[i]._predecessors)
+                roots.push([this, i] { _execute(i); });
+        pool_submit_many(std::move(roots));
+        for (isize n; (n = _remaining.load(std::memory_order_acquire));)
+            _remaining.wait(n, std::memory_order_acquire);
+    }
+
+}; // struct task_graph
+
+} // namespace manic
+
+#endif /* task_graph_hpp */
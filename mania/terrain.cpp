@@ -8,30 +8,27 @@
 
 #include "terrain.hpp"
 
+#include <vector>
+
 #include "hash.hpp"
 #include "vector.hpp"
 #include "debug.hpp"
 
 namespace manic {
 
-double _terrain_noise(uint64_t seed, ptrdiff_t i, ptrdiff_t j) {
-    // generate uniform between [-1.0, +1.0)
-    seed = hash(hash(seed ^ i) ^ j);
-    auto x = static_cast<int64_t>(seed) * pow(2.0, -63);
-    //std::cout << "sample " << x << std::endl;
-    return x;
-}
-
 void _terrain_perturb(uint64_t seed, ptrdiff_t i, ptrdiff_t j, matrix_view<double> a) {
+    // adds the noise hash(hash(seed ^ i) ^ j) as uniform on [-1.0, +1.0), a
+    // row segment at a time
+    u64 h[64];
     for (ptrdiff_t s = 0; s != a.rows(); ++s)
-        for (ptrdiff_t t = 0; t != a.columns(); ++t)
-            a(s, t) += _terrain_noise(seed, i + s, j + t);
+        for (ptrdiff_t t = 0; t < a.columns(); t += 64) {
+            ptrdiff_t n = std::min<ptrdiff_t>(64, a.columns() - t);
+            hash_row(seed, i + s, j + t, h, n);
+            for (ptrdiff_t k = 0; k != n; ++k)
+                a(s, t + k) += static_cast<int64_t>(h[k]) * pow(2.0, -63);
+        }
 }
 
-// TODO: When we are filtering the exploded values, 5/8ths of the values we
-// encounter are zeros!  We can do better if we make a combined explode-filter-
-// into-transpose operation we call twice.
-
 // TODO: For tiling purposes we sometimes want to only generate nonzero values
 // in some region (but still filter them into an expanded region).
 
@@ -40,7 +37,7 @@ void _terrain_perturb(uint64_t seed, ptrdiff_t i, ptrdiff_t j, matrix_view<doubl
 
 // TODO: Compute the variance of the output (or normalize it).
 
-// TODO: Integer arithmetic?
+// (terrain_fixed, below, is the bit-exact integer version of this pipeline)
 
 void _terrain_recurse(ptrdiff_t i,
                       ptrdiff_t j,
@@ -84,26 +81,12 @@ void _terrain_recurse(ptrdiff_t i,
     
     std::cout << "variance of samples before filter " << variance(a) << std::endl;
     
-    // Double size
-    b.discard_and_resize(a.rows() * 2, a.columns() * 2);
-    b = 0.0;
-    explode(b, a);
-    
-    // Account for rounding in higher coordinates
-    b.crop(i - i2 * 2, j - j2 * 2, rows, columns);
-    
-    // Low-pass filter by ping-pong
-    a.discard_and_resize(b.rows(), b.columns() - filter.size());
-    a = 0.0;
-    assert(a._invariant());
-    assert(b._invariant());
-    filter_rows(a, b, filter);
-    b.discard_and_resize(a.rows() - filter.size(), a.columns());
-    b = 0.0;
-    filter_columns(b, a, filter);
-    
-    // Prepare output
-    swap(a, b);
+    // Double size and low-pass filter each axis, accounting for rounding in
+    // higher coordinates
+    b.discard_and_resize(columns - filter.size(), a.rows());
+    explode_filter_transpose(b, a, j - j2 * 2, filter);
+    a.discard_and_resize(rows - filter.size(), b.rows());
+    explode_filter_transpose(a, b, i - i2 * 2, filter);
     
     //std::cout << "min: " << min(a) << std::endl;
     //std::cout << "max: " << max(a) << std::endl;
@@ -115,16 +98,7 @@ void _terrain_recurse(ptrdiff_t i,
 
 }
 
-matrix<double> terrain(ptrdiff_t i,
-                       ptrdiff_t j,
-                       ptrdiff_t rows,
-                       ptrdiff_t columns,
-                       uint64_t seed) {
-    
-    timer _("terrain");
-    
-    // Deterministically generate terrain of given region
-    
+vector<double> _terrain_filter() {
     vector<double> filter(16);
     for (ptrdiff_t i = 0; i != 16; ++i) {
         filter[i] = exp(-sqr(i - 7.5) / 8.0);
@@ -136,6 +110,21 @@ matrix<double> terrain(ptrdiff_t i,
     //      2.0: expanding the image 2x2 reduces the slopes by 2
     //           (this is implicitly a choice about the shape of the power
     //           spectrum)
+    return filter;
+}
+
+matrix<double> terrain(ptrdiff_t i,
+                       ptrdiff_t j,
+                       ptrdiff_t rows,
+                       ptrdiff_t columns,
+                       uint64_t seed,
+                       ptrdiff_t depth) {
+    
+    timer _("terrain");
+    
+    // Deterministically generate terrain of given region
+    
+    vector<double> filter = _terrain_filter();
     
     
     {
@@ -159,7 +148,7 @@ matrix<double> terrain(ptrdiff_t i,
     matrix<double> a;
     matrix<double> b;
     
-    _terrain_recurse(i, j, rows, columns, filter, 1, a, b, hash(seed));
+    _terrain_recurse(i, j, rows, columns, filter, depth, a, b, hash(seed));
     // we defensively hashed the seed
     
     /*
@@ -179,4 +168,270 @@ matrix<double> terrain(ptrdiff_t i,
     return a;
 }
 
+// Fixed-point pipeline
+//
+// Every operation of terrain_fixed and terrain_cache's tiles is on integers,
+// and C++20 defines the signed shifts as arithmetic, so the results are the
+// same on every compiler and host.
+
+// The taps of _terrain_filter in TERRAIN_FILTER_BITS fixed point, baked here
+// rather than computed so that no host's exp() is involved
+vector<i32> _terrain_filter_fixed() {
+    static constexpr i32 taps[16] = {
+        1, 3, 13, 46, 125, 265, 436, 560, 560, 436, 265, 125, 46, 13, 3, 1,
+    };
+    vector<i32> filter(16);
+    std::copy(std::begin(taps), std::end(taps), filter.begin());
+    return filter;
+}
+
+void _terrain_perturb(u64 seed, i64 i, i64 j, matrix_view<i32> a) {
+    // adds the noise (i64) hash(hash(seed ^ i) ^ j) >> (63 -
+    // TERRAIN_FRACTION_BITS), uniform on [-1.0, +1.0) in that fixed point, a
+    // row segment at a time
+    u64 h[64];
+    for (i64 s = 0; s != a.rows(); ++s)
+        for (i64 t = 0; t < a.columns(); t += 64) {
+            i64 n = std::min<i64>(64, a.columns() - t);
+            hash_row(seed, i + s, j + t, h, n);
+            for (i64 k = 0; k != n; ++k)
+                a(s, t + k) += (i32) ((i64) h[k] >> (63 - TERRAIN_FRACTION_BITS));
+        }
+}
+
+matrix<i32> _terrain_fixed_recurse(i64 i,
+                                   i64 j,
+                                   i64 rows,
+                                   i64 columns,
+                                   const_vector_view<i32> filter,
+                                   isize depth,
+                                   u64 seed) {
+    
+    if (!depth)
+        return matrix<i32>(rows, columns); // <-- zeros
+    
+    i64 n = filter.size();
+    i -= n / 2;
+    j -= n / 2;
+    rows += n;
+    columns += n;
+    
+    i64 i2 = i >> 1;
+    i64 j2 = j >> 1;
+    i64 rows2 = ((i + rows + 1) >> 1) - i2;
+    i64 columns2 = ((j + columns + 1) >> 1) - j2;
+    
+    matrix<i32> a = _terrain_fixed_recurse(i2, j2, rows2, columns2, filter, depth - 1, hash(seed));
+    _terrain_perturb(seed, i2, j2, a);
+    
+    matrix<i32> b(columns - n, rows2);
+    explode_filter_transpose(b, a, j - j2 * 2, filter, TERRAIN_FILTER_BITS);
+    a.discard_and_resize(rows - n, columns - n);
+    explode_filter_transpose(a, b, i - i2 * 2, filter, TERRAIN_FILTER_BITS);
+    
+    return a;
+    
+}
+
+matrix<i32> terrain_fixed(i64 i,
+                          i64 j,
+                          i64 rows,
+                          i64 columns,
+                          u64 seed,
+                          isize depth) {
+    assert(depth <= TERRAIN_MAX_DEPTH);
+    return _terrain_fixed_recurse(i, j, rows, columns, _terrain_filter_fixed(), depth, hash(seed));
+}
+
+terrain_cache::terrain_cache(u64 seed, isize depth)
+: _seed(seed)
+, _depth(depth)
+, _filter(_terrain_filter_fixed()) {
+    assert(depth <= TERRAIN_MAX_DEPTH);
+    // we defensively hash the seed, as terrain does
+    u64 s = hash(seed);
+    for (isize level = 0; level != depth; ++level) {
+        _seeds.push_back(s);
+        s = hash(s);
+    }
+}
+
+// Mirrors _terrain_fixed_recurse, with the next level's values assembled from tiles
+matrix<i32> terrain_cache::_region(isize level, i64 i, i64 j, i64 rows, i64 columns) const {
+    
+    if (level == _depth)
+        return matrix<i32>(rows, columns); // <-- zeros
+    
+    i64 n = _filter.size();
+    i -= n / 2;
+    j -= n / 2;
+    rows += n;
+    columns += n;
+    
+    i64 i2 = i >> 1;
+    i64 j2 = j >> 1;
+    i64 rows2 = ((i + rows + 1) >> 1) - i2;
+    i64 columns2 = ((j + columns + 1) >> 1) - j2;
+    
+    matrix<i32> a(rows2, columns2);
+    _assemble(level + 1, i2, j2, a);
+    _terrain_perturb(_seeds[level], i2, j2, a);
+    
+    matrix<i32> b(columns - n, rows2);
+    explode_filter_transpose(b, a, j - j2 * 2, _filter, TERRAIN_FILTER_BITS);
+    a.discard_and_resize(rows - n, columns - n);
+    explode_filter_transpose(a, b, i - i2 * 2, _filter, TERRAIN_FILTER_BITS);
+    
+    return a;
+    
+}
+
+void terrain_cache::_assemble(isize level, i64 i, i64 j, matrix_view<i32> a) const {
+    if (level == _depth)
+        return; // <-- the coarsest level is zero
+    for (i64 u = i >> LOG2_TILE; (u << LOG2_TILE) < i + a.rows(); ++u) {
+        for (i64 v = j >> LOG2_TILE; (v << LOG2_TILE) < j + a.columns(); ++v) {
+            matrix<i32> t = _tile(level, vec<i64, 2>{u, v});
+            // copy the overlap
+            i64 i0 = std::max(i, u << LOG2_TILE);
+            i64 i1 = std::min(i + a.rows(), (u + 1) << LOG2_TILE);
+            i64 j0 = std::max(j, v << LOG2_TILE);
+            i64 j1 = std::min(j + a.columns(), (v + 1) << LOG2_TILE);
+            for (i64 s = i0; s != i1; ++s)
+                for (i64 r = j0; r != j1; ++r)
+                    a(s - i, r - j) = t(s - (u << LOG2_TILE), r - (v << LOG2_TILE));
+        }
+    }
+}
+
+matrix<i32> terrain_cache::_tile(isize level, vec<i64, 2> xy) const {
+    _key k{_seed, level, xy};
+    {
+        auto g = _tiles.lock();
+        if (_entry* p = g->_entries.try_get(k)) {
+            p->_referenced = true;
+            ++g->_hits;
+            return p->_tile;
+        }
+        ++g->_misses;
+    }
+    matrix<i32> t = _region(level, xy.x << LOG2_TILE, xy.y << LOG2_TILE, TILE, TILE);
+    {
+        auto g = _tiles.lock();
+        if (g->_entries.contains(k))
+            return t; // <-- another thread computed it meanwhile
+        if ((isize) g->_clock.size() < CAPACITY) {
+            g->_clock.push_back(k);
+        } else {
+            // advance the hand past recently used tiles, clearing their
+            // bits, and replace the first tile found unused
+            for (;;) {
+                _key& victim = g->_clock[g->_hand];
+                _entry* p = g->_entries.try_get(victim);
+                g->_hand = (g->_hand + 1) % CAPACITY;
+                if (!p->_referenced) {
+                    g->_entries.erase(victim);
+                    victim = k;
+                    break;
+                }
+                p->_referenced = false;
+            }
+        }
+        g->_entries.entry(k).or_insert(_entry{t, false});
+    }
+    return t;
+}
+
+terrain_cache::statistics terrain_cache::get_statistics() const {
+    auto g = _tiles.lock();
+    return statistics{g->_hits, g->_misses, (isize) g->_clock.size()};
+}
+
+// Level of detail
+//
+// Unlike the pipeline above, lod works in floating point: its tiles are for
+// display and are never persisted or compared between hosts, so they need
+// only be close, not bit-exact.
+
+// The impulse response, on one axis, of upsampling from level b to the full
+// resolution and then averaging blocks of 2^b back to level b; that is, the
+// level b block means of the terrain are the level b samples (perturbed but
+// not yet filtered) convolved with these taps.  Taps are indexed from lo;
+// the rounding of the fixed-point pipeline is neglected.
+static std::pair<i64, std::vector<double>> _terrain_lod_taps(const_vector_view<i32> f, isize b) {
+    i64 n = f.size();
+    i64 lo = 0;
+    std::vector<double> r(1, 1.0);
+    for (isize l = 0; l != b; ++l) {
+        // out(p) = sum_k e(p - n / 2 + k) f(k), e(2 q) = r(q), as in
+        // _terrain_fixed_recurse
+        i64 lo2 = 2 * lo + n / 2 - (n - 1);
+        std::vector<double> r2(2 * (r.size() - 1) + n, 0.0);
+        for (isize q = 0; q != (isize) r.size(); ++q)
+            for (i64 k = 0; k != n; ++k)
+                r2[2 * (lo + q) + n / 2 - k - lo2] += r[q] * f[k] / (1 << TERRAIN_FILTER_BITS);
+        lo = lo2;
+        r = std::move(r2);
+    }
+    i64 m = i64(1) << b;
+    i64 lo3 = lo >> b;
+    i64 hi3 = ((lo + r.size() - 1) >> b) + 1;
+    std::vector<double> h(hi3 - lo3, 0.0);
+    for (isize p = 0; p != (isize) r.size(); ++p)
+        h[((lo + p) >> b) - lo3] += r[p] / m;
+    return { lo3, std::move(h) };
+}
+
+matrix<i32> terrain_cache::lod(isize level, vec<i64, 2> xy) const {
+    assert(level >= 0);
+    // we compute the block means of a finer level b exactly, then average
+    // them; only octaves finer than b are neglected
+    isize b = std::max<isize>(level - LOD_EXACT, 0);
+    i64 r = TILE << (level - b);
+    i64 i = xy.x * r;
+    i64 j = xy.y * r;
+    matrix<double> z(r, r);
+    if (!b) {
+        matrix<i32> a = _region(0, i, j, r, r);
+        for (i64 s = 0; s != r; ++s)
+            for (i64 t = 0; t != r; ++t)
+                z(s, t) = a(s, t);
+    } else if (b <= _depth) {
+        auto [lo, h] = _terrain_lod_taps(_filter, b);
+        i64 n = h.size();
+        // z(s, t) = sum_uv y(s - lo - u, t - lo - v) h(u) h(v)
+        i64 i0 = i - lo - n + 1;
+        i64 j0 = j - lo - n + 1;
+        matrix<i32> y(r + n - 1, r + n - 1);
+        _assemble(b, i0, j0, y);
+        _terrain_perturb(_seeds[b - 1], i0, j0, y);
+        matrix<double> w(r + n - 1, r);
+        for (i64 s = 0; s != w.rows(); ++s)
+            for (i64 t = 0; t != r; ++t) {
+                double e = 0.0;
+                for (i64 v = 0; v != n; ++v)
+                    e += y(s, t + n - 1 - v) * h[v];
+                w(s, t) = e;
+            }
+        for (i64 s = 0; s != r; ++s)
+            for (i64 t = 0; t != r; ++t) {
+                double e = 0.0;
+                for (i64 u = 0; u != n; ++u)
+                    e += w(s + n - 1 - u, t) * h[u];
+                z(s, t) = e;
+            }
+    } // else every octave is finer than b, and we neglect them all
+    i64 m = r / TILE;
+    matrix<i32> a(TILE, TILE);
+    for (i64 s = 0; s != TILE; ++s)
+        for (i64 t = 0; t != TILE; ++t) {
+            double e = 0.0;
+            for (i64 u = 0; u != m; ++u)
+                for (i64 v = 0; v != m; ++v)
+                    e += z(s * m + u, t * m + v);
+            a(s, t) = (i32) std::lround(e / (m * m));
+        }
+    return a;
+}
+
 } // namespace manic
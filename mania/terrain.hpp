@@ -9,7 +9,12 @@
 #ifndef terrain_hpp
 #define terrain_hpp
 
+#include <vector>
+
 #include "matrix.hpp"
+#include "mutex.hpp"
+#include "table3.hpp"
+#include "vector.hpp"
 
 namespace manic {
 
@@ -23,7 +28,131 @@ matrix<double> terrain(ptrdiff_t i,
                        ptrdiff_t j,
                        ptrdiff_t rows,
                        ptrdiff_t columns,
-                       uint64_t seed = 0);
+                       uint64_t seed = 0,
+                       ptrdiff_t depth = 1);
+
+// Fixed-point terrain, bit-identical across compilers and hosts, for
+// simulations that must agree byte for byte.  The pipeline is that of
+// terrain, with samples in TERRAIN_FRACTION_BITS fixed point and filter taps
+// in TERRAIN_FILTER_BITS fixed point, so values are approximately
+// terrain(...) * (1 << TERRAIN_FRACTION_BITS).  Depth is limited so that the
+// 32-bit filter sums cannot overflow.
+//
+// TERRAIN_GENERATOR_VERSION identifies the output of the pipeline; bump it
+// whenever terrain_fixed changes, so that persisted terrain is regenerated.
+
+enum : int {
+    TERRAIN_FRACTION_BITS = 12,
+    TERRAIN_FILTER_BITS = 10,
+    TERRAIN_MAX_DEPTH = 7,
+    TERRAIN_GENERATOR_VERSION = 1,
+};
+
+matrix<i32> terrain_fixed(i64 i,
+                          i64 j,
+                          i64 rows,
+                          i64 columns,
+                          u64 seed = 0,
+                          isize depth = 1);
+
+// Building blocks of terrain_fixed, for other schedules of the same pipeline
+vector<i32> _terrain_filter_fixed();
+void _terrain_perturb(u64 seed, i64 i, i64 j, matrix_view<i32> a);
+
+// Produces the same values as terrain_fixed, but caches the coarser octaves in
+// TILE x TILE tiles keyed by (level, tile coordinate, seed).  Each request is
+// composed from the cached tiles of the next coarser level, and each tile from
+// the tiles of the level above it, so a stream of neighbouring requests
+// computes every coarse octave only once rather than rebuilding the whole
+// padded pyramid for each request.  With depth 1 there are no coarser
+// octaves, and the cache is never consulted.
+//
+// At most CAPACITY tiles are retained; when the cache is full, the CLOCK
+// (second chance) policy evicts a tile that has not been used since the
+// hand last passed it, approximating least recently used.
+//
+// Thread-safe; tiles computed concurrently by two threads are identical, so
+// we do not hold the lock while computing them.
+
+class terrain_cache {
+
+public:
+
+    enum : i64 {
+        TILE = 16,
+        LOG2_TILE = 4,
+        CAPACITY = 4096, // <-- tiles retained
+        LOD_EXACT = 2, // <-- levels of finer octaves included in lod
+    };
+
+    struct _key {
+        u64 _seed;
+        i64 _level;
+        vec<i64, 2> _xy;
+        bool operator==(_key const& other) const {
+            return (_seed == other._seed) && (_level == other._level) && (_xy == other._xy);
+        }
+    };
+
+    struct _entry {
+        matrix<i32> _tile;
+        bool _referenced;
+    };
+
+    struct _tiles_type {
+        table3<_key, _entry> _entries;
+        std::vector<_key> _clock; // <-- the resident keys, in a ring
+        isize _hand = 0;
+        u64 _hits = 0;
+        u64 _misses = 0;
+    };
+
+    u64 _seed;
+    isize _depth;
+    vector<i32> _filter;
+    vector<u64> _seeds; // <-- noise seed of each level
+    mutex<_tiles_type> _tiles;
+
+    matrix<i32> _region(isize level, i64 i, i64 j, i64 rows, i64 columns) const;
+    void _assemble(isize level, i64 i, i64 j, matrix_view<i32> a) const;
+    matrix<i32> _tile(isize level, vec<i64, 2> xy) const;
+
+    explicit terrain_cache(u64 seed = 0, isize depth = 1);
+
+    // Equivalent to terrain_fixed(i, j, rows, columns, seed, depth)
+    matrix<i32> operator()(i64 i, i64 j, i64 rows, i64 columns) const {
+        return _region(0, i, j, rows, columns);
+    }
+
+    u64 seed() const { return _seed; }
+    isize depth() const { return _depth; }
+
+    struct statistics {
+        u64 hits;
+        u64 misses;
+        isize tiles;
+    };
+
+    statistics get_statistics() const;
+
+    // Level-of-detail tile; sample (s, t) approximates the mean of the
+    // full-resolution values over the 2^level x 2^level block at
+    // ((xy.x * TILE + s) << level, (xy.y * TILE + t) << level).
+    //
+    // The pipeline is linear, so the block means of the terrain are the
+    // samples of the coarser octaves at that level, convolved with a short
+    // fixed filter, plus the block means of the finer octaves' noise, which
+    // shrink with each level.  We compute the means exactly at LOD_EXACT
+    // levels below the requested one, from the coarse octaves alone, and
+    // average them; the cost of a tile therefore does not depend on level.
+    // Levels up to LOD_EXACT are exact, up to rounding.
+    matrix<i32> lod(isize level, vec<i64, 2> xy) const;
+
+};
+
+inline u64 hash(terrain_cache::_key const& k) {
+    return hash_combine(&k, sizeof(k));
+}
 
 // Using a hash function we generate deterministic uncorrelated and uniformly
 // distributed values on a 2d grid.
@@ -6,22 +6,39 @@
 //  Copyright © 2019 Antony Searle. All rights reserved.
 //
 
-#include "terrain.hpp"
 #include "terrain2.hpp"
 
 namespace manic {
 
+matrix<u8> _terrain_quantize(const_matrix_view<i32> a) {
+    matrix<u8> b(a.rows(), a.columns());
+    for (i64 i = 0; i != a.rows(); ++i)
+        for (i64 j = 0; j != a.columns(); ++j)
+            b(i, j) = std::clamp<i32>((a(i, j) >> (TERRAIN_FRACTION_BITS - 8)) + 128, 0, 255);
+    return b;
+}
+
+std::shared_ptr<terrain_store const>& terrain_default_store() {
+    static std::shared_ptr<terrain_store const> p;
+    return p;
+}
+
 matrix<u8> _terrain_generator::_terrain_maker::operator()() const {
     
     constexpr i64 N = 16;
     constexpr i64 MASK = N - 1;
     
-    matrix<double> a = terrain(_xy.x & ~MASK, _xy.y & ~MASK, N, N, _seed);
+    if (_store)
+        if (auto a = _store->try_get(_cache->seed(), _xy))
+            return std::move(*a);
+    
+    // fixed point, so every host generates identical chunks
+    matrix<i32> a = (*_cache)(_xy.x & ~MASK, _xy.y & ~MASK, N, N);
+    
+    matrix<u8> b = _terrain_quantize(a);
     
-    matrix<u8> b(N, N);
-    for (i64 i = 0; i != N; ++i)
-        for (i64 j = 0; j != N; ++j)
-            b(i, j) = std::clamp<double>(a(i, j) * 256 + 128, 0, 255);
+    if (_store)
+        _store->insert(_cache->seed(), _xy, b);
             
     return b;
     
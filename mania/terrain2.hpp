@@ -9,36 +9,57 @@
 #ifndef terrain2_hpp
 #define terrain2_hpp
 
+#include <memory>
+
 #include "space2.hpp"
+#include "terrain.hpp"
+#include "terrain_store.hpp"
 
 namespace manic {
 
+// Fixed-point terrain to the u8 heights stored in chunks
+matrix<u8> _terrain_quantize(const_matrix_view<i32> a);
+
+// The store of this machine, used by generators made or deserialized
+// without one; set it at startup, before making any world
+std::shared_ptr<terrain_store const>& terrain_default_store();
+
 struct _terrain_generator {
     
-    u64 _seed;
+    // Shared by copies of the generator and by the chunk makers, so that
+    // neighbouring chunks reuse the coarse octaves
+    std::shared_ptr<terrain_cache const> _cache;
+    
+    // Optional; consulted before generating, and populated after
+    std::shared_ptr<terrain_store const> _store;
     
-    explicit _terrain_generator(u64 seed)
-    : _seed(seed) {
+    explicit _terrain_generator(u64 seed,
+                                std::shared_ptr<terrain_store const> store = terrain_default_store())
+    : _cache(std::make_shared<terrain_cache>(seed))
+    , _store(std::move(store)) {
     }
     
     struct _terrain_maker {
 
         vec<i64, 2> _xy;
-        u64 _seed;
+        std::shared_ptr<terrain_cache const> _cache;
+        std::shared_ptr<terrain_store const> _store;
 
         matrix<u8> operator()() const;
         
     };
         
     _terrain_maker operator()(vec<i64, 2> xy) const {
-        return _terrain_maker{xy, _seed};
+        return _terrain_maker{xy, _cache, _store};
     }
     
 };
 
 template<typename Serializer>
 void serialize(_terrain_generator const& x, Serializer& s) {
-    serialize(x._seed, s);
+    // the store is local to this machine; a deserialized generator uses
+    // terrain_default_store
+    serialize(x._cache->seed(), s);
 }
 
 template<typename Deserializer>
@@ -0,0 +1,207 @@
+//
+//  terrain_bake.cpp
+//  mania
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#include <cmath>
+#include <complex>
+#include <vector>
+
+#include "hash.hpp"
+#include "terrain_bake.hpp"
+
+namespace manic {
+
+namespace {
+
+using cplx = std::complex<double>;
+
+// Runs f(begin, end) on n items split among threads
+template<typename F>
+void _parallel_for(isize n, isize threads, F f) {
+    threads = std::max<isize>(1, std::min(threads, n));
+    std::vector<std::thread> v;
+    for (isize t = 1; t < threads; ++t)
+        v.emplace_back(f, n * t / threads, n * (t + 1) / threads);
+    f(0, n / threads);
+    for (auto& s : v)
+        s.join();
+}
+
+// In-place radix-2 transform of length n, unnormalized, with twiddles
+// w[k] = exp(-2 pi i k / n) precomputed for k < n / 2
+void _fft(cplx* x, isize n, cplx const* w, bool inverse) {
+    for (isize i = 1, j = 0; i < n; ++i) {
+        isize b = n >> 1;
+        for (; j & b; b >>= 1)
+            j ^= b;
+        j ^= b;
+        if (i < j)
+            std::swap(x[i], x[j]);
+    }
+    for (isize m = 2; m <= n; m <<= 1) {
+        isize h = m >> 1;
+        isize s = n / m;
+        for (isize i = 0; i < n; i += m)
+            for (isize k = 0; k != h; ++k) {
+                cplx u = inverse ? std::conj(w[k * s]) : w[k * s];
+                cplx p = x[i + k];
+                cplx q = x[i + k + h] * u;
+                x[i + k] = p + q;
+                x[i + k + h] = p - q;
+            }
+    }
+}
+
+} // namespace
+
+void _explode_filter_transpose_fft(matrix_view<i32> c,
+                                   const_matrix_view<i32> a,
+                                   isize offset,
+                                   const_vector_view<i32> f,
+                                   int fraction_bits,
+                                   isize threads) {
+    assert((offset == 0) || (offset == 1));
+    assert(c.columns() == a.rows());
+    assert(c.rows() + f.size() <= 2 * a.columns() - offset);
+
+    // c(j, i) = sum_k e(i, j + k) * f(k), where e(i, 2 * m - offset) = a(i, m)
+    //
+    // is the correlation of e with f, i.e. the convolution of e with f
+    // reversed, read at j + n - 1
+    isize n = f.size();
+    isize m = 2 * a.columns() - offset;
+    isize l = 1;
+    while (l < m + n)
+        l <<= 1;
+
+    std::vector<cplx> w(l / 2);
+    for (isize k = 0; k != l / 2; ++k)
+        w[k] = std::polar(1.0, -2.0 * M_PI * k / l);
+
+    // spectrum of the reversed filter, with the 1 / l normalization of the
+    // inverse transform folded in
+    std::vector<cplx> g(l);
+    for (isize k = 0; k != n; ++k)
+        g[k] = f[n - 1 - k];
+    _fft(g.data(), l, w.data(), false);
+    for (cplx& z : g)
+        z /= (double) l;
+
+    i32 half = fraction_bits ? (i32(1) << (fraction_bits - 1)) : 0;
+
+    // two rows of a per transform, as the real and imaginary parts
+    _parallel_for((a.rows() + 1) / 2, threads, [&](isize begin, isize end) {
+        std::vector<cplx> x(l);
+        for (isize p = begin; p != end; ++p) {
+            isize i = p * 2;
+            bool pair = i + 1 < a.rows();
+            std::fill(x.begin(), x.end(), cplx());
+            for (isize r = offset; r < m; r += 2)
+                x[r] = cplx(a(i, (r + offset) >> 1),
+                            pair ? a(i + 1, (r + offset) >> 1) : 0);
+            _fft(x.data(), l, w.data(), false);
+            for (isize k = 0; k != l; ++k)
+                x[k] *= g[k];
+            _fft(x.data(), l, w.data(), true);
+            for (isize j = 0; j != c.rows(); ++j) {
+                cplx z = x[j + n - 1];
+                // the exact sums are integers; recover them
+                i64 s = std::llround(z.real());
+                i64 t = std::llround(z.imag());
+                assert(std::abs(z.real() - s) < 0.25 && std::abs(z.imag() - t) < 0.25);
+                c(j, i) = (i32) ((s + half) >> fraction_bits);
+                if (pair)
+                    c(j, i + 1) = (i32) ((t + half) >> fraction_bits);
+            }
+        }
+    });
+}
+
+namespace {
+
+// Mirrors _terrain_fixed_recurse
+matrix<i32> _terrain_fixed_fft_recurse(i64 i,
+                                       i64 j,
+                                       i64 rows,
+                                       i64 columns,
+                                       const_vector_view<i32> filter,
+                                       isize depth,
+                                       u64 seed,
+                                       isize threads) {
+
+    if (!depth)
+        return matrix<i32>(rows, columns); // <-- zeros
+
+    i64 n = filter.size();
+    i -= n / 2;
+    j -= n / 2;
+    rows += n;
+    columns += n;
+
+    i64 i2 = i >> 1;
+    i64 j2 = j >> 1;
+    i64 rows2 = ((i + rows + 1) >> 1) - i2;
+    i64 columns2 = ((j + columns + 1) >> 1) - j2;
+
+    matrix<i32> a = _terrain_fixed_fft_recurse(i2, j2, rows2, columns2, filter, depth - 1, hash(seed), threads);
+    _parallel_for(rows2, threads, [&](isize begin, isize end) {
+        _terrain_perturb(seed, i2 + begin, j2, a.sub(begin, 0, end - begin, columns2));
+    });
+
+    matrix<i32> b(columns - n, rows2);
+    _explode_filter_transpose_fft(b, a, j - j2 * 2, filter, TERRAIN_FILTER_BITS, threads);
+    a.discard_and_resize(rows - n, columns - n);
+    _explode_filter_transpose_fft(a, b, i - i2 * 2, filter, TERRAIN_FILTER_BITS, threads);
+
+    return a;
+
+}
+
+} // namespace
+
+matrix<i32> terrain_fixed_fft(i64 i,
+                              i64 j,
+                              i64 rows,
+                              i64 columns,
+                              u64 seed,
+                              isize depth,
+                              isize threads) {
+    assert(depth <= TERRAIN_MAX_DEPTH);
+    return _terrain_fixed_fft_recurse(i, j, rows, columns, _terrain_filter_fixed(), depth, hash(seed), threads);
+}
+
+isize terrain_bake(_terrain_generator const& generator,
+                   vec<i64, 2> lo,
+                   vec<i64, 2> hi,
+                   isize threads,
+                   bool fft) {
+    constexpr i64 N = terrain_store::N;
+    assert(generator._store);
+    assert(!(lo.x & (N - 1)) && !(lo.y & (N - 1)));
+    assert(!(hi.x & (N - 1)) && !(hi.y & (N - 1)));
+    terrain_store const& store = *generator._store;
+    u64 seed = generator._cache->seed();
+    isize depth = generator._cache->depth();
+    isize before = store.size();
+    auto write = [&](const_matrix_view<i32> a, i64 i) {
+        for (i64 u = 0; u != a.rows(); u += N)
+            for (i64 v = 0; v != a.columns(); v += N)
+                store.insert(seed, vec<i64, 2>{i + u, lo.y + v},
+                             _terrain_quantize(a.sub(u, v, N, N)));
+    };
+    if (fft) {
+        write(terrain_fixed_fft(lo.x, lo.y, hi.x - lo.x, hi.y - lo.y, seed, depth, threads), lo.x);
+    } else {
+        _parallel_for((hi.x - lo.x) / N, threads, [&](isize begin, isize end) {
+            i64 i = lo.x + begin * N;
+            write(terrain_fixed(i, lo.y, (end - begin) * N, hi.y - lo.y, seed, depth), i);
+        });
+    }
+    return store.size() - before;
+}
+
+} // namespace manic
@@ -0,0 +1,65 @@
+//
+//  terrain_bake.hpp
+//  mania
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#ifndef terrain_bake_hpp
+#define terrain_bake_hpp
+
+#include <thread>
+
+#include "matrix.hpp"
+#include "terrain2.hpp"
+#include "vec.hpp"
+
+namespace manic {
+
+// Offline generation of large terrain regions
+//
+// terrain_fixed_fft computes the same values as terrain_fixed, but performs
+// the upsampling filter of each octave by FFT, two rows at a time (packed
+// into the real and imaginary parts), with the rows shared among threads.
+// The fixed-point sums are small enough that the double-precision
+// convolution is within 0.5 of the exact integer sum, so rounding recovers
+// it, and the result is bit-identical to the direct pipeline.
+//
+// The cost of the FFT per sample is independent of the filter length, but
+// with the current 16-tap filter it is several times that of the direct
+// kernel, so the baker uses it only on request; it pays off for much wider
+// filters.
+
+matrix<i32> terrain_fixed_fft(i64 i,
+                              i64 j,
+                              i64 rows,
+                              i64 columns,
+                              u64 seed = 0,
+                              isize depth = 1,
+                              isize threads = std::thread::hardware_concurrency());
+
+// Generates the chunks of [lo, hi) (cells, chunk aligned) as the generator
+// would, and writes them to its store; returns the number of chunks written
+// (chunks already present are left alone).
+//
+// By default each thread generates a strip of whole chunk rows directly;
+// with fft, the region is generated at once by terrain_fixed_fft.
+isize terrain_bake(_terrain_generator const& generator,
+                   vec<i64, 2> lo,
+                   vec<i64, 2> hi,
+                   isize threads = std::thread::hardware_concurrency(),
+                   bool fft = false);
+
+// Exposed for testing; the FFT equivalent of explode_filter_transpose for
+// fixed-point i32
+void _explode_filter_transpose_fft(matrix_view<i32> c,
+                                   const_matrix_view<i32> a,
+                                   isize offset,
+                                   const_vector_view<i32> f,
+                                   int fraction_bits,
+                                   isize threads);
+
+} // namespace manic
+
+#endif /* terrain_bake_hpp */
@@ -0,0 +1,99 @@
+//
+//  terrain_lod.hpp
+//  mania
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#ifndef terrain_lod_hpp
+#define terrain_lod_hpp
+
+#include <algorithm>
+
+#include "table3.hpp"
+#include "terrain2.hpp"
+
+namespace manic {
+
+// Level-of-detail view of a terrain2, for zoomed-out maps
+//
+// A level l tile holds the means of TILE x TILE blocks of 2^l x 2^l cells.
+// Tiles are built from the coarse octaves by terrain_cache::lod, so they
+// never touch the full-resolution chunks and cost the same at any level.
+// Edits to the chunks (such as tracks) are folded in through per-level sums
+// of the changes within each block, updated in O(LEVELS) per edit; a block
+// whose edits cancel out is forgotten, so the sums are bounded by the
+// blocks with net edits.  The sums cannot be recovered without regenerating
+// every chunk, so anything that saves the edits must save them too.
+
+struct terrain_lod {
+
+    enum : isize {
+        TILE = terrain_cache::TILE,
+        LOG2_TILE = terrain_cache::LOG2_TILE,
+        LEVELS = 24,
+    };
+
+    // Sum of (after - before) over the edited cells of each block; level 0
+    // is the chunks themselves and is unused
+    table3<vec<i64, 2>, i64> _edits[LEVELS];
+
+    // Adds d to the sums of the blocks containing block uv of level k
+    void _add(vec<i64, 2> uv, isize k, i64 d) {
+        for (isize l = std::max<isize>(k, 1); l != LEVELS; ++l) {
+            vec<i64, 2> b{uv.x >> (l - k), uv.y >> (l - k)};
+            if (!(_edits[l].entry(b).or_insert(0) += d))
+                _edits[l].erase(b);
+        }
+    }
+
+    void did_write(vec<i64, 2> xy, u8 before, u8 after) {
+        if (before != after)
+            _add(xy, 0, (i64) after - before);
+    }
+
+    matrix<u8> operator()(terrain2& terrain, isize level, vec<i64, 2> xy) const {
+        assert(0 <= level && level < LEVELS);
+        if (!level)
+            return terrain.get_chunk(vec<i64, 2>{xy.x << LOG2_TILE, xy.y << LOG2_TILE});
+        matrix<u8> a = _terrain_quantize(terrain._generator._cache->lod(level, xy));
+        if (_edits[level].size()) {
+            i64 n = i64(1) << (2 * level);
+            for (i64 s = 0; s != TILE; ++s)
+                for (i64 t = 0; t != TILE; ++t)
+                    if (i64 const* d = _edits[level].try_get(vec<i64, 2>{(xy.x << LOG2_TILE) + s, (xy.y << LOG2_TILE) + t}))
+                        // (rounded to nearest)
+                        a(s, t) = (u8) std::clamp<i64>(a(s, t) + (*d * 2 + (*d < 0 ? -n : n)) / (2 * n), 0, 255);
+        }
+        return a;
+    }
+
+}; // struct terrain_lod
+
+// The finest sums determine the rest
+
+template<typename Serializer>
+void serialize(terrain_lod const& x, Serializer& s) {
+    serialize(x._edits[1].size(), s);
+    for (auto&& [uv, d] : x._edits[1]) {
+        serialize(uv.x, s);
+        serialize(uv.y, s);
+        serialize(d, s);
+    }
+}
+
+template<typename Deserializer>
+terrain_lod deserialize(placeholder<terrain_lod>, Deserializer& d) {
+    terrain_lod x;
+    for (auto n = deserialize<usize>(d); n--;) {
+        i64 u = deserialize<i64>(d);
+        i64 v = deserialize<i64>(d);
+        x._add(vec<i64, 2>{u, v}, 1, deserialize<i64>(d));
+    }
+    return x;
+}
+
+} // namespace manic
+
+#endif /* terrain_lod_hpp */
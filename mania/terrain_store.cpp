@@ -0,0 +1,232 @@
+//
+//  terrain_store.cpp
+//  mania
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <utility>
+
+#include "terrain_store.hpp"
+
+namespace manic {
+
+terrain_store::terrain_store(string_view path, u64 version)
+: _fd(-1)
+, _version(version) {
+
+    auto g = std::as_const(_log).lock();
+    g->_base = nullptr;
+    g->_length = 0;
+
+    _fd = ::open(string(path).c_str(), O_RDWR | O_CREAT, 0644);
+    if (_fd < 0)
+        return;
+
+    // the log has one writer; a store already open on the file, in this
+    // process or another, leaves this one empty
+    if (flock(_fd, LOCK_EX | LOCK_NB)) {
+        ::close(std::exchange(_fd, -1));
+        return;
+    }
+
+    // map the file as it stands, and check its header and index
+    struct stat s;
+    bool ok = !fstat(_fd, &s);
+    if (ok && s.st_size >= (i64) sizeof(_header))
+        ok = _resize(_fd, *g, s.st_size) && _consistent(*g);
+    else
+        ok = false;
+    if (!ok && !_initialize(_fd, *g))
+        ::close(std::exchange(_fd, -1));
+
+}
+
+terrain_store::~terrain_store() {
+    auto g = std::as_const(_log).lock();
+    if (g->_base)
+        munmap(g->_base, g->_length);
+    if (_fd >= 0)
+        ::close(_fd);
+}
+
+// Maps length bytes of the file, extending it if necessary
+bool terrain_store::_resize(int fd, _state& s, i64 length) {
+    if (s._base)
+        munmap(s._base, s._length);
+    s._base = nullptr;
+    s._length = 0;
+    if (ftruncate(fd, length))
+        return false;
+    void* p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        return false;
+    s._base = (unsigned char*) p;
+    s._length = length;
+    return true;
+}
+
+// Discards the contents of the file and writes an empty log and index
+bool terrain_store::_initialize(int fd, _state& s) {
+    if (s._base)
+        munmap(s._base, s._length);
+    s._base = nullptr;
+    s._length = 0;
+    if (ftruncate(fd, 0) || !_resize(fd, s, GROWTH))
+        return false;
+    _header& h = *(_header*) s._base;
+    h._table = sizeof(_header);
+    h._slots = SLOTS;
+    h._used = h._table + SLOTS * sizeof(_slot);
+    h._occupied = 0;
+    h._magic = MAGIC;
+    return true;
+}
+
+bool terrain_store::_consistent(_state const& s) {
+    _header const& h = *(_header const*) s._base;
+    if (!((h._magic == MAGIC)
+          && (h._slots >= SLOTS)
+          && !(h._slots & (h._slots - 1))
+          && (0 <= h._occupied) && (h._occupied < h._slots)
+          && (h._table >= (i64) sizeof(_header))
+          && !(h._table % (i64) alignof(_slot))
+          && !(h._used % (i64) alignof(_record))
+          && (h._table + h._slots * (i64) sizeof(_slot) <= h._used)
+          && (h._used <= s._length)))
+        return false;
+    // the index must have the vacant slots the header claims, or probes
+    // for absent keys would not find one
+    _slot const* table = (_slot const*) (s._base + h._table);
+    i64 n = 0;
+    for (i64 i = 0; i != h._slots; ++i)
+        n += (table[i]._offset != 0);
+    return n == h._occupied;
+}
+
+// The slot holding k, or the vacant slot where it would go, or nullptr if
+// the table is full, which only a corrupt file can be
+terrain_store::_slot* terrain_store::_probe(_slot* table, i64 slots, _key const& k) {
+    u64 i = hash(k);
+    for (i64 n = 0; n != slots; ++n, ++i) {
+        _slot* p = table + (i & (slots - 1));
+        if (!p->_offset || p->_name == k)
+            return p;
+    }
+    return nullptr;
+}
+
+terrain_store::_slot* terrain_store::_probe(_state const& s, _key const& k) {
+    _header const& h = *(_header const*) s._base;
+    return _probe((_slot*) (s._base + h._table), h._slots, k);
+}
+
+// The record the slot refers to, if it survived intact
+terrain_store::_record const* terrain_store::_valid(_state const& s, _slot const& p) {
+    _header const& h = *(_header const*) s._base;
+    if ((p._offset < (i64) sizeof(_header))
+        || (p._offset % (i64) alignof(_record))
+        || (p._offset + (i64) sizeof(_record) > h._used))
+        return nullptr;
+    _record const* r = (_record const*) (s._base + p._offset);
+    if (!(r->_name == p._name) || r->_checksum != _checksum(*r))
+        return nullptr;
+    return r;
+}
+
+isize terrain_store::size() const {
+    auto g = _log.lock();
+    if (!g->_base)
+        return 0;
+    _header const& h = *(_header const*) g->_base;
+    _slot const* table = (_slot const*) (g->_base + h._table);
+    isize n = 0;
+    for (i64 i = 0; i != h._slots; ++i)
+        n += (table[i]._offset && table[i]._name._version == _version && _valid(*g, table[i]));
+    return n;
+}
+
+std::optional<matrix<u8>> terrain_store::try_get(u64 seed, vec<i64, 2> xy) const {
+    auto g = _log.lock();
+    if (!g->_base)
+        return std::nullopt;
+    _slot const* p = _probe(*g, _key{seed, _version, xy});
+    if (!p) {
+        // the file was corrupted while open; start it afresh
+        _initialize(_fd, *g);
+        return std::nullopt;
+    }
+    _record const* r = _valid(*g, *p);
+    if (!r)
+        return std::nullopt;
+    matrix<u8> a(N, N);
+    for (i64 i = 0; i != N; ++i)
+        std::memcpy(&a(i, 0), r->_chunk + i * N, N);
+    return a;
+}
+
+void terrain_store::insert(u64 seed, vec<i64, 2> xy, const_matrix_view<u8> chunk) const {
+    assert(chunk.rows() == N && chunk.columns() == N);
+    auto g = _log.lock();
+    if (!g->_base)
+        return;
+    _key k{seed, _version, xy};
+    i64 slots;
+    bool grow;
+    i64 n;
+    {
+        _slot* p = _probe(*g, k);
+        if (!p) {
+            // the file was corrupted while open; start it afresh
+            if (!_initialize(_fd, *g))
+                return;
+            p = _probe(*g, k);
+        }
+        if (_valid(*g, *p))
+            return;
+        _header const& h = *(_header const*) g->_base;
+        slots = h._slots;
+        grow = !p->_offset && (h._occupied + 1) * 2 > h._slots;
+        n = h._used + sizeof(_record) + (grow ? 2 * slots * sizeof(_slot) : 0);
+    }
+    if (n > g->_length && !_resize(_fd, *g, (n + GROWTH - 1) & ~(GROWTH - 1)))
+        return; // <-- the store is closed; keep generating
+    // (the mapping may have moved)
+    _header& h = *(_header*) g->_base;
+    i64 offset = h._used;
+    i64 used = offset + sizeof(_record);
+    _record* r = (_record*) (g->_base + offset);
+    r->_name = k;
+    for (i64 i = 0; i != N; ++i)
+        std::memcpy(r->_chunk + i * N, &chunk(i, 0), N);
+    r->_checksum = _checksum(*r);
+    if (grow) {
+        // append a table twice the size, and rehash into it
+        _slot const* old = (_slot const*) (g->_base + h._table);
+        _slot* table = (_slot*) (g->_base + used);
+        std::memset(table, 0, 2 * slots * sizeof(_slot));
+        for (i64 i = 0; i != slots; ++i)
+            if (old[i]._offset)
+                *_probe(table, 2 * slots, old[i]._name) = old[i];
+        h._used = used + 2 * slots * sizeof(_slot);
+        h._table = used;
+        h._slots = 2 * slots;
+    } else {
+        h._used = used;
+    }
+    _slot* p = _probe(*g, k);
+    assert(p); // <-- we found a slot in this table, or grew it
+    if (!p->_offset)
+        ++h._occupied;
+    *p = _slot{k, offset};
+}
+
+} // namespace manic
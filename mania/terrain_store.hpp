@@ -0,0 +1,140 @@
+//
+//  terrain_store.hpp
+//  mania
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#ifndef terrain_store_hpp
+#define terrain_store_hpp
+
+#include <optional>
+
+#include "hash.hpp"
+#include "matrix.hpp"
+#include "mutex.hpp"
+#include "string.hpp"
+#include "table3.hpp"
+#include "terrain.hpp"
+#include "vec.hpp"
+
+namespace manic {
+
+// Persistent cache of generated terrain chunks, keyed by (seed, chunk,
+// generator version), so that a returning world is paged in rather than
+// synthesized again.
+//
+// The file is a header, followed by an append-only log of fixed-size
+// records interleaved with the index: an open-addressing hash table of
+// record offsets, which is also kept in the file.  The header locates the
+// end of the log and the current table.  Opening a store checks the header
+// and counts the occupied slots of the table, in O(slots), but reads no
+// records; each lookup probes the table and touches the one record it
+// finds.  When the table fills, a table twice the size is appended, rehashed
+// from the old one, and the header repointed; the old table is abandoned.
+//
+// The file is memory-mapped, and remapped as it grows; every access holds
+// the lock, so nothing sees the mapping move.
+//
+// A crash may leave a record, a slot or the header torn or stale, so each
+// lookup checks that the record it reaches is aligned, lies within the log
+// and has the right key and a valid checksum, and treats a record that does
+// not as missing; inserting the chunk again repairs the slot.  Records from
+// other generator versions remain in the file but never match, so they are
+// simply ignored.  A file with the wrong magic number, an inconsistent or
+// misaligned header or an occupied count that does not match the table is
+// started afresh.
+//
+// The file is shared by every process on the machine, but only one store at
+// a time may append to it, so a store holds an exclusive flock on the file
+// while it is open.
+//
+// Best-effort: if the file cannot be opened, locked or mapped, the store is
+// empty and discards writes.  Thread-safe.
+
+class terrain_store {
+
+public:
+
+    enum : i64 {
+        N = 16, // <-- chunk size
+        MAGIC = 0x7465727261696e74, // <-- "terraint", the indexed layout
+        SLOTS = 256, // <-- initial size of the index
+        GROWTH = i64(1) << 20, // <-- file is extended in steps of this size
+    };
+
+    struct _key {
+        u64 _seed;
+        u64 _version;
+        vec<i64, 2> _xy;
+        bool operator==(_key const& other) const {
+            return (_seed == other._seed) && (_version == other._version) && (_xy == other._xy);
+        }
+    };
+
+    struct _record {
+        _key _name;
+        u64 _checksum; // <-- of _name and _chunk
+        u8 _chunk[N * N];
+    };
+
+    struct _slot {
+        _key _name;
+        i64 _offset; // <-- of the record; zero if vacant
+    };
+
+    struct _header {
+        u64 _magic;
+        i64 _used; // <-- bytes of header, records and tables
+        i64 _table; // <-- offset of the index
+        i64 _slots; // <-- size of the index, a power of two
+        i64 _occupied; // <-- slots of the index in use
+    };
+
+    struct _state {
+        unsigned char* _base;
+        i64 _length; // <-- bytes of file, and of the mapping
+    };
+
+    int _fd;
+    u64 _version;
+    mutex<_state> _log;
+
+    static u64 _checksum(_record const& r) {
+        return hash_combine(r._chunk, sizeof(r._chunk), hash_combine(&r._name, sizeof(r._name), MAGIC));
+    }
+
+    explicit terrain_store(string_view path, u64 version = TERRAIN_GENERATOR_VERSION);
+
+    terrain_store(terrain_store const&) = delete;
+    ~terrain_store();
+    terrain_store& operator=(terrain_store const&) = delete;
+
+    bool is_open() const { return _log.lock()->_base; }
+
+    // Counts the valid records of this version by walking the index; for
+    // diagnostics
+    isize size() const;
+
+    std::optional<matrix<u8>> try_get(u64 seed, vec<i64, 2> xy) const;
+
+    // Appends the chunk unless it is already present
+    void insert(u64 seed, vec<i64, 2> xy, const_matrix_view<u8> chunk) const;
+
+    static bool _resize(int fd, _state& s, i64 length);
+    static bool _initialize(int fd, _state& s);
+    static bool _consistent(_state const& s);
+    static _slot* _probe(_slot* table, i64 slots, _key const& k);
+    static _slot* _probe(_state const& s, _key const& k);
+    static _record const* _valid(_state const& s, _slot const& p);
+
+};
+
+inline u64 hash(terrain_store::_key const& k) {
+    return hash_combine(&k, sizeof(k));
+}
+
+} // namespace manic
+
+#endif /* terrain_store_hpp */
@@ -0,0 +1,205 @@
+//
+//  tick_journal.hpp
+//  mania
+//
+//  Created by Antony Searle on 19/10/26.
+//  Copyright © 2026 Antony Searle. All rights reserved.
+//
+
+#ifndef tick_journal_hpp
+#define tick_journal_hpp
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "atomic.hpp"
+#include "common.hpp"
+#include "space2.hpp"
+#include "vec.hpp"
+
+namespace manic {
+
+// Side effects of a parallel tick, replayed in a deterministic order
+//
+// Each job of a parallel tick opens a writer for the entity it executes and
+// records the entity's cell writes and waiter wake-ups through it.  Writers
+// append to a buffer owned by the calling thread, in blocks of BLOCK
+// entries that are kept from tick to tick, so recording costs a store and
+// an increment.  A thread's buffer is created the first time it opens a
+// writer on a journal, and pushed onto the journal's list with a CAS; there
+// is no lock anywhere.
+//
+// After the parallel phase has joined (task_graph::run has returned, for
+// example), commit gathers every buffer and merges them into the canonical
+// order of (chunk, entity, sequence), where sequence counts the effects of
+// one writer.  The order does not depend on which threads ran which
+// entities, or when, so replaying it is deterministic.  Effects with equal
+// keys, which arise only if an entity is opened more than once between
+// commits, are ordered by their contents, so that the order is still
+// deterministic.
+//
+// open is thread-safe; commit must not run concurrently with any writer.
+
+struct tick_journal {
+
+    struct entry {
+
+        enum : u64 {
+            WRITE, // <-- _xy takes _value
+            WAKE, // <-- the waiters on _xy wake
+        };
+
+        u64 _entity;
+        u64 _sequence;
+        u64 _kind;
+        vec<i64, 2> _xy;
+        u64 _value;
+
+        vec<i64, 2> chunk() const {
+            return vec<i64, 2>{_xy.x & ~CHUNK_MASK, _xy.y & ~CHUNK_MASK};
+        }
+
+        friend bool operator<(entry const& a, entry const& b) {
+            return (std::forward_as_tuple(a.chunk(), a._entity, a._sequence, a._kind, a._xy, a._value)
+                    < std::forward_as_tuple(b.chunk(), b._entity, b._sequence, b._kind, b._xy, b._value));
+        }
+
+    };
+
+    enum : isize {
+        BLOCK = 256,
+    };
+
+    struct _buffer {
+
+        _buffer* _next = nullptr; // <-- immutable once registered
+        std::thread::id _owner;
+        std::vector<std::unique_ptr<entry[]>> _blocks;
+        isize _size = 0;
+
+        void push_back(entry const& e) {
+            isize i = _size & (BLOCK - 1);
+            if (!i && (usize) (_size / BLOCK) == _blocks.size())
+                _blocks.emplace_back(new entry[BLOCK]);
+            _blocks[_size / BLOCK][i] = e;
+            ++_size;
+        }
+
+        template<typename F>
+        void for_each(F&& f) const {
+            for (isize i = 0; i != _size; ++i)
+                f(_blocks[i / BLOCK][i & (BLOCK - 1)]);
+        }
+
+    };
+
+    struct writer {
+
+        _buffer* _buf;
+        u64 _entity;
+        u64 _sequence;
+
+        void write(vec<i64, 2> xy, u64 value) {
+            _buf->push_back(entry{_entity, _sequence++, entry::WRITE, xy, value});
+        }
+
+        void wake(vec<i64, 2> xy) {
+            _buf->push_back(entry{_entity, _sequence++, entry::WAKE, xy, 0});
+        }
+
+    };
+
+    u64 _serial; // <-- distinguishes this journal from any previously at its address
+    Atomic<_buffer*> _head;
+    std::vector<entry> _merged;
+
+    static u64 _next_serial() {
+        static const Atomic<u64> n(0);
+        return n.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    tick_journal()
+    : _serial(_next_serial())
+    , _head(nullptr) {
+    }
+
+    tick_journal(tick_journal const&) = delete;
+
+    ~tick_journal() {
+        for (_buffer* p = _head; p;)
+            delete std::exchange(p, p->_next);
+    }
+
+    tick_journal& operator=(tick_journal const&) = delete;
+
+    // The calling thread's buffer
+    //
+    // Each thread remembers only the journal it last used, so switching
+    // journals walks this journal's list for a buffer the thread owns; a
+    // tick uses one journal, so that is rare.
+    _buffer* _local() const {
+        thread_local std::pair<u64, _buffer*> last{~u64(0), nullptr};
+        if (last.first == _serial)
+            return last.second;
+        std::thread::id id = std::this_thread::get_id();
+        _buffer* p = _head.load(std::memory_order_acquire);
+        while (p && p->_owner != id)
+            p = p->_next;
+        if (!p) {
+            p = new _buffer;
+            p->_owner = id;
+            p->_next = _head.load(std::memory_order_relaxed);
+            while (!_head.compare_exchange_weak(p->_next, p, std::memory_order_release, std::memory_order_relaxed))
+                ;
+        }
+        last = {_serial, p};
+        return p;
+    }
+
+    writer open(u64 entity) const {
+        return writer{_local(), entity, 0};
+    }
+
+    // The effects recorded since the last commit, in canonical order, valid
+    // until the next commit
+    std::vector<entry> const& commit() {
+        _merged.clear();
+        // each buffer is a run, usually already in order, as jobs tend to
+        // execute entities in order; merge them pairwise
+        std::vector<usize> runs;
+        for (_buffer* p = _head; p; p = p->_next) {
+            if (!p->_size)
+                continue;
+            usize first = _merged.size();
+            p->for_each([&](entry const& e) { _merged.push_back(e); });
+            if (!std::is_sorted(_merged.begin() + first, _merged.end()))
+                std::sort(_merged.begin() + first, _merged.end());
+            runs.push_back(first);
+            p->_size = 0;
+        }
+        runs.push_back(_merged.size());
+        while (runs.size() > 2) {
+            std::vector<usize> next;
+            usize i = 0;
+            for (; i + 2 < runs.size(); i += 2) {
+                std::inplace_merge(_merged.begin() + runs[i],
+                                   _merged.begin() + runs[i + 1],
+                                   _merged.begin() + runs[i + 2]);
+                next.push_back(runs[i]);
+            }
+            for (; i != runs.size(); ++i)
+                next.push_back(runs[i]);
+            runs = std::move(next);
+        }
+        return _merged;
+    }
+
+}; // struct tick_journal
+
+} // namespace manic
+
+#endif /* tick_journal_hpp */
@@ -58,7 +58,7 @@ namespace manic {
         vector& operator=(const_vector_view<T> v) {
             std::destroy_n(this->_begin, this->_size);
             if (this->capacity() < v.size()) {
-                raw_vector<T>(std::max(this->_capacity * 2, v.size())).swap(*this);
+                raw_vector<T>(std::max(this->_capacity * 2, v.size()), uninitialized).swap(*this);
             }
             this->_begin = this->_allocation;
             this->_size = v.size();
@@ -126,7 +126,7 @@ namespace manic {
                 std::uninitialized_fill_n(this->_begin + this->_size, n - this->_size, x);
                 this->_size = n;
             } else {
-                raw_vector<T> v(std::max(n, 2 * this->_capacity));
+                raw_vector<T> v(std::max(n, 2 * this->_capacity), uninitialized);
                 std::memcpy(v._allocation, this->_begin, this->_size * sizeof(T));
                 std::uninitialized_fill_n(v._allocation + this->_size, n - this->_size, x);
                 this->_begin = v._allocation;
@@ -137,7 +137,7 @@ namespace manic {
         
         void reserve(ptrdiff_t new_cap) {
             if (new_cap > this->_capacity) {
-                raw_vector<T> v(std::max(new_cap, this->_capacity * 2));
+                raw_vector<T> v(std::max(new_cap, this->_capacity * 2), uninitialized);
                 std::memcpy(v._allocation, this->_begin, this->_size * sizeof(T));
                 this->_begin = v._allocation;
                 v.swap(*this);
@@ -145,7 +145,7 @@ namespace manic {
         }
         
         void shrink_to_fit() {
-            raw_vector<T> v(this->_size);
+            raw_vector<T> v(this->_size, uninitialized);
             std::memcpy(v._allocation, this->_begin, this->_size * sizeof(T));
             this->_begin = v._allocation;
             v.swap(*this);
@@ -172,7 +172,7 @@ namespace manic {
                     std::memcpy(this->_allocation, this->_begin, this->_size * sizeof(T));
                     this->_begin = this->_allocation;
                 } else {
-                    raw_vector<T> v(std::max(this->_size + 1, this->_capacity * 2));
+                    raw_vector<T> v(std::max(this->_size + 1, this->_capacity * 2), uninitialized);
                     std::memcpy(v._allocation, this->_begin, this->_size * sizeof(T));
                     this->_begin = v._allocation;
                     v.swap(*this);
@@ -223,7 +223,7 @@ namespace manic {
                     this->_begin = this->_allocation;
                 } else {
                     // reallocate
-                    raw_vector<T> v(std::max(this->_size + n, this->_capacity * 2));
+                    raw_vector<T> v(std::max(this->_size + n, this->_capacity * 2), uninitialized);
                     std::memcpy(v._allocation, this->_begin, this->_size * sizeof(T));
                     v.swap(*this);
                     this->_begin = this->_allocation;
@@ -24,14 +24,17 @@ world::world()
 }
 
 void world::tick() {
-    if (vector<entity2*>* a = _waiting_on_time.try_get(counter)) {
-        vector<entity2*> b;
+    for (command& c : _commands.drain())
+        _apply(c);
+    if (small_vector<entity2*, 4>* a = _waiting_on_time.try_get(counter)) {
+        small_vector<entity2*, 4> b;
         while (a->size()) {
             assert(b.empty());
             swap(*a, b);
             assert(a->empty());
-            while (!b.empty())
-                b.pop_front()->tick(*this);
+            for (entity2* p : b)
+                p->tick(*this);
+            b.clear();
             // entities may have enqueued themselves at the current time, so
             // we have more work to do, and they may have enqueued themselves
             // at other times, triggering a table resize, so we must find the
@@ -46,8 +49,9 @@ void world::tick() {
     ++counter;
 }
 
-u64 world::read(vec<i64, 2> xy) {
-    return this->_board(xy);
+u64 world::read(vec<i64, 2> xy) const {
+    u64 const* p = this->_board.try_get(xy);
+    return p ? *p : 0;
 }
 
 void world::write(vec<i64, 2> xy, u64 v) {
@@ -56,16 +60,51 @@ void world::write(vec<i64, 2> xy, u64 v) {
 }
 
 void world::_did_write(vec<i64, 2> xy) {
-    vector<entity2*>* a = this->_waiting_on_write.try_get(xy);
+    small_vector<entity2*, 4>* a = this->_waiting_on_write.try_get(xy);
     if (a) {
-        // if somebody is writing, we must be within world::tick
-        // ... unless the write originates from a UI action such as spawning a new entity2?
-        assert(this->_waiting_on_time.contains(this->counter));
-        this->_waiting_on_time[this->counter].append(a->begin(), a->end());
+        // we are within world::tick, perhaps applying a command before any
+        // entity has run at this time
+        this->_waiting_on_time.entry(this->counter).or_insert_with([]() {
+            return small_vector<entity2*, 4>{};
+        }).append(a->begin(), a->end());
         this->_waiting_on_write.erase(xy);
     }
 }
 
+void world::replay(tick_journal& j) {
+    for (tick_journal::entry const& e : j.commit()) {
+        switch (e._kind) {
+            case tick_journal::entry::WRITE:
+                write(e._xy, e._value);
+                break;
+            case tick_journal::entry::WAKE:
+                _did_write(e._xy);
+                break;
+        }
+    }
+}
+
+void world::_apply(command& c) {
+    switch (c._kind) {
+        case command::WRITE:
+            write(c._xy, c._value);
+            break;
+        case command::ADD:
+            write(c._xy, read(c._xy) + c._value);
+            break;
+        case command::SPAWN:
+            if (instruction::is_vacant(read({c._entity->x, c._entity->y})))
+                push_back(c._entity);
+            else
+                delete c._entity;
+            break;
+        case command::PASTE:
+            for (isize i = 0; i != c._region.rows(); ++i)
+                for (isize j = 0; j != c._region.columns(); ++j)
+                    write(c._xy + vec<i64, 2>{i, j}, c._region(i, j));
+            break;
+    }
+}
 
 void world::push_back(entity2* p) {
     // register for drawing
@@ -81,21 +120,36 @@ void world::push_back(entity2* p) {
 
 void world::did_exit(i64 i, i64 j, u64 d) {
     // make tracks
-    _terrain({i, j}) = 255;
+    u8& t = _terrain({i, j});
+    _terrain_lod.did_write({i, j}, t, 255);
+    t = 255;
+}
+
+matrix<u8> world::terrain_tile(isize level, vec<i64, 2> xy) {
+    return _terrain_lod(_terrain, level, xy);
+}
+
+void world::prefetch(vec<i64, 2> lo, vec<i64, 2> hi, vec<double, 2> velocity) {
+    _terrain_prefetcher.install(_terrain);
+    if (!_terrain_prefetcher.request(_terrain, lo, hi, velocity))
+        return;
+    for (entity2* p : _entities)
+        if (!_terrain_prefetcher.request(_terrain, vec<i64, 2>{p->x, p->y}))
+            return;
 }
 
 void world::wait_on_time(u64 t, entity2* p) {
     assert(t >= counter);
     assert(p);
     this->_waiting_on_time.entry(t).or_insert_with([]() {
-        return vector<entity2*>{};
+        return small_vector<entity2*, 4>{};
     }).push_back(p);
     p->t = t;
 }
 
 void world::wait_on_write(vec<i64, 2> x, entity2* p) {
     this->_waiting_on_write.entry(x).or_insert_with([](){
-        return vector<entity2*>{};
+        return small_vector<entity2*, 4>{};
     }).push_back(p);
 }
 
@@ -9,9 +9,15 @@
 #ifndef world_hpp
 #define world_hpp
 
+#include "command_queue.hpp"
 #include "entity2.hpp"
+#include "prefetcher.hpp"
+#include "segmented_vector.hpp"
+#include "small_vector.hpp"
 #include "space2.hpp"
 #include "terrain2.hpp"
+#include "terrain_lod.hpp"
+#include "tick_journal.hpp"
 #include "vector.hpp"
 
 namespace manic {
@@ -38,13 +44,19 @@ struct world {
 
     // Values in mutable cells, cells often empty
     // Values represent numbers, lock/occupancy, etc.
+    //
+    // (space2<_space2_inline<u64>, hamt> would make _board.snapshot() O(1),
+    // at the cost of a trie walk on every access; switch when something
+    // consumes snapshots)
     space2<_space2_inline<u64>> _board;
 
     // Underlying terrain, every tile occupied
     terrain2 _terrain;
+    prefetcher<terrain2> _terrain_prefetcher;
+    terrain_lod _terrain_lod; // <-- edits to _terrain, for zoomed-out views
     
-    // Bag of entities.
-    vector<entity2*> _entities;
+    // Bag of entities.  Segmented so that growth never copies the whole list
+    segmented_vector<entity2*> _entities;
     //usize _next_insert;
     
     // Idea 2: entities spend most of their time waiting (travelling is
@@ -55,8 +67,13 @@ struct world {
     
     u64 counter = 0;
     
-    table3<u64, vector<entity2*>> _waiting_on_time;
-    table3<vec<i64, 2>, vector<entity2*>> _waiting_on_write;
+    // Most bins hold only a few entities, so keep them inline in the table
+    table3<u64, small_vector<entity2*, 4>> _waiting_on_time;
+    table3<vec<i64, 2>, small_vector<entity2*, 4>> _waiting_on_write;
+    
+    // Commands from the UI and network threads, applied at the start of
+    // each tick; other threads may use it concurrently with tick
+    command_queue _commands;
     
     void wait_on_write(vec<i64, 2>, entity2*);
     void wait_on_time(u64, entity2*);
@@ -74,9 +91,15 @@ struct world {
     
     // Can we execute entities by chunk without losing deterministic ordering?
     
-    u64 read(vec<i64, 2> xy);
+    u64 read(vec<i64, 2> xy) const; // <-- empty cells read as zero
     void write(vec<i64, 2> xy, u64 v);
-    void _did_write(vec<i64, 2> xy); // hack until we clean up access
+    void _did_write(vec<i64, 2> xy);
+    
+    void _apply(command&);
+
+    // Commit the journal of a parallel tick, and apply its writes and
+    // wake-ups in its canonical order
+    void replay(tick_journal&);
     
     world();
         
@@ -88,21 +111,33 @@ struct world {
     
     void did_exit(i64 i, i64 j, u64 d);
     
+    // Terrain tile of TILE x TILE block means of 2^level cells, including
+    // edits; the cost does not depend on level
+    matrix<u8> terrain_tile(isize level, vec<i64, 2> xy);
+    
+    // Generate terrain in the background ahead of the view [lo, hi), moving
+    // at velocity cells per frame, and around the entities
+    void prefetch(vec<i64, 2> lo, vec<i64, 2> hi, vec<double, 2> velocity);
+    
 }; // struct world
 
 template<typename Serializer>
 void serialize(world const& x, Serializer& s) {
     serialize(x._board, s);
     serialize(x._terrain, s);
+    serialize(x._terrain_lod, s);
     // entities are hard
     serialize(x.counter, s);
 }
 
+// (not yet instantiable: space2's deserialize returns nothing, and world
+// cannot be moved out while it holds a command_queue)
 template<typename Deserializer>
 auto deserialize(placeholder<world>, Deserializer& d) {
     world x;
     x._board = deserialize<decltype(x._board)>(d);
     x._terrain = deserialize<decltype(x._terrain)>(d);
+    x._terrain_lod = deserialize<terrain_lod>(d);
 
     
     